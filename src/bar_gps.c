@@ -26,6 +26,7 @@
 #include "bar_gps.h"
 
 #include "bar.h"
+#include "cache-metadb.h"
 #include "filedata.h"
 #include "layout.h"
 #include "metadata.h"
@@ -47,6 +48,8 @@
 #define THUMB_SIZE 100
 
 #define DIRECTION_SIZE 300
+#define MARKERS_INDEXED_MAX 64	/* markers of indexed files added per idle call */
+#define VIEWPORT_UPDATE_DELAY 300	/* ms after the map stops moving before markers are re-read */
 
 /*
  *-------------------------------------------------------------------
@@ -69,6 +72,9 @@ struct _PaneGPSData
 	ChamplainBoundingBox *bbox;
 	guint num_added;
 	guint create_markers_id;
+	guint viewport_id;
+	CacheMetaArea viewport;
+	gboolean viewport_only;
 	GtkWidget *progress;
 	GtkWidget *slider;
 	GtkWidget *state;
@@ -420,6 +426,55 @@ static gboolean bar_pane_gps_marker_keypress_cb(GtkWidget *widget, ClutterButton
 	return TRUE;
 }
 
+static void bar_pane_gps_add_marker(PaneGPSData *pgd, FileData *fd,
+				    gdouble latitude, gdouble longitude, gdouble compass)
+{
+	ClutterActor *parent_marker, *label_marker;
+	ClutterActor *direction;
+	ClutterColor marker_colour = { MARKER_COLOUR };
+	ClutterColor thumb_colour = { THUMB_COLOUR };
+	ClutterContent *canvas;
+
+	if (latitude == CACHE_META_NO_COORD) return;
+
+	pgd->num_added++;
+
+	parent_marker = champlain_marker_new();
+	clutter_actor_set_reactive(parent_marker, FALSE);
+	label_marker = champlain_label_new_with_text("i","courier 5", &marker_colour, &marker_colour);
+	clutter_actor_set_reactive(label_marker, TRUE);
+	champlain_marker_set_selection_color(&thumb_colour);
+
+	if (compass != CACHE_META_NO_COORD)
+		{
+		canvas = clutter_canvas_new();
+		clutter_canvas_set_size(CLUTTER_CANVAS (canvas), DIRECTION_SIZE, 3);
+		g_signal_connect(canvas, "draw", G_CALLBACK(bar_gps_draw_direction), NULL);
+		direction = clutter_actor_new();
+		clutter_actor_set_size(direction, DIRECTION_SIZE, 3);
+		clutter_actor_set_position(direction, 0, 0);
+		clutter_actor_set_rotation_angle(direction, CLUTTER_Z_AXIS, compass -90.00);
+		clutter_actor_set_content(direction, canvas);
+		clutter_content_invalidate(canvas);
+		g_object_unref(canvas);
+
+		clutter_actor_add_child(parent_marker, direction);
+		clutter_actor_set_opacity(direction, 0);
+		}
+
+	clutter_actor_add_child(parent_marker, label_marker);
+
+	champlain_location_set_location(CHAMPLAIN_LOCATION(parent_marker), latitude, longitude);
+	champlain_marker_layer_add_marker(pgd->icon_layer, CHAMPLAIN_MARKER(parent_marker));
+
+	g_signal_connect(G_OBJECT(label_marker), "button_release_event",
+			G_CALLBACK(bar_pane_gps_marker_keypress_cb), pgd);
+
+	g_object_set_data(G_OBJECT(label_marker), "file_fd", fd);
+
+	champlain_bounding_box_extend(pgd->bbox, latitude, longitude);
+}
+
 static gboolean bar_pane_gps_create_markers_cb(gpointer data)
 {
 	PaneGPSData *pgd = data;
@@ -427,12 +482,10 @@ static gboolean bar_pane_gps_create_markers_cb(gpointer data)
 	gdouble longitude;
 	gdouble compass;
 	FileData *fd;
-	ClutterActor *parent_marker, *label_marker;
-	ClutterActor *direction;
-	ClutterColor marker_colour = { MARKER_COLOUR };
-	ClutterColor thumb_colour = { THUMB_COLOUR };
+	CacheMetaData *md;
 	GString *message;
-	ClutterContent *canvas;
+	CacheMetaAreaMatch match;
+	gint count = 0;
 
 	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(pgd->progress),
 							(gdouble)(pgd->selection_count - g_list_length(pgd->not_added)) /
@@ -446,52 +499,40 @@ static gboolean bar_pane_gps_create_markers_cb(gpointer data)
 
 	if(pgd->not_added)
 		{
-		fd = pgd->not_added->data;
-		pgd->not_added = pgd->not_added->next;
-
-		latitude = metadata_read_GPS_coord(fd, "Xmp.exif.GPSLatitude", 0);
-		longitude = metadata_read_GPS_coord(fd, "Xmp.exif.GPSLongitude", 0);
-		compass = metadata_read_GPS_direction(fd, "Xmp.exif.GPSImgDirection", 1000);
-
-		if (!(latitude == 0 && longitude == 0))
+		/* indexed positions need no file read, add a batch of them at once */
+		while (pgd->not_added && count < MARKERS_INDEXED_MAX)
 			{
-			pgd->num_added++;
-
-			parent_marker = champlain_marker_new();
-			clutter_actor_set_reactive(parent_marker, FALSE);
-			label_marker = champlain_label_new_with_text("i","courier 5", &marker_colour, &marker_colour);
-			clutter_actor_set_reactive(label_marker, TRUE);
-			champlain_marker_set_selection_color(&thumb_colour);
+			fd = pgd->not_added->data;
 
-			if (compass != 1000)
+			/* files the index places off the visible map are not read */
+			match = CACHE_META_AREA_UNKNOWN;
+			if (pgd->viewport_only) match = cache_meta_db_match_area(fd, &pgd->viewport);
+			if (match == CACHE_META_AREA_NO_POSITION || match == CACHE_META_AREA_OUTSIDE)
 				{
-				canvas = clutter_canvas_new();
-				clutter_canvas_set_size(CLUTTER_CANVAS (canvas), DIRECTION_SIZE, 3);
-				g_signal_connect(canvas, "draw", G_CALLBACK(bar_gps_draw_direction), NULL);
-				direction = clutter_actor_new();
-				clutter_actor_set_size(direction, DIRECTION_SIZE, 3);
-				clutter_actor_set_position(direction, 0, 0);
-				clutter_actor_set_rotation_angle(direction, CLUTTER_Z_AXIS, compass -90.00);
-				clutter_actor_set_content(direction, canvas);
-				clutter_content_invalidate(canvas);
-				g_object_unref(canvas);
-
-				clutter_actor_add_child(parent_marker, direction);
-				clutter_actor_set_opacity(direction, 0);
+				pgd->not_added = pgd->not_added->next;
+				count++;
+				continue;
 				}
 
-			clutter_actor_add_child(parent_marker, label_marker);
-
-			champlain_location_set_location(CHAMPLAIN_LOCATION(parent_marker), latitude, longitude);
-			champlain_marker_layer_add_marker(pgd->icon_layer, CHAMPLAIN_MARKER(parent_marker));
-
-			g_signal_connect(G_OBJECT(label_marker), "button_release_event",
-	 				G_CALLBACK(bar_pane_gps_marker_keypress_cb), pgd);
-
-			g_object_set_data(G_OBJECT(label_marker), "file_fd", fd);
-
-			champlain_bounding_box_extend(pgd->bbox, latitude, longitude);
+			if (!cache_meta_db_load_position(fd, &latitude, &longitude, &compass))
+				{
+				if (count > 0) break;
+
+				/* read from the file, and indexed */
+				md = cache_meta_db_get(fd);
+				latitude = md->latitude;
+				longitude = md->longitude;
+				compass = md->direction;
+				cache_meta_data_free(md);
+				count = MARKERS_INDEXED_MAX;
+				}
+			pgd->not_added = pgd->not_added->next;
 
+			if (!pgd->viewport_only || cache_meta_area_contains(&pgd->viewport, latitude, longitude))
+				{
+				bar_pane_gps_add_marker(pgd, fd, latitude, longitude, compass);
+				}
+			count++;
 			}
 		return TRUE;
 		}
@@ -515,6 +556,24 @@ static gboolean bar_pane_gps_create_markers_cb(gpointer data)
 	return FALSE;
 }
 
+/* the box of the visible map, FALSE when it is not known or crosses the date line */
+static gboolean bar_pane_gps_viewport(PaneGPSData *pgd, CacheMetaArea *area)
+{
+	ChamplainBoundingBox *box;
+	gboolean ret = FALSE;
+
+	box = champlain_view_get_bounding_box(CHAMPLAIN_VIEW(pgd->gps_view));
+	if (box && champlain_bounding_box_is_valid(box) &&
+	    box->bottom < box->top && box->left < box->right)
+		{
+		cache_meta_area_set_box(area, box->bottom, box->top, box->left, box->right);
+		ret = TRUE;
+		}
+	if (box) champlain_bounding_box_free(box);
+
+	return ret;
+}
+
 static void bar_pane_gps_update(PaneGPSData *pgd)
 {
 	GList *list;
@@ -558,6 +617,12 @@ static void bar_pane_gps_update(PaneGPSData *pgd)
 	pgd->not_added = list;
 
 	pgd->bbox = champlain_bounding_box_new();
+
+	/* a map that is not re-centred shows only the markers in view,
+	 * those of all files are wanted to centre it on them
+	 */
+	pgd->viewport_only = !pgd->centre_map_checked && bar_pane_gps_viewport(pgd, &pgd->viewport);
+
 	pgd->selection_count = g_list_length(pgd->selection_list);
 	pgd->create_markers_id = g_idle_add(bar_pane_gps_create_markers_cb, pgd);
 	pgd->num_added = 0;
@@ -754,6 +819,29 @@ static void bar_pane_gps_view_state_changed_cb(ChamplainView *view,
 	g_string_free(message, TRUE);
 }
 
+static gboolean bar_pane_gps_viewport_update_cb(gpointer data)
+{
+	PaneGPSData *pgd = data;
+
+	pgd->viewport_id = 0;
+	bar_pane_gps_update(pgd);
+
+	return FALSE;
+}
+
+static void bar_pane_gps_view_moved_cb(ChamplainView *view,
+				       GParamSpec *gobject,
+				       gpointer data)
+{
+	PaneGPSData *pgd = data;
+
+	if (pgd->centre_map_checked || !pgd->enable_markers_checked) return;
+
+	/* wait for the map to come to rest */
+	if (pgd->viewport_id) g_source_remove(pgd->viewport_id);
+	pgd->viewport_id = g_timeout_add(VIEWPORT_UPDATE_DELAY, bar_pane_gps_viewport_update_cb, pgd);
+}
+
 static void bar_pane_gps_notify_cb(FileData *fd, NotifyType type, gpointer data)
 {
 	PaneGPSData *pgd = data;
@@ -896,6 +984,7 @@ static void bar_pane_gps_destroy(GtkWidget *widget, gpointer data)
 	file_data_unregister_notify_func(bar_pane_gps_notify_cb, pgd);
 
 	g_idle_remove_by_data(pgd);
+	if (pgd->viewport_id) g_source_remove(pgd->viewport_id);
 
 	filelist_free(pgd->selection_list);
 	if (pgd->bbox) champlain_bounding_box_free(pgd->bbox);
@@ -993,6 +1082,9 @@ GtkWidget *bar_pane_gps_new(const gchar *id, const gchar *title, const gchar *ma
 	g_signal_connect(G_OBJECT(gpswidget), "button_press_event", G_CALLBACK(bar_pane_gps_map_keypress_cb), pgd);
 	g_signal_connect(pgd->gps_view, "notify::state", G_CALLBACK(bar_pane_gps_view_state_changed_cb), pgd);
 	g_signal_connect(pgd->gps_view, "notify::zoom-level", G_CALLBACK(bar_pane_gps_view_state_changed_cb), pgd);
+	g_signal_connect(pgd->gps_view, "notify::zoom-level", G_CALLBACK(bar_pane_gps_view_moved_cb), pgd);
+	g_signal_connect(pgd->gps_view, "notify::latitude", G_CALLBACK(bar_pane_gps_view_moved_cb), pgd);
+	g_signal_connect(pgd->gps_view, "notify::longitude", G_CALLBACK(bar_pane_gps_view_moved_cb), pgd);
 	g_signal_connect(G_OBJECT(slider), "value-changed", G_CALLBACK(bar_pane_gps_slider_changed_cb), pgd);
 
 	bar_pane_gps_dnd_init(pgd);
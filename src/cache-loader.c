@@ -22,6 +22,7 @@
 #include "main.h"
 #include "cache-loader.h"
 #include "cache.h"
+#include "cache-simdb.h"
 
 #include "filedata.h"
 #include "exif.h"
@@ -54,10 +55,14 @@ static gboolean cache_loader_process(CacheLoader *cl)
 	    !cl->cd->similarity)
 		{
 		GdkPixbuf *pixbuf;
+		gint width;
+		gint height;
 
 		if (!cl->il && !cl->error)
 			{
 			cl->il = image_loader_new(cl->fd);
+			image_loader_set_queue_priority(cl->il, IMAGE_LOADER_PRIORITY_BACKGROUND);
+			image_loader_set_requested_size(cl->il, IMAGE_SIM_LOAD_SIZE, IMAGE_SIM_LOAD_SIZE);
 			g_signal_connect(G_OBJECT(cl->il), "error", (GCallback)cache_loader_error_cb, cl);
 			g_signal_connect(G_OBJECT(cl->il), "done", (GCallback)cache_loader_done_cb, cl);
 			if (image_loader_start(cl->il))
@@ -82,11 +87,11 @@ static gboolean cache_loader_process(CacheLoader *cl)
 				cl->done_mask |= CACHE_LOADER_SIMILARITY;
 				}
 
-			/* we have the dimensions via pixbuf */
-			if (!cl->cd->dimensions)
+			/* we have the dimensions via the loader, the pixbuf is reduced */
+			if (!cl->cd->dimensions &&
+			    image_loader_get_image_size(cl->il, &width, &height))
 				{
-				cache_sim_data_set_dimensions(cl->cd, gdk_pixbuf_get_width(pixbuf),
-								      gdk_pixbuf_get_height(pixbuf));
+				cache_sim_data_set_dimensions(cl->cd, width, height);
 				if (cl->todo_mask & CACHE_LOADER_DIMENSIONS)
 					{
 					cl->todo_mask &= ~CACHE_LOADER_DIMENSIONS;
@@ -167,20 +172,7 @@ static gboolean cache_loader_process(CacheLoader *cl)
 		if (options->thumbnails.enable_caching &&
 		    cl->done_mask != CACHE_LOADER_NONE)
 			{
-			gchar *base;
-			mode_t mode = 0755;
-
-			base = cache_get_location(CACHE_TYPE_SIM, cl->fd->path, FALSE, &mode);
-			if (recursive_mkdir_if_not_exists(base, mode))
-				{
-				g_free(cl->cd->path);
-				cl->cd->path = cache_get_location(CACHE_TYPE_SIM, cl->fd->path, TRUE, NULL);
-				if (cache_sim_data_save(cl->cd))
-					{
-					filetime_set(cl->cd->path, filetime(cl->fd->path));
-					}
-				}
-			g_free(base);
+			cache_sim_db_save(cl->fd->path, cl->cd);
 			}
 
 		cl->idle_id = 0;
@@ -207,7 +199,6 @@ CacheLoader *cache_loader_new(FileData *fd, CacheDataType load_mask,
 			      CacheLoaderDoneFunc done_func, gpointer done_data)
 {
 	CacheLoader *cl;
-	gchar *found;
 
 	if (!fd || !isfile(fd->path)) return NULL;
 
@@ -217,12 +208,7 @@ CacheLoader *cache_loader_new(FileData *fd, CacheDataType load_mask,
 	cl->done_func = done_func;
 	cl->done_data = done_data;
 
-	found = cache_find_location(CACHE_TYPE_SIM, cl->fd->path);
-	if (found && filetime(found) == filetime(cl->fd->path))
-		{
-		cl->cd = cache_sim_data_load(found);
-		}
-	g_free(found);
+	cl->cd = cache_sim_db_load(cl->fd->path);
 
 	if (!cl->cd) cl->cd = cache_sim_data_new();
 
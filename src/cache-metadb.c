@@ -0,0 +1,957 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <math.h>
+
+#include "main.h"
+#include "cache-metadb.h"
+
+#include "cache.h"
+#include "filedata.h"
+#include "md5-util.h"
+#include "metadata.h"
+#include "ui_fileops.h"
+
+
+/*
+ *-------------------------------------------------------------------
+ * Index file format:
+ *-------------------------------------------------------------------
+ *
+ * A header followed by records, in host byte order:
+ *
+ * header: "GQMETADB", version (guint32), record size (guint32)
+ * record: CacheMetaDbRecord, then keywords_len bytes of keywords, each
+ *         ending with a NUL, then comment_len bytes of the comment
+ *         with its NUL, no comment if 0
+ *
+ * Records are found by the xxh64 of the file name. The whole file is read
+ * into memory on first use, and rewritten when it changed. A file with
+ * another version, record size or byte order is started over.
+ *
+ * The flags tell which of the values were read: the ones for sorting, or
+ * also the ones for searching.
+ *
+ * For searching by position, the entries with one are put
+ * into a grid of CACHE_META_DB_GRID_SIZE degree cells when first needed.
+ * The grid and the entries found in the last area are dropped when the
+ * entries change.
+ */
+
+#define CACHE_META_DB_MAGIC "GQMETADB"
+#define CACHE_META_DB_VERSION 3
+#define CACHE_META_DB_OPEN_MAX 32		/* indexes kept in memory */
+#define CACHE_META_DB_FLUSH_DELAY 10		/* seconds changes are kept before writing */
+#define CACHE_META_DB_GRID_SIZE 1.0		/* degrees */
+#define CACHE_META_DB_INDEX_BATCH 4		/* changed files indexed per idle call */
+
+enum {
+	CACHE_META_DB_GPS	= 1 << 0,
+	CACHE_META_DB_SORT	= 1 << 1,	/* exif dates, rating and orientation */
+	CACHE_META_DB_SEARCH	= 1 << 2	/* keywords, comment and position */
+};
+
+typedef struct _CacheMetaDbHeader CacheMetaDbHeader;
+struct _CacheMetaDbHeader
+{
+	gchar magic[8];
+	guint32 version;
+	guint32 record_size;
+};
+
+/* all members are naturally aligned, there is no padding */
+typedef struct _CacheMetaDbRecord CacheMetaDbRecord;
+struct _CacheMetaDbRecord
+{
+	guint64 name_hash;
+	gint64 mtime;
+	gint64 size;
+	gint64 sidecar_mtime;		/* newest of the sidecars */
+	gint64 exifdate;
+	gint64 exifdate_digitized;
+	gdouble latitude;
+	gdouble longitude;
+	gdouble direction;
+	gint32 rating;
+	gint32 orientation;
+	guint32 flags;
+	guint32 keywords_len;
+	guint32 comment_len;
+	guint32 reserved;
+};
+
+typedef struct _CacheMetaDbEntry CacheMetaDbEntry;
+struct _CacheMetaDbEntry
+{
+	guint64 name_hash;
+	gint64 mtime;
+	gint64 size;
+	gint64 sidecar_mtime;
+	guint32 fields;			/* CACHE_META_DB_SORT and CACHE_META_DB_SEARCH */
+	CacheMetaData md;
+};
+
+typedef struct _CacheMetaDb CacheMetaDb;
+struct _CacheMetaDb
+{
+	gchar *dir;			/* of the indexed files */
+	gchar *path;			/* of the index, in locale encoding */
+	GHashTable *entries;		/* name hash -> CacheMetaDbEntry */
+	gboolean changed;
+
+	GHashTable *grid;		/* cell -> GList of CacheMetaDbEntry, or NULL */
+	CacheMetaArea area;
+	GHashTable *area_inside;	/* name hash -> CacheMetaDbEntry in area, or NULL */
+};
+
+/* most recently used first, all access is under the mutex */
+static GList *cache_meta_db_list = NULL;
+static GMutex *cache_meta_db_mutex = NULL;
+static guint cache_meta_db_flush_id = 0;	/* event source id */
+
+/* changed files to index again, main thread only */
+static GList *cache_meta_db_index_queue = NULL;
+static guint cache_meta_db_index_id = 0;	/* event source id */
+
+
+static void cache_meta_db_lock(void)
+{
+	static gsize init = 0;
+
+	if (g_once_init_enter(&init))
+		{
+#if GLIB_CHECK_VERSION(2,32,0)
+		cache_meta_db_mutex = g_new(GMutex, 1);
+		g_mutex_init(cache_meta_db_mutex);
+#else
+		cache_meta_db_mutex = g_mutex_new();
+#endif
+		g_once_init_leave(&init, 1);
+		}
+
+	g_mutex_lock(cache_meta_db_mutex);
+}
+
+static void cache_meta_db_unlock(void)
+{
+	g_mutex_unlock(cache_meta_db_mutex);
+}
+
+static guint64 cache_meta_db_name_hash(const gchar *path)
+{
+	const gchar *name = filename_from_path(path);
+	XXH64Context ctx;
+
+	xxh64_init(&ctx, 0);
+	xxh64_update(&ctx, (const guchar *)name, strlen(name));
+	return xxh64_final(&ctx);
+}
+
+/* sidecars can hold the metadata without the file itself changing */
+static gint64 cache_meta_db_sidecar_mtime(FileData *fd)
+{
+	gint64 mtime = 0;
+	GList *work;
+
+	for (work = fd->sidecar_files; work; work = work->next)
+		{
+		FileData *sfd = work->data;
+
+		mtime = MAX(mtime, (gint64)sfd->date);
+		}
+
+	return mtime;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * data
+ *-------------------------------------------------------------------
+ */
+
+static void cache_meta_data_clear(CacheMetaData *md)
+{
+	string_list_free(md->keywords);
+	g_free(md->comment);
+	md->keywords = NULL;
+	md->comment = NULL;
+}
+
+static void cache_meta_data_copy(CacheMetaData *dest, const CacheMetaData *src)
+{
+	*dest = *src;
+	dest->keywords = string_list_copy(src->keywords);
+	dest->comment = g_strdup(src->comment);
+}
+
+void cache_meta_data_free(CacheMetaData *md)
+{
+	if (!md) return;
+
+	cache_meta_data_clear(md);
+	g_free(md);
+}
+
+/* reads the data from the file, with the usual metadata functions */
+static CacheMetaData *cache_meta_data_new_from_file(FileData *fd)
+{
+	CacheMetaData *md;
+
+	md = g_new0(CacheMetaData, 1);
+
+	read_exif_time_data(fd);
+	read_exif_time_digitized_data(fd);
+	md->exifdate = fd->exifdate;
+	md->exifdate_digitized = fd->exifdate_digitized;
+
+	md->rating = metadata_read_int(fd, RATING_KEY, STAR_RATING_NOT_READ);
+	md->orientation = metadata_read_int(fd, ORIENTATION_KEY, EXIF_ORIENTATION_TOP_LEFT);
+	md->keywords = metadata_read_list(fd, KEYWORD_KEY, METADATA_PLAIN);
+	md->comment = metadata_read_string(fd, COMMENT_KEY, METADATA_PLAIN);
+
+	md->direction = metadata_read_GPS_direction(fd, "Xmp.exif.GPSImgDirection", CACHE_META_NO_COORD);
+	md->latitude = metadata_read_GPS_coord(fd, "Xmp.exif.GPSLatitude", CACHE_META_NO_COORD);
+	md->longitude = metadata_read_GPS_coord(fd, "Xmp.exif.GPSLongitude", CACHE_META_NO_COORD);
+	if (md->latitude == CACHE_META_NO_COORD || md->longitude == CACHE_META_NO_COORD)
+		{
+		md->latitude = CACHE_META_NO_COORD;
+		md->longitude = CACHE_META_NO_COORD;
+		}
+
+	return md;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * index files
+ *-------------------------------------------------------------------
+ */
+
+static void cache_meta_db_entry_free(gpointer data)
+{
+	CacheMetaDbEntry *entry = data;
+
+	cache_meta_data_clear(&entry->md);
+	g_free(entry);
+}
+
+static void cache_meta_db_read(CacheMetaDb *db)
+{
+	gchar *buf;
+	gsize len;
+	gsize pos;
+	const CacheMetaDbHeader *header;
+
+	if (!g_file_get_contents(db->path, &buf, &len, NULL)) return;
+
+	header = (const CacheMetaDbHeader *)buf;
+	if (len < sizeof(CacheMetaDbHeader) ||
+	    memcmp(header->magic, CACHE_META_DB_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != CACHE_META_DB_VERSION ||
+	    header->record_size != sizeof(CacheMetaDbRecord))
+		{
+		DEBUG_1("metadata index not usable, starting over: %s", db->path);
+		g_free(buf);
+		return;
+		}
+
+	pos = sizeof(CacheMetaDbHeader);
+	while (pos + sizeof(CacheMetaDbRecord) <= len)
+		{
+		CacheMetaDbRecord record;
+		CacheMetaDbEntry *entry;
+		const gchar *keywords;
+		const gchar *p;
+
+		/* records after variable length data are not aligned */
+		memcpy(&record, buf + pos, sizeof(record));
+		pos += sizeof(record);
+
+		/* the rest is cut short, or not ours */
+		if (record.keywords_len > len - pos ||
+		    record.comment_len > len - pos - record.keywords_len) break;
+		if ((record.keywords_len && buf[pos + record.keywords_len - 1] != '\0') ||
+		    (record.comment_len && buf[pos + record.keywords_len + record.comment_len - 1] != '\0')) break;
+
+		entry = g_new0(CacheMetaDbEntry, 1);
+		entry->name_hash = record.name_hash;
+		entry->mtime = record.mtime;
+		entry->size = record.size;
+		entry->sidecar_mtime = record.sidecar_mtime;
+		entry->fields = record.flags & (CACHE_META_DB_SORT | CACHE_META_DB_SEARCH);
+		entry->md.exifdate = (time_t)record.exifdate;
+		entry->md.exifdate_digitized = (time_t)record.exifdate_digitized;
+		entry->md.rating = record.rating;
+		entry->md.orientation = record.orientation;
+		entry->md.latitude = (record.flags & CACHE_META_DB_GPS) ? record.latitude : CACHE_META_NO_COORD;
+		entry->md.longitude = (record.flags & CACHE_META_DB_GPS) ? record.longitude : CACHE_META_NO_COORD;
+		entry->md.direction = record.direction;
+
+		keywords = buf + pos;
+		for (p = keywords; p < keywords + record.keywords_len; p += strlen(p) + 1)
+			{
+			entry->md.keywords = g_list_prepend(entry->md.keywords, g_strdup(p));
+			}
+		entry->md.keywords = g_list_reverse(entry->md.keywords);
+		pos += record.keywords_len;
+
+		if (record.comment_len) entry->md.comment = g_strdup(buf + pos);
+		pos += record.comment_len;
+
+		g_hash_table_replace(db->entries, &entry->name_hash, entry);
+		}
+
+	g_free(buf);
+
+	DEBUG_1("metadata index read, %u records: %s", g_hash_table_size(db->entries), db->path);
+}
+
+static void cache_meta_db_write_entry(gpointer key, gpointer value, gpointer data)
+{
+	CacheMetaDbEntry *entry = value;
+	GString *out = data;
+	CacheMetaDbRecord record;
+	GList *work;
+
+	memset(&record, 0, sizeof(record));
+	record.name_hash = entry->name_hash;
+	record.mtime = entry->mtime;
+	record.size = entry->size;
+	record.sidecar_mtime = entry->sidecar_mtime;
+	record.flags = entry->fields;
+	record.exifdate = entry->md.exifdate;
+	record.exifdate_digitized = entry->md.exifdate_digitized;
+	record.rating = entry->md.rating;
+	record.orientation = entry->md.orientation;
+	record.direction = entry->md.direction;
+	if (entry->md.latitude != CACHE_META_NO_COORD)
+		{
+		record.latitude = entry->md.latitude;
+		record.longitude = entry->md.longitude;
+		record.flags |= CACHE_META_DB_GPS;
+		}
+	for (work = entry->md.keywords; work; work = work->next)
+		{
+		record.keywords_len += strlen(work->data) + 1;
+		}
+	if (entry->md.comment) record.comment_len = strlen(entry->md.comment) + 1;
+
+	g_string_append_len(out, (const gchar *)&record, sizeof(record));
+	for (work = entry->md.keywords; work; work = work->next)
+		{
+		g_string_append_len(out, work->data, strlen(work->data) + 1);
+		}
+	if (entry->md.comment) g_string_append_len(out, entry->md.comment, record.comment_len);
+}
+
+static gboolean cache_meta_db_write(CacheMetaDb *db)
+{
+	CacheMetaDbHeader header;
+	GString *out;
+	gchar *dir;
+	gboolean success;
+
+	if (!db->changed) return TRUE;
+
+	dir = g_path_get_dirname(db->path);
+	success = (g_mkdir_with_parents(dir, 0755) == 0);
+	g_free(dir);
+	if (!success) return FALSE;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_META_DB_MAGIC, sizeof(header.magic));
+	header.version = CACHE_META_DB_VERSION;
+	header.record_size = sizeof(CacheMetaDbRecord);
+
+	out = g_string_new(NULL);
+	g_string_append_len(out, (const gchar *)&header, sizeof(header));
+	g_hash_table_foreach(db->entries, cache_meta_db_write_entry, out);
+
+	/* written to a temporary file and renamed, never seen half done */
+	success = g_file_set_contents(db->path, out->str, out->len, NULL);
+	g_string_free(out, TRUE);
+
+	if (success) db->changed = FALSE;
+
+	DEBUG_1("metadata index written, %u records: %s", g_hash_table_size(db->entries), db->path);
+
+	return success;
+}
+
+static void cache_meta_db_grid_clear(CacheMetaDb *db)
+{
+	if (db->grid) g_hash_table_destroy(db->grid);
+	if (db->area_inside) g_hash_table_destroy(db->area_inside);
+	db->grid = NULL;
+	db->area_inside = NULL;
+}
+
+static void cache_meta_db_free(CacheMetaDb *db)
+{
+	if (!cache_meta_db_write(db)) log_printf("Unable to save metadata index: %s\n", db->path);
+
+	cache_meta_db_grid_clear(db);
+	g_hash_table_destroy(db->entries);
+	g_free(db->dir);
+	g_free(db->path);
+	g_free(db);
+}
+
+/* the index for the file at path, in locale encoding */
+static gchar *cache_meta_db_path(const gchar *path)
+{
+	gchar *base;
+	gchar *db_path;
+
+	base = cache_get_location(CACHE_TYPE_METADATA, path, FALSE, NULL);
+	if (!base) return NULL;
+
+	db_path = g_build_filename(base, GQ_CACHE_META_DB, NULL);
+	g_free(base);
+
+	base = path_from_utf8(db_path);
+	g_free(db_path);
+
+	return base;
+}
+
+static CacheMetaDb *cache_meta_db_get_db(const gchar *path)
+{
+	CacheMetaDb *db;
+	GList *work;
+	gchar *dir;
+	gchar *db_path;
+
+	dir = remove_level_from_path(path);
+
+	work = cache_meta_db_list;
+	while (work)
+		{
+		db = work->data;
+		if (strcmp(db->dir, dir) == 0)
+			{
+			cache_meta_db_list = g_list_remove_link(cache_meta_db_list, work);
+			cache_meta_db_list = g_list_concat(work, cache_meta_db_list);
+			g_free(dir);
+			return db;
+			}
+		work = work->next;
+		}
+
+	db_path = cache_meta_db_path(path);
+	if (!db_path)
+		{
+		g_free(dir);
+		return NULL;
+		}
+
+	db = g_new0(CacheMetaDb, 1);
+	db->dir = dir;
+	db->path = db_path;
+	db->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, cache_meta_db_entry_free);
+	cache_meta_db_read(db);
+
+	cache_meta_db_list = g_list_prepend(cache_meta_db_list, db);
+	if (g_list_length(cache_meta_db_list) > CACHE_META_DB_OPEN_MAX)
+		{
+		work = g_list_last(cache_meta_db_list);
+		cache_meta_db_free(work->data);
+		cache_meta_db_list = g_list_delete_link(cache_meta_db_list, work);
+		}
+
+	return db;
+}
+
+static void cache_meta_db_flush_unlocked(void)
+{
+	GList *work;
+
+	for (work = cache_meta_db_list; work; work = work->next)
+		{
+		CacheMetaDb *db = work->data;
+
+		if (!cache_meta_db_write(db)) log_printf("Unable to save metadata index: %s\n", db->path);
+		}
+}
+
+static gboolean cache_meta_db_flush_cb(gpointer data)
+{
+	cache_meta_db_lock();
+	cache_meta_db_flush_id = 0;
+	cache_meta_db_flush_unlocked();
+	cache_meta_db_unlock();
+
+	return FALSE;
+}
+
+static void cache_meta_db_changed(CacheMetaDb *db)
+{
+	cache_meta_db_grid_clear(db);
+
+	db->changed = TRUE;
+	if (!cache_meta_db_flush_id)
+		{
+		cache_meta_db_flush_id = g_timeout_add_seconds(CACHE_META_DB_FLUSH_DELAY, cache_meta_db_flush_cb, NULL);
+		}
+}
+
+static void cache_meta_db_remove_path(const gchar *path)
+{
+	CacheMetaDb *db;
+	guint64 name_hash;
+
+	name_hash = cache_meta_db_name_hash(path);
+
+	cache_meta_db_lock();
+	db = cache_meta_db_get_db(path);
+	if (db && g_hash_table_remove(db->entries, &name_hash)) cache_meta_db_changed(db);
+	cache_meta_db_unlock();
+}
+
+static gboolean cache_meta_db_index_cb(gpointer data)
+{
+	gint i;
+
+	for (i = 0; i < CACHE_META_DB_INDEX_BATCH && cache_meta_db_index_queue; i++)
+		{
+		FileData *fd = cache_meta_db_index_queue->data;
+
+		cache_meta_db_index_queue = g_list_delete_link(cache_meta_db_index_queue, cache_meta_db_index_queue);
+
+		/* gone or moved on again; unwritten changes notify again once written */
+		if (isfile(fd->path) && !fd->modified_xmp) cache_meta_data_free(cache_meta_db_get(fd));
+		file_data_unref(fd);
+		}
+
+	if (cache_meta_db_index_queue) return TRUE;
+
+	cache_meta_db_index_id = 0;
+	return FALSE;
+}
+
+static void cache_meta_db_index_add(FileData *fd)
+{
+	if (g_list_find(cache_meta_db_index_queue, fd)) return;
+
+	cache_meta_db_index_queue = g_list_append(cache_meta_db_index_queue, file_data_ref(fd));
+	if (!cache_meta_db_index_id)
+		{
+		cache_meta_db_index_id = g_idle_add_full(G_PRIORITY_LOW, cache_meta_db_index_cb, NULL, NULL);
+		}
+}
+
+/* metadata changed by geeqie may go to sidecars or the metadata cache,
+ * without the file changing; the files are indexed again when idle, so
+ * the index is up to date for the next search
+ */
+static void cache_meta_db_notify_cb(FileData *fd, NotifyType type, gpointer data)
+{
+	if (!(type & (NOTIFY_METADATA | NOTIFY_ORIENTATION | NOTIFY_REREAD | NOTIFY_CHANGE))) return;
+
+	DEBUG_1("Notify metadata index: %s %04x", fd->path, type);
+
+	cache_meta_db_remove_path(fd->path);
+	if ((type & NOTIFY_CHANGE) && fd->change && fd->change->source)
+		{
+		cache_meta_db_remove_path(fd->change->source);
+		}
+
+	cache_meta_db_index_add(fd);
+}
+
+static void cache_meta_db_notify_init(void)
+{
+	static gboolean notify_registered = FALSE;
+
+	if (notify_registered) return;
+
+	file_data_register_notify_func(cache_meta_db_notify_cb, NULL, NOTIFY_PRIORITY_HIGH);
+	notify_registered = TRUE;
+}
+
+/* the up to date entry of fd with the fields, or NULL; db_return is
+ * set to its index if not NULL
+ */
+static CacheMetaDbEntry *cache_meta_db_lookup(FileData *fd, guint32 fields, CacheMetaDb **db_return)
+{
+	CacheMetaDb *db;
+	CacheMetaDbEntry *entry;
+	guint64 name_hash;
+
+	name_hash = cache_meta_db_name_hash(fd->path);
+
+	db = cache_meta_db_get_db(fd->path);
+	if (db_return) *db_return = db;
+	entry = db ? g_hash_table_lookup(db->entries, &name_hash) : NULL;
+	if (entry &&
+	    (entry->fields & fields) == fields &&
+	    entry->mtime == (gint64)fd->date &&
+	    entry->size == (gint64)fd->size &&
+	    entry->sidecar_mtime == cache_meta_db_sidecar_mtime(fd)) return entry;
+
+	return NULL;
+}
+
+static void cache_meta_db_add(FileData *fd, CacheMetaDbEntry *entry)
+{
+	CacheMetaDb *db;
+
+	entry->name_hash = cache_meta_db_name_hash(fd->path);
+	entry->mtime = fd->date;
+	entry->size = fd->size;
+	entry->sidecar_mtime = cache_meta_db_sidecar_mtime(fd);
+
+	db = cache_meta_db_get_db(fd->path);
+	if (db)
+		{
+		g_hash_table_replace(db->entries, &entry->name_hash, entry);
+		cache_meta_db_changed(db);
+		}
+	else
+		{
+		cache_meta_db_entry_free(entry);
+		}
+}
+
+/*
+ *-------------------------------------------------------------------
+ * positions
+ *-------------------------------------------------------------------
+ */
+
+static gint cache_meta_db_grid_cell(gint lat_cell, gint lon_cell)
+{
+	return lat_cell * 1000 + lon_cell;
+}
+
+static gint cache_meta_db_grid_coord(gdouble coord)
+{
+	return (gint)floor(coord / CACHE_META_DB_GRID_SIZE);
+}
+
+static void cache_meta_db_grid_add(gpointer key, gpointer value, gpointer data)
+{
+	CacheMetaDbEntry *entry = value;
+	GHashTable *grid = data;
+	gpointer cell;
+
+	if (entry->md.latitude == CACHE_META_NO_COORD) return;
+
+	cell = GINT_TO_POINTER(cache_meta_db_grid_cell(cache_meta_db_grid_coord(entry->md.latitude),
+						       cache_meta_db_grid_coord(entry->md.longitude)));
+	g_hash_table_insert(grid, cell, g_list_prepend(g_hash_table_lookup(grid, cell), entry));
+}
+
+static void cache_meta_db_area_add_list(CacheMetaDb *db, GList *list)
+{
+	while (list)
+		{
+		CacheMetaDbEntry *entry = list->data;
+
+		if (cache_meta_area_contains(&db->area, entry->md.latitude, entry->md.longitude))
+			{
+			g_hash_table_insert(db->area_inside, &entry->name_hash, entry);
+			}
+		list = list->next;
+		}
+}
+
+static void cache_meta_db_area_add_cell(gpointer key, gpointer value, gpointer data)
+{
+	cache_meta_db_area_add_list(data, value);
+}
+
+/* the name hashes of the entries in area, kept until the entries or the area change */
+static GHashTable *cache_meta_db_area_inside(CacheMetaDb *db, const CacheMetaArea *area)
+{
+	gint lat_min, lat_max, lon_min, lon_max;
+	gint lat_cell, lon_cell;
+
+	if (db->area_inside && memcmp(&db->area, area, sizeof(CacheMetaArea)) == 0) return db->area_inside;
+
+	if (!db->grid)
+		{
+		db->grid = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_list_free);
+		g_hash_table_foreach(db->entries, cache_meta_db_grid_add, db->grid);
+		}
+
+	if (db->area_inside) g_hash_table_destroy(db->area_inside);
+	db->area_inside = g_hash_table_new(g_int64_hash, g_int64_equal);
+	db->area = *area;
+
+	lat_min = cache_meta_db_grid_coord(area->lat_min);
+	lat_max = cache_meta_db_grid_coord(area->lat_max);
+	lon_min = cache_meta_db_grid_coord(area->lon_min);
+	lon_max = cache_meta_db_grid_coord(area->lon_max);
+
+	if ((gdouble)(lat_max - lat_min + 1) * (lon_max - lon_min + 1) > g_hash_table_size(db->grid))
+		{
+		/* more cells in the area than used ones */
+		g_hash_table_foreach(db->grid, cache_meta_db_area_add_cell, db);
+		}
+	else
+		{
+		for (lat_cell = lat_min; lat_cell <= lat_max; lat_cell++)
+			{
+			for (lon_cell = lon_min; lon_cell <= lon_max; lon_cell++)
+				{
+				cache_meta_db_area_add_list(db, g_hash_table_lookup(db->grid,
+							    GINT_TO_POINTER(cache_meta_db_grid_cell(lat_cell, lon_cell))));
+				}
+			}
+		}
+
+	DEBUG_1("metadata index area, %u of %u records: %s", g_hash_table_size(db->area_inside),
+		g_hash_table_size(db->entries), db->path);
+
+	return db->area_inside;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * public
+ *-------------------------------------------------------------------
+ */
+
+void cache_meta_area_set(CacheMetaArea *area, gdouble latitude, gdouble longitude, gdouble radius)
+{
+	gdouble degrees = radius * 180.0 / G_PI;
+	gdouble lon_degrees;
+
+	area->latitude = latitude;
+	area->longitude = longitude;
+	area->radius = radius;
+
+	area->lat_min = latitude - degrees;
+	area->lat_max = latitude + degrees;
+	area->lon_min = -180.0;
+	area->lon_max = 180.0;
+
+	/* narrower in longitude, unless it takes in a pole or crosses 180 degrees */
+	if (area->lat_min > -90.0 && area->lat_max < 90.0)
+		{
+		lon_degrees = degrees / cos(MAX(fabs(area->lat_min), fabs(area->lat_max)) * G_PI / 180.0);
+		if (longitude - lon_degrees > -180.0 && longitude + lon_degrees < 180.0)
+			{
+			area->lon_min = longitude - lon_degrees;
+			area->lon_max = longitude + lon_degrees;
+			}
+		}
+
+	area->lat_min = MAX(area->lat_min, -90.0);
+	area->lat_max = MIN(area->lat_max, 90.0);
+}
+
+void cache_meta_area_set_box(CacheMetaArea *area, gdouble lat_min, gdouble lat_max,
+			     gdouble lon_min, gdouble lon_max)
+{
+	area->latitude = (lat_min + lat_max) / 2;
+	area->longitude = (lon_min + lon_max) / 2;
+	area->radius = -1.0;
+
+	area->lat_min = lat_min;
+	area->lat_max = lat_max;
+	area->lon_min = lon_min;
+	area->lon_max = lon_max;
+}
+
+gboolean cache_meta_area_contains(const CacheMetaArea *area, gdouble latitude, gdouble longitude)
+{
+	gdouble lat1, lat2;
+	gdouble c;
+
+	if (latitude < area->lat_min || latitude > area->lat_max ||
+	    longitude < area->lon_min || longitude > area->lon_max) return FALSE;
+
+	if (area->radius < 0.0) return TRUE;
+
+	/* the angle between them, on a sphere */
+	lat1 = latitude * G_PI / 180.0;
+	lat2 = area->latitude * G_PI / 180.0;
+	c = sin(lat1) * sin(lat2) + cos(lat1) * cos(lat2) * cos((area->longitude - longitude) * G_PI / 180.0);
+
+	return (acos(CLAMP(c, -1.0, 1.0)) <= area->radius);
+}
+
+
+CacheMetaData *cache_meta_db_load(FileData *fd)
+{
+	CacheMetaData *md = NULL;
+	CacheMetaDbEntry *entry;
+
+	if (!fd) return NULL;
+
+	cache_meta_db_lock();
+	entry = cache_meta_db_lookup(fd, CACHE_META_DB_SORT | CACHE_META_DB_SEARCH, NULL);
+	if (entry)
+		{
+		md = g_new0(CacheMetaData, 1);
+		cache_meta_data_copy(md, &entry->md);
+		}
+	cache_meta_db_unlock();
+
+	return md;
+}
+
+void cache_meta_db_save(FileData *fd, CacheMetaData *md)
+{
+	CacheMetaDbEntry *entry;
+
+	if (!fd || !md) return;
+
+	entry = g_new0(CacheMetaDbEntry, 1);
+	entry->fields = CACHE_META_DB_SORT | CACHE_META_DB_SEARCH;
+	cache_meta_data_copy(&entry->md, md);
+
+	cache_meta_db_lock();
+	cache_meta_db_add(fd, entry);
+	cache_meta_db_unlock();
+}
+
+void cache_meta_db_remove(FileData *fd)
+{
+	if (fd) cache_meta_db_remove_path(fd->path);
+}
+
+CacheMetaData *cache_meta_db_get(FileData *fd)
+{
+	CacheMetaData *md;
+
+	cache_meta_db_notify_init();
+
+	md = cache_meta_db_load(fd);
+	if (md) return md;
+
+	md = cache_meta_data_new_from_file(fd);
+	cache_meta_db_save(fd, md);
+
+	return md;
+}
+
+gboolean cache_meta_db_load_sort_data(FileData *fd)
+{
+	CacheMetaDbEntry *entry;
+
+	if (!fd) return FALSE;
+
+	cache_meta_db_notify_init();
+
+	cache_meta_db_lock();
+	entry = cache_meta_db_lookup(fd, CACHE_META_DB_SORT, NULL);
+	if (entry)
+		{
+		fd->exifdate = entry->md.exifdate;
+		fd->exifdate_digitized = entry->md.exifdate_digitized;
+		fd->rating = entry->md.rating;
+		if (!fd->exif_orientation) fd->exif_orientation = entry->md.orientation;
+		}
+	cache_meta_db_unlock();
+
+	return (entry != NULL);
+}
+
+void cache_meta_db_save_sort_data(FileData *fd)
+{
+	CacheMetaDbEntry *entry;
+
+	if (!fd) return;
+
+	cache_meta_db_notify_init();
+
+	cache_meta_db_lock();
+	/* an entry with everything stays */
+	if (!cache_meta_db_lookup(fd, CACHE_META_DB_SORT, NULL))
+		{
+		entry = g_new0(CacheMetaDbEntry, 1);
+		entry->fields = CACHE_META_DB_SORT;
+		entry->md.exifdate = fd->exifdate;
+		entry->md.exifdate_digitized = fd->exifdate_digitized;
+		entry->md.rating = fd->rating;
+		entry->md.orientation = fd->exif_orientation ? fd->exif_orientation : EXIF_ORIENTATION_TOP_LEFT;
+		entry->md.latitude = CACHE_META_NO_COORD;
+		entry->md.longitude = CACHE_META_NO_COORD;
+		entry->md.direction = CACHE_META_NO_COORD;
+		cache_meta_db_add(fd, entry);
+		}
+	cache_meta_db_unlock();
+}
+
+CacheMetaAreaMatch cache_meta_db_match_area(FileData *fd, const CacheMetaArea *area)
+{
+	CacheMetaAreaMatch match;
+	CacheMetaDbEntry *entry;
+	CacheMetaDb *db;
+
+	if (!fd) return CACHE_META_AREA_UNKNOWN;
+
+	cache_meta_db_notify_init();
+
+	cache_meta_db_lock();
+	entry = cache_meta_db_lookup(fd, CACHE_META_DB_SEARCH, &db);
+	if (!entry)
+		{
+		match = CACHE_META_AREA_UNKNOWN;
+		}
+	else if (entry->md.latitude == CACHE_META_NO_COORD)
+		{
+		match = CACHE_META_AREA_NO_POSITION;
+		}
+	else
+		{
+		match = g_hash_table_lookup(cache_meta_db_area_inside(db, area), &entry->name_hash) ?
+			CACHE_META_AREA_INSIDE : CACHE_META_AREA_OUTSIDE;
+		}
+	cache_meta_db_unlock();
+
+	return match;
+}
+
+gboolean cache_meta_db_load_position(FileData *fd, gdouble *latitude, gdouble *longitude, gdouble *direction)
+{
+	CacheMetaDbEntry *entry;
+
+	if (!fd) return FALSE;
+
+	cache_meta_db_notify_init();
+
+	cache_meta_db_lock();
+	entry = cache_meta_db_lookup(fd, CACHE_META_DB_SEARCH, NULL);
+	if (entry)
+		{
+		*latitude = entry->md.latitude;
+		*longitude = entry->md.longitude;
+		*direction = entry->md.direction;
+		}
+	cache_meta_db_unlock();
+
+	return (entry != NULL);
+}
+
+void cache_meta_db_flush(void)
+{
+	cache_meta_db_lock();
+	if (cache_meta_db_flush_id)
+		{
+		g_source_remove(cache_meta_db_flush_id);
+		cache_meta_db_flush_id = 0;
+		}
+	cache_meta_db_flush_unlocked();
+	cache_meta_db_unlock();
+}
+
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CACHE_METADB_H
+#define CACHE_METADB_H
+
+#define GQ_CACHE_META_DB	"metaindex.db"
+
+/* no GPS position */
+#define CACHE_META_NO_COORD 1000.0
+
+/*
+ * An index of the metadata searched for and sorted by, for all files of
+ * a directory, in one file of the metadata cache. Entries are only valid
+ * for the size and mtime of the file and its sidecars they were read from,
+ * and are dropped when geeqie changes the metadata. Changed files are
+ * indexed again when idle. Changes are written out a little later, or by
+ * cache_meta_db_flush(). Thread safe.
+ */
+
+typedef struct _CacheMetaData CacheMetaData;
+struct _CacheMetaData
+{
+	time_t exifdate;
+	time_t exifdate_digitized;
+	gint rating;			/* STAR_RATING_NOT_READ if none */
+	gint orientation;
+	gdouble latitude;		/* CACHE_META_NO_COORD if none */
+	gdouble longitude;
+	gdouble direction;		/* CACHE_META_NO_COORD if none */
+	GList *keywords;
+	gchar *comment;
+};
+
+void cache_meta_data_free(CacheMetaData *md);
+
+/* the indexed data of fd, NULL if there is none that is up to date */
+CacheMetaData *cache_meta_db_load(FileData *fd);
+void cache_meta_db_save(FileData *fd, CacheMetaData *md);
+void cache_meta_db_remove(FileData *fd);
+
+/* the indexed data of fd, read from the file and indexed when needed;
+ * that uses the metadata functions, so only from the main thread
+ */
+CacheMetaData *cache_meta_db_get(FileData *fd);
+
+/* the exif dates, rating and exif orientation of fd, set in fd if they are
+ * indexed; saved from fd after they were read from the file. These are
+ * for sorting, without reading the files. Only from the main thread.
+ */
+gboolean cache_meta_db_load_sort_data(FileData *fd);
+void cache_meta_db_save_sort_data(FileData *fd);
+
+/* an area around a position, radius in radians on the sphere, and the
+ * box of latitudes and longitudes in degrees around it; or only a box
+ */
+typedef struct _CacheMetaArea CacheMetaArea;
+struct _CacheMetaArea
+{
+	gdouble latitude;
+	gdouble longitude;
+	gdouble radius;			/* negative for the box only */
+	gdouble lat_min;
+	gdouble lat_max;
+	gdouble lon_min;
+	gdouble lon_max;
+};
+
+typedef enum {
+	CACHE_META_AREA_UNKNOWN,	/* not indexed, read the file */
+	CACHE_META_AREA_NO_POSITION,
+	CACHE_META_AREA_OUTSIDE,
+	CACHE_META_AREA_INSIDE
+} CacheMetaAreaMatch;
+
+void cache_meta_area_set(CacheMetaArea *area, gdouble latitude, gdouble longitude, gdouble radius);
+void cache_meta_area_set_box(CacheMetaArea *area, gdouble lat_min, gdouble lat_max,
+			     gdouble lon_min, gdouble lon_max);
+gboolean cache_meta_area_contains(const CacheMetaArea *area, gdouble latitude, gdouble longitude);
+
+/* whether the indexed position of fd is in area; the positions of a
+ * directory are looked up by grid cells, and the result for the last
+ * area is kept, so matching all files of it with one area is fast
+ */
+CacheMetaAreaMatch cache_meta_db_match_area(FileData *fd, const CacheMetaArea *area);
+
+/* the indexed position and image direction of fd, without the rest of
+ * the data; FALSE if fd is not indexed, latitude is CACHE_META_NO_COORD
+ * for no position
+ */
+gboolean cache_meta_db_load_position(FileData *fd, gdouble *latitude, gdouble *longitude, gdouble *direction);
+
+/* writes out the changed indexes */
+void cache_meta_db_flush(void);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
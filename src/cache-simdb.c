@@ -0,0 +1,745 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "main.h"
+#include "cache-simdb.h"
+
+#include "md5-util.h"
+#include "ui_fileops.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+/*
+ *-------------------------------------------------------------------
+ * Database file format:
+ *-------------------------------------------------------------------
+ *
+ * A header followed by records of fixed size, in host byte order:
+ *
+ * header: "GQSIMDB\n", version (guint32), record size (guint32)
+ * record: CacheSimDbRecord
+ *
+ * Records are found by the xxh64 of the file name and are only valid
+ * for the size and mtime of the file they were made from. A record is
+ * updated in place, new ones are appended. A file with another version,
+ * record size or byte order is started over.
+ *
+ * The records of removed files are cleared to a name hash of 0 and
+ * reused for new ones. When more than half of the records are cleared,
+ * the file is written anew with only the others.
+ */
+
+#define CACHE_SIM_DB_MAGIC "GQSIMDB\n"
+#define CACHE_SIM_DB_VERSION 1
+#define CACHE_SIM_DB_OPEN_MAX 32	/* databases kept mapped */
+#define CACHE_SIM_DB_FREE_MIN 16	/* cleared records before the file is compacted */
+#define CACHE_SIM_DB_COPY_MAX 16	/* appended records kept in memory before the file is mapped again */
+
+enum {
+	CACHE_SIM_DB_DIMENSIONS	= 1 << 0,
+	CACHE_SIM_DB_DATE	= 1 << 1,
+	CACHE_SIM_DB_MD5SUM	= 1 << 2,
+	CACHE_SIM_DB_XXH64SUM	= 1 << 3,
+	CACHE_SIM_DB_SIMILARITY	= 1 << 4
+};
+
+typedef struct _CacheSimDbHeader CacheSimDbHeader;
+struct _CacheSimDbHeader
+{
+	gchar magic[8];
+	guint32 version;
+	guint32 record_size;
+};
+
+/* all members are naturally aligned, there is no padding */
+typedef struct _CacheSimDbRecord CacheSimDbRecord;
+struct _CacheSimDbRecord
+{
+	guint64 name_hash;
+	gint64 mtime;
+	gint64 size;
+	gint64 date;
+	gint32 width;
+	gint32 height;
+	guint32 flags;
+	guint32 reserved;
+	guchar md5sum[16];
+	guchar xxh64sum[8];
+	guint8 avg_r[1024];
+	guint8 avg_g[1024];
+	guint8 avg_b[1024];
+};
+
+typedef struct _CacheSimDbEntry CacheSimDbEntry;
+struct _CacheSimDbEntry
+{
+	guint64 name_hash;
+	goffset offset;			/* of the record in the file */
+	CacheSimDbRecord *copy;		/* appended after the file was mapped */
+};
+
+typedef struct _CacheSimDb CacheSimDb;
+struct _CacheSimDb
+{
+	gchar *path;			/* of the database, in locale encoding */
+	guchar *map;
+	gsize map_size;
+	dev_t dev;			/* of the file that was mapped, to notice it was replaced */
+	ino_t ino;
+	GHashTable *entries;		/* name hash -> CacheSimDbEntry */
+	GArray *free;			/* offsets of the cleared records */
+	guint copies;			/* entries with a copy */
+};
+
+/* most recently used first, all access is under the mutex */
+static GList *cache_sim_db_list = NULL;
+static GMutex *cache_sim_db_mutex = NULL;
+
+
+static void cache_sim_db_lock(void)
+{
+	static gsize init = 0;
+
+	if (g_once_init_enter(&init))
+		{
+#if GLIB_CHECK_VERSION(2,32,0)
+		cache_sim_db_mutex = g_new(GMutex, 1);
+		g_mutex_init(cache_sim_db_mutex);
+#else
+		cache_sim_db_mutex = g_mutex_new();
+#endif
+		g_once_init_leave(&init, 1);
+		}
+
+	g_mutex_lock(cache_sim_db_mutex);
+}
+
+static void cache_sim_db_unlock(void)
+{
+	g_mutex_unlock(cache_sim_db_mutex);
+}
+
+static guint64 cache_sim_db_name_hash(const gchar *path)
+{
+	const gchar *name = filename_from_path(path);
+	XXH64Context ctx;
+
+	xxh64_init(&ctx, 0);
+	xxh64_update(&ctx, (const guchar *)name, strlen(name));
+
+	return xxh64_final(&ctx);
+}
+
+/*
+ *-------------------------------------------------------------------
+ * database handles
+ *-------------------------------------------------------------------
+ */
+
+static void cache_sim_db_entry_free(gpointer data)
+{
+	CacheSimDbEntry *entry = data;
+
+	g_free(entry->copy);
+	g_free(entry);
+}
+
+static const CacheSimDbRecord *cache_sim_db_entry_record(CacheSimDb *db, CacheSimDbEntry *entry)
+{
+	if (entry->copy) return entry->copy;
+
+	return (const CacheSimDbRecord *)(db->map + entry->offset);
+}
+
+static void cache_sim_db_unmap(CacheSimDb *db)
+{
+	g_hash_table_remove_all(db->entries);
+	g_array_set_size(db->free, 0);
+	db->copies = 0;
+	if (db->map) munmap(db->map, db->map_size);
+	db->map = NULL;
+	db->map_size = 0;
+}
+
+static void cache_sim_db_map(CacheSimDb *db)
+{
+	struct stat st;
+	const CacheSimDbHeader *header;
+	gsize count;
+	gsize i;
+	gint fd;
+
+	fd = open(db->path, O_RDONLY);
+	if (fd < 0) return;
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheSimDbHeader))
+		{
+		close(fd);
+		return;
+		}
+
+	db->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (db->map == MAP_FAILED)
+		{
+		db->map = NULL;
+		return;
+		}
+	db->map_size = st.st_size;
+	db->dev = st.st_dev;
+	db->ino = st.st_ino;
+
+	header = (const CacheSimDbHeader *)db->map;
+	if (memcmp(header->magic, CACHE_SIM_DB_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != CACHE_SIM_DB_VERSION ||
+	    header->record_size != sizeof(CacheSimDbRecord))
+		{
+		DEBUG_1("sim cache db not usable, starting over: %s", db->path);
+		cache_sim_db_unmap(db);
+		return;
+		}
+
+	/* a record cut short by a crash is left out, and later overwritten */
+	count = (db->map_size - sizeof(CacheSimDbHeader)) / sizeof(CacheSimDbRecord);
+	for (i = 0; i < count; i++)
+		{
+		goffset offset = sizeof(CacheSimDbHeader) + i * sizeof(CacheSimDbRecord);
+		const CacheSimDbRecord *record = (const CacheSimDbRecord *)(db->map + offset);
+		CacheSimDbEntry *entry;
+
+		if (record->name_hash == 0)
+			{
+			g_array_append_val(db->free, offset);
+			continue;
+			}
+
+		entry = g_new0(CacheSimDbEntry, 1);
+		entry->offset = offset;
+		entry->name_hash = record->name_hash;
+
+		g_hash_table_replace(db->entries, &entry->name_hash, entry);
+		}
+
+	DEBUG_1("sim cache db mapped, %" G_GSIZE_FORMAT " records: %s", count, db->path);
+}
+
+static void cache_sim_db_free(CacheSimDb *db)
+{
+	cache_sim_db_unmap(db);
+	g_hash_table_destroy(db->entries);
+	g_array_free(db->free, TRUE);
+	g_free(db->path);
+	g_free(db);
+}
+
+static CacheSimDb *cache_sim_db_get(const gchar *path)
+{
+	CacheSimDb *db;
+	GList *work;
+
+	work = cache_sim_db_list;
+	while (work)
+		{
+		db = work->data;
+		if (strcmp(db->path, path) == 0)
+			{
+			cache_sim_db_list = g_list_remove_link(cache_sim_db_list, work);
+			cache_sim_db_list = g_list_concat(work, cache_sim_db_list);
+			return db;
+			}
+		work = work->next;
+		}
+
+	db = g_new0(CacheSimDb, 1);
+	db->path = g_strdup(path);
+	db->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, cache_sim_db_entry_free);
+	db->free = g_array_new(FALSE, FALSE, sizeof(goffset));
+	cache_sim_db_map(db);
+
+	cache_sim_db_list = g_list_prepend(cache_sim_db_list, db);
+	if (g_list_length(cache_sim_db_list) > CACHE_SIM_DB_OPEN_MAX)
+		{
+		work = g_list_last(cache_sim_db_list);
+		cache_sim_db_free(work->data);
+		cache_sim_db_list = g_list_delete_link(cache_sim_db_list, work);
+		}
+
+	return db;
+}
+
+/* the database file opened for writing, created if it is not there;
+ * the map is brought up to date with it, -1 on failure
+ */
+static gint cache_sim_db_open(CacheSimDb *db, struct stat *st)
+{
+	gint fd;
+
+	fd = open(db->path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return -1;
+
+	if (fstat(fd, st) != 0)
+		{
+		close(fd);
+		return -1;
+		}
+
+	if (!db->map || st->st_dev != db->dev || st->st_ino != db->ino ||
+	    st->st_size < (off_t)sizeof(CacheSimDbHeader))
+		{
+		/* not the file that was read, take it as it is now */
+		cache_sim_db_unmap(db);
+		cache_sim_db_map(db);
+		}
+
+	if (!db->map)
+		{
+		CacheSimDbHeader header;
+
+		/* new or unusable, start over */
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CACHE_SIM_DB_MAGIC, sizeof(header.magic));
+		header.version = CACHE_SIM_DB_VERSION;
+		header.record_size = sizeof(CacheSimDbRecord);
+
+		if (ftruncate(fd, 0) != 0 ||
+		    pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+			{
+			close(fd);
+			return -1;
+			}
+		st->st_size = sizeof(header);
+		cache_sim_db_unmap(db);
+		cache_sim_db_map(db);
+		}
+
+	return fd;
+}
+
+static gboolean cache_sim_db_write(CacheSimDb *db, const CacheSimDbRecord *record)
+{
+	CacheSimDbEntry *entry;
+	struct stat st;
+	off_t offset;
+	gint fd;
+	gboolean success;
+	gboolean reused = FALSE;
+
+	fd = cache_sim_db_open(db, &st);
+	if (fd < 0) return FALSE;
+
+	entry = g_hash_table_lookup(db->entries, &record->name_hash);
+	if (entry)
+		{
+		offset = entry->offset;
+		}
+	else if (db->free->len > 0)
+		{
+		offset = g_array_index(db->free, goffset, db->free->len - 1);
+		reused = TRUE;
+		}
+	else
+		{
+		offset = sizeof(CacheSimDbHeader) +
+			 (st.st_size - sizeof(CacheSimDbHeader)) / sizeof(CacheSimDbRecord) * sizeof(CacheSimDbRecord);
+		}
+
+	success = (pwrite(fd, record, sizeof(CacheSimDbRecord), offset) == sizeof(CacheSimDbRecord));
+	if (close(fd) != 0) success = FALSE;
+	if (!success) return FALSE;
+
+	if (reused) g_array_set_size(db->free, db->free->len - 1);
+
+	if (!entry)
+		{
+		entry = g_new0(CacheSimDbEntry, 1);
+		entry->name_hash = record->name_hash;
+		entry->offset = offset;
+		g_hash_table_replace(db->entries, &entry->name_hash, entry);
+		}
+
+	/* the shared map sees the writes within it, only appended records need a copy */
+	if (offset + sizeof(CacheSimDbRecord) <= db->map_size) return TRUE;
+
+	if (!entry->copy)
+		{
+		if (db->copies >= CACHE_SIM_DB_COPY_MAX)
+			{
+			/* map the grown file, this drops all copies */
+			cache_sim_db_unmap(db);
+			cache_sim_db_map(db);
+			return TRUE;
+			}
+		entry->copy = g_new(CacheSimDbRecord, 1);
+		db->copies++;
+		}
+	memcpy(entry->copy, record, sizeof(CacheSimDbRecord));
+
+	return TRUE;
+}
+
+/* writes the database anew with only the records in use */
+static gboolean cache_sim_db_compact(CacheSimDb *db)
+{
+	CacheSimDbHeader header;
+	GHashTableIter iter;
+	gpointer value;
+	gchar *tmp_path;
+	gint fd;
+	gboolean success;
+
+	tmp_path = g_strconcat(db->path, ".tmp", NULL);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		{
+		g_free(tmp_path);
+		return FALSE;
+		}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_SIM_DB_MAGIC, sizeof(header.magic));
+	header.version = CACHE_SIM_DB_VERSION;
+	header.record_size = sizeof(CacheSimDbRecord);
+
+	success = (write(fd, &header, sizeof(header)) == sizeof(header));
+
+	g_hash_table_iter_init(&iter, db->entries);
+	while (success && g_hash_table_iter_next(&iter, NULL, &value))
+		{
+		success = (write(fd, cache_sim_db_entry_record(db, value), sizeof(CacheSimDbRecord)) == sizeof(CacheSimDbRecord));
+		}
+
+	if (close(fd) != 0) success = FALSE;
+	if (success) success = (rename(tmp_path, db->path) == 0);
+	if (!success) unlink(tmp_path);
+	g_free(tmp_path);
+
+	DEBUG_1("sim cache db compacted, %u records: %s", g_hash_table_size(db->entries), db->path);
+
+	/* the new file, or the old one as it is */
+	cache_sim_db_unmap(db);
+	cache_sim_db_map(db);
+
+	return success;
+}
+
+static gboolean cache_sim_db_clear(CacheSimDb *db, guint64 name_hash)
+{
+	CacheSimDbEntry *entry;
+	CacheSimDbRecord *record;
+	struct stat st;
+	goffset offset;
+	gint fd;
+	gboolean success;
+
+	if (!g_hash_table_lookup(db->entries, &name_hash)) return TRUE;
+
+	fd = cache_sim_db_open(db, &st);
+	if (fd < 0) return FALSE;
+
+	/* the map may have been renewed */
+	entry = g_hash_table_lookup(db->entries, &name_hash);
+	if (!entry)
+		{
+		close(fd);
+		return TRUE;
+		}
+	offset = entry->offset;
+
+	record = g_new0(CacheSimDbRecord, 1);
+	success = (pwrite(fd, record, sizeof(CacheSimDbRecord), offset) == sizeof(CacheSimDbRecord));
+	g_free(record);
+	if (close(fd) != 0) success = FALSE;
+	if (!success) return FALSE;
+
+	if (entry->copy) db->copies--;
+	g_hash_table_remove(db->entries, &name_hash);
+	g_array_append_val(db->free, offset);
+
+	if (db->free->len >= CACHE_SIM_DB_FREE_MIN && db->free->len > g_hash_table_size(db->entries))
+		{
+		return cache_sim_db_compact(db);
+		}
+
+	return TRUE;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * records
+ *-------------------------------------------------------------------
+ */
+
+static CacheData *cache_sim_db_record_to_data(const CacheSimDbRecord *record)
+{
+	CacheData *cd;
+
+	cd = cache_sim_data_new();
+
+	if (record->flags & CACHE_SIM_DB_DIMENSIONS)
+		{
+		cache_sim_data_set_dimensions(cd, record->width, record->height);
+		}
+	if (record->flags & CACHE_SIM_DB_DATE)
+		{
+		cache_sim_data_set_date(cd, (time_t)record->date);
+		}
+	if (record->flags & CACHE_SIM_DB_MD5SUM)
+		{
+		cache_sim_data_set_md5sum(cd, (guchar *)record->md5sum);
+		}
+	if (record->flags & CACHE_SIM_DB_XXH64SUM)
+		{
+		cache_sim_data_set_xxh64sum(cd, (guchar *)record->xxh64sum);
+		}
+	if (record->flags & CACHE_SIM_DB_SIMILARITY)
+		{
+		cd->sim = image_sim_new();
+		memcpy(cd->sim->avg_r, record->avg_r, 1024);
+		memcpy(cd->sim->avg_g, record->avg_g, 1024);
+		memcpy(cd->sim->avg_b, record->avg_b, 1024);
+		cd->sim->filled = TRUE;
+		cd->similarity = TRUE;
+		}
+
+	return cd;
+}
+
+static void cache_sim_db_record_from_data(CacheSimDbRecord *record, CacheData *cd)
+{
+	if (cd->dimensions)
+		{
+		record->width = cd->width;
+		record->height = cd->height;
+		record->flags |= CACHE_SIM_DB_DIMENSIONS;
+		}
+	if (cd->have_date)
+		{
+		record->date = cd->date;
+		record->flags |= CACHE_SIM_DB_DATE;
+		}
+	if (cd->have_md5sum)
+		{
+		memcpy(record->md5sum, cd->md5sum, sizeof(record->md5sum));
+		record->flags |= CACHE_SIM_DB_MD5SUM;
+		}
+	if (cd->have_xxh64sum)
+		{
+		memcpy(record->xxh64sum, cd->xxh64sum, sizeof(record->xxh64sum));
+		record->flags |= CACHE_SIM_DB_XXH64SUM;
+		}
+	if (cd->similarity && cd->sim && cd->sim->filled)
+		{
+		memcpy(record->avg_r, cd->sim->avg_r, 1024);
+		memcpy(record->avg_g, cd->sim->avg_g, 1024);
+		memcpy(record->avg_b, cd->sim->avg_b, 1024);
+		record->flags |= CACHE_SIM_DB_SIMILARITY;
+		}
+}
+
+/* the database for the file at path, in locale encoding */
+static gchar *cache_sim_db_path(const gchar *path, mode_t *mode)
+{
+	gchar *base;
+	gchar *db_path;
+
+	base = cache_get_location(CACHE_TYPE_SIM, path, FALSE, mode);
+	if (!base) return NULL;
+
+	if (mode && !recursive_mkdir_if_not_exists(base, *mode))
+		{
+		g_free(base);
+		return NULL;
+		}
+
+	db_path = g_build_filename(base, GQ_CACHE_SIM_DB, NULL);
+	g_free(base);
+
+	base = path_from_utf8(db_path);
+	g_free(db_path);
+
+	return base;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * public
+ *-------------------------------------------------------------------
+ */
+
+static CacheData *cache_sim_db_import(const gchar *path, struct stat *st)
+{
+	CacheData *cd = NULL;
+	gchar *sim_path;
+
+	sim_path = cache_find_location(CACHE_TYPE_SIM, path);
+	if (sim_path && filetime(sim_path) == st->st_mtime)
+		{
+		cd = cache_sim_data_load(sim_path);
+		}
+	g_free(sim_path);
+
+	if (cd)
+		{
+		DEBUG_1("sim cache db import: %s", path);
+		cache_sim_db_save(path, cd);
+		}
+
+	return cd;
+}
+
+CacheData *cache_sim_db_load(const gchar *path)
+{
+	CacheData *cd = NULL;
+	CacheSimDb *db;
+	CacheSimDbEntry *entry;
+	struct stat st;
+	guint64 name_hash;
+	gchar *db_path;
+
+	if (!path || !stat_utf8(path, &st)) return NULL;
+
+	db_path = cache_sim_db_path(path, NULL);
+	if (!db_path) return NULL;
+
+	name_hash = cache_sim_db_name_hash(path);
+
+	cache_sim_db_lock();
+	db = cache_sim_db_get(db_path);
+	entry = g_hash_table_lookup(db->entries, &name_hash);
+	if (entry)
+		{
+		const CacheSimDbRecord *record = cache_sim_db_entry_record(db, entry);
+
+		if (record->name_hash == name_hash &&
+		    record->mtime == (gint64)st.st_mtime &&
+		    record->size == (gint64)st.st_size)
+			{
+			cd = cache_sim_db_record_to_data(record);
+			}
+		}
+	cache_sim_db_unlock();
+	g_free(db_path);
+
+	if (!cd) cd = cache_sim_db_import(path, &st);
+
+	return cd;
+}
+
+gboolean cache_sim_db_save(const gchar *path, CacheData *cd)
+{
+	CacheSimDbRecord *record;
+	struct stat st;
+	gchar *db_path;
+	mode_t mode = 0755;
+	gboolean success;
+
+	if (!path || !cd || !stat_utf8(path, &st)) return FALSE;
+
+	record = g_new0(CacheSimDbRecord, 1);
+	record->name_hash = cache_sim_db_name_hash(path);
+	record->mtime = st.st_mtime;
+	record->size = st.st_size;
+	cache_sim_db_record_from_data(record, cd);
+
+	cache_sim_db_lock();
+	db_path = cache_sim_db_path(path, &mode);
+	success = (db_path && cache_sim_db_write(cache_sim_db_get(db_path), record));
+	cache_sim_db_unlock();
+
+	if (!success) log_printf("Unable to save sim cache data: %s\n", path);
+
+	g_free(db_path);
+	g_free(record);
+
+	return success;
+}
+
+void cache_sim_db_remove(const gchar *path)
+{
+	guint64 name_hash;
+	gchar *db_path;
+
+	if (!path) return;
+
+	db_path = cache_sim_db_path(path, NULL);
+	if (!db_path) return;
+
+	name_hash = cache_sim_db_name_hash(path);
+
+	cache_sim_db_lock();
+	if (access(db_path, F_OK) == 0 &&
+	    !cache_sim_db_clear(cache_sim_db_get(db_path), name_hash))
+		{
+		log_printf("Unable to remove sim cache data: %s\n", path);
+		}
+	cache_sim_db_unlock();
+
+	g_free(db_path);
+}
+
+void cache_sim_db_move(const gchar *src, const gchar *dest)
+{
+	CacheSimDbRecord *record = NULL;
+	CacheSimDb *db;
+	CacheSimDbEntry *entry;
+	guint64 name_hash;
+	gchar *src_db_path;
+	gchar *dest_db_path;
+	mode_t mode = 0755;
+
+	if (!src || !dest) return;
+
+	src_db_path = cache_sim_db_path(src, NULL);
+	if (!src_db_path) return;
+
+	name_hash = cache_sim_db_name_hash(src);
+
+	cache_sim_db_lock();
+	if (access(src_db_path, F_OK) == 0)
+		{
+		db = cache_sim_db_get(src_db_path);
+		entry = g_hash_table_lookup(db->entries, &name_hash);
+		if (entry)
+			{
+			record = g_memdup(cache_sim_db_entry_record(db, entry), sizeof(CacheSimDbRecord));
+			cache_sim_db_clear(db, name_hash);
+			}
+		}
+
+	/* the moved file keeps its mtime and size, the record stays valid */
+	if (record && record->name_hash == name_hash)
+		{
+		record->name_hash = cache_sim_db_name_hash(dest);
+		dest_db_path = cache_sim_db_path(dest, &mode);
+		if (!dest_db_path || !cache_sim_db_write(cache_sim_db_get(dest_db_path), record))
+			{
+			log_printf("Unable to move sim cache data: %s\n", dest);
+			}
+		g_free(dest_db_path);
+		}
+	cache_sim_db_unlock();
+
+	g_free(record);
+	g_free(src_db_path);
+}
+
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CACHE_SIMDB_H
+#define CACHE_SIMDB_H
+
+#include "cache.h"
+
+#define GQ_CACHE_SIM_DB		"simcache.db"
+
+/*
+ * The sim cache data of all files of a directory, packed in one file of
+ * fixed size records next to where their .sim files would be.
+ * Thread safe, the duplicate search reads and writes it from its workers.
+ */
+
+/* data of the file at path, NULL if there is none that is up to date,
+ * an up to date .sim file of the old format is imported
+ */
+CacheData *cache_sim_db_load(const gchar *path);
+
+/* stores the data of the file at path, replacing what was there */
+gboolean cache_sim_db_save(const gchar *path, CacheData *cd);
+
+/* drops the data of a removed file, or takes it along to where the
+ * file was moved
+ */
+void cache_sim_db_remove(const gchar *path);
+void cache_sim_db_move(const gchar *src, const gchar *dest);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
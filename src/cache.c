@@ -41,6 +41,7 @@
  * Dimensions=[<width> x <height>]
  * Date=[<value in time_t format, or -1 if no embedded date>]
  * MD5sum=[<32 character ascii text digest>]
+ * XXH64sum=[<16 character ascii text digest>]
  * SimilarityGrid[32 x 32]=<3072 bytes of data (1024 pixels in RGB format, 1 pixel is 24bits)>
  *
  *
@@ -114,6 +115,19 @@ static gboolean cache_sim_write_md5sum(SecureSaveInfo *ssi, CacheData *cd)
 	return TRUE;
 }
 
+static gboolean cache_sim_write_xxh64sum(SecureSaveInfo *ssi, CacheData *cd)
+{
+	gchar *text;
+
+	if (!cd || !cd->have_xxh64sum) return FALSE;
+
+	text = digest_to_text(DIGEST_TYPE_XXH64, cd->xxh64sum);
+	secure_fprintf(ssi, "XXH64sum=[%s]\n", text);
+	g_free(text);
+
+	return TRUE;
+}
+
 static gboolean cache_sim_write_similarity(SecureSaveInfo *ssi, CacheData *cd)
 {
 	guint x, y;
@@ -166,6 +180,7 @@ gboolean cache_sim_data_save(CacheData *cd)
 	cache_sim_write_dimensions(ssi, cd);
 	cache_sim_write_date(ssi, cd);
 	cache_sim_write_md5sum(ssi, cd);
+	cache_sim_write_xxh64sum(ssi, cd);
 	cache_sim_write_similarity(ssi, cd);
 
 	if (secure_close(ssi))
@@ -293,16 +308,12 @@ static gboolean cache_sim_read_date(FILE *f, gchar *buf, gint s, CacheData *cd)
 	return FALSE;
 }
 
-static gboolean cache_sim_read_md5sum(FILE *f, gchar *buf, gint s, CacheData *cd)
+/* reads the text between the brackets of the line, up to len - 1 chars */
+static gboolean cache_sim_read_bracket_text(FILE *f, gint s, gchar *text, gsize len)
 {
-	if (!f || !buf || !cd) return FALSE;
-
-	if (s < 8 || strncmp("MD5sum", buf, 6) != 0) return FALSE;
-
 	if (fseek(f, - s, SEEK_CUR) == 0)
 		{
 		gchar b;
-		gchar buf[64];
 		gsize p = 0;
 
 		b = 'X';
@@ -310,10 +321,10 @@ static gboolean cache_sim_read_md5sum(FILE *f, gchar *buf, gint s, CacheData *cd
 			{
 			if (fread(&b, sizeof(b), 1, f) != 1) return FALSE;
 			}
-		while (b != ']' && p < sizeof(buf) - 1)
+		while (b != ']' && p < len - 1)
 			{
 			if (fread(&b, sizeof(b), 1, f) != 1) return FALSE;
-			buf[p] = b;
+			text[p] = b;
 			p++;
 			}
 		while (b != '\n')
@@ -321,8 +332,7 @@ static gboolean cache_sim_read_md5sum(FILE *f, gchar *buf, gint s, CacheData *cd
 			if (fread(&b, sizeof(b), 1, f) != 1) break;
 			}
 
-		buf[p] = '\0';
-		cd->have_md5sum = md5_digest_from_text(buf, cd->md5sum);
+		text[p] = '\0';
 
 		return TRUE;
 		}
@@ -330,6 +340,36 @@ static gboolean cache_sim_read_md5sum(FILE *f, gchar *buf, gint s, CacheData *cd
 	return FALSE;
 }
 
+static gboolean cache_sim_read_md5sum(FILE *f, gchar *buf, gint s, CacheData *cd)
+{
+	gchar text[64];
+
+	if (!f || !buf || !cd) return FALSE;
+
+	if (s < 8 || strncmp("MD5sum", buf, 6) != 0) return FALSE;
+
+	if (!cache_sim_read_bracket_text(f, s, text, sizeof(text))) return FALSE;
+
+	cd->have_md5sum = md5_digest_from_text(text, cd->md5sum);
+
+	return TRUE;
+}
+
+static gboolean cache_sim_read_xxh64sum(FILE *f, gchar *buf, gint s, CacheData *cd)
+{
+	gchar text[64];
+
+	if (!f || !buf || !cd) return FALSE;
+
+	if (s < 10 || strncmp("XXH64sum", buf, 8) != 0) return FALSE;
+
+	if (!cache_sim_read_bracket_text(f, s, text, sizeof(text))) return FALSE;
+
+	cd->have_xxh64sum = digest_from_text(DIGEST_TYPE_XXH64, text, cd->xxh64sum);
+
+	return TRUE;
+}
+
 static gboolean cache_sim_read_similarity(FILE *f, gchar *buf, gint s, CacheData *cd)
 {
 	if (!f || !buf || !cd) return FALSE;
@@ -437,6 +477,7 @@ CacheData *cache_sim_data_load(const gchar *path)
 			    !cache_sim_read_dimensions(f, buf, s, cd) &&
 			    !cache_sim_read_date(f, buf, s, cd) &&
 			    !cache_sim_read_md5sum(f, buf, s, cd) &&
+			    !cache_sim_read_xxh64sum(f, buf, s, cd) &&
 			    !cache_sim_read_similarity(f, buf, s, cd))
 				{
 				if (!cache_sim_read_skipline(f, s))
@@ -460,6 +501,7 @@ CacheData *cache_sim_data_load(const gchar *path)
 	if (!cd->dimensions &&
 	    !cd->have_date &&
 	    !cd->have_md5sum &&
+	    !cd->have_xxh64sum &&
 	    !cd->similarity)
 		{
 		cache_sim_data_free(cd);
@@ -505,6 +547,19 @@ void cache_sim_data_set_md5sum(CacheData *cd, guchar digest[16])
 	cd->have_md5sum = TRUE;
 }
 
+void cache_sim_data_set_xxh64sum(CacheData *cd, guchar digest[8])
+{
+	gint i;
+
+	if (!cd) return;
+
+	for (i = 0; i < 8; i++)
+		{
+		cd->xxh64sum[i] = digest[i];
+		}
+	cd->have_xxh64sum = TRUE;
+}
+
 void cache_sim_data_set_similarity(CacheData *cd, ImageSimilarityData *sd)
 {
 	if (!cd || !sd || !sd->filled) return;
@@ -53,11 +53,13 @@ struct _CacheData
 	gint height;
 	time_t date;
 	guchar md5sum[16];
+	guchar xxh64sum[16];	/* 8 used, sized for the digest_* functions */
 	ImageSimilarityData *sim;
 
 	gboolean dimensions;
 	gboolean have_date;
 	gboolean have_md5sum;
+	gboolean have_xxh64sum;
 	gboolean similarity;
 };
 
@@ -73,6 +75,7 @@ CacheData *cache_sim_data_load(const gchar *path);
 void cache_sim_data_set_dimensions(CacheData *cd, gint w, gint h);
 void cache_sim_data_set_date(CacheData *cd, time_t date);
 void cache_sim_data_set_md5sum(CacheData *cd, guchar digest[16]);
+void cache_sim_data_set_xxh64sum(CacheData *cd, guchar digest[8]);
 void cache_sim_data_set_similarity(CacheData *cd, ImageSimilarityData *sd);
 gint cache_sim_data_filled(ImageSimilarityData *sd);
 
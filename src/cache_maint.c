@@ -23,6 +23,8 @@
 #include "cache_maint.h"
 
 #include "cache.h"
+#include "cache-metadb.h"
+#include "cache-simdb.h"
 #include "filedata.h"
 #include "layout.h"
 #include "thumb.h"
@@ -187,12 +189,23 @@ static gboolean cache_maintain_home_cb(gpointer data)
 				FileData *fd_list = work->data;
 				gchar *path_buf = g_strdup(fd_list->path);
 				gchar *dot;
+				gboolean orphan;
 
-				dot = extension_find_dot(path_buf);
+				if (strcmp(fd_list->name, GQ_CACHE_SIM_DB) == 0 ||
+				    strcmp(fd_list->name, GQ_CACHE_META_DB) == 0)
+					{
+					/* the databases belong to the directory */
+					dot = NULL;
+					orphan = (strlen(fd->path) > base_length && !isdir(fd->path + base_length));
+					}
+				else
+					{
+					dot = extension_find_dot(path_buf);
 
-				if (dot) *dot = '\0';
-				if ((!cm->metadata && cm->clear) ||
-				    (strlen(path_buf) > base_length && !isfile(path_buf + base_length)) )
+					if (dot) *dot = '\0';
+					orphan = (strlen(path_buf) > base_length && !isfile(path_buf + base_length));
+					}
+				if ((!cm->metadata && cm->clear) || orphan)
 					{
 					if (dot) *dot = '.';
 					if (!unlink_file(path_buf)) log_printf("failed to delete:%s\n", path_buf);
@@ -434,6 +447,8 @@ static void cache_maint_moved(FileData *fd)
 		}
 	g_free(base);
 
+	cache_sim_db_move(src, dest);
+
 	base = cache_get_location(CACHE_TYPE_METADATA, dest, FALSE, &mode);
 	if (recursive_mkdir_if_not_exists(base, mode))
 		{
@@ -472,6 +487,8 @@ static void cache_maint_removed(FileData *fd)
 	cache_file_remove(buf);
 	g_free(buf);
 
+	cache_sim_db_remove(fd->path);
+
 	buf = cache_find_location(CACHE_TYPE_METADATA, fd->path);
 	cache_file_remove(buf);
 	g_free(buf);
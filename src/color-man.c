@@ -23,6 +23,7 @@
 #include "color-man.h"
 
 #include "image.h"
+#include "misc.h"
 #include "ui_fileops.h"
 
 
@@ -53,9 +54,16 @@ struct _ColorManCache {
 	gint refcount;
 };
 
-/* pixels to transform per idle call */
+/* pixels to transform per idle call and thread */
 #define COLOR_MAN_CHUNK_SIZE 81900
 
+#if defined(HAVE_LCMS2) && defined(HAVE_GTHREAD)
+/* an lcms2 transform created without the cache of the last pixel
+ * can be used by several threads at once
+ */
+#define COLOR_MAN_THREADS
+#endif
+
 
 static void color_man_lib_init(void)
 {
@@ -188,7 +196,12 @@ static ColorManCache *color_man_cache_new(ColorManProfileType in_type, const gch
 					   (has_alpha) ? TYPE_RGBA_8 : TYPE_RGB_8,
 					   cc->profile_out,
 					   (has_alpha) ? TYPE_RGBA_8 : TYPE_RGB_8,
-					   options->color_profile.render_intent, 0);
+					   options->color_profile.render_intent,
+#ifdef COLOR_MAN_THREADS
+					   cmsFLAGS_NOCACHE);
+#else
+					   0);
+#endif
 
 	if (!cc->transform)
 		{
@@ -299,13 +312,66 @@ static void color_man_done(ColorMan *cm, ColorManReturnType type)
 		}
 }
 
+typedef struct _ColorManBand ColorManBand;
+struct _ColorManBand
+{
+	cmsHTRANSFORM transform;
+	guchar *pix;		/* first pixel of the band */
+	gint rs;
+	gint w;
+	gint h;
+};
+
+static void color_man_correct_band(ColorManBand *band)
+{
+	gint i;
+
+	for (i = 0; i < band->h; i++)
+		{
+		guchar *pbuf;
+
+		pbuf = band->pix + i * band->rs;
+
+		cmsDoTransform(band->transform, pbuf, pbuf, band->w);
+		}
+}
+
+#ifdef COLOR_MAN_THREADS
+static void color_man_correct_band_thread(gpointer data, gpointer user_data)
+{
+	color_man_correct_band(data);
+}
+#endif
+
+/* threads worth using for the pixels, 1 when they are too few */
+static gint color_man_threads(gint pixels)
+{
+#ifdef COLOR_MAN_THREADS
+	return CLAMP(pixels / COLOR_MAN_CHUNK_SIZE, 1, get_cpu_cores());
+#else
+	return 1;
+#endif
+}
+
+gboolean color_man_thread_safe(void)
+{
+#ifdef COLOR_MAN_THREADS
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
 void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, gint w, gint h)
 {
 	ColorManCache *cc;
+	ColorManBand band;
 	guchar *pix;
 	gint rs;
-	gint i;
 	gint pixbuf_width, pixbuf_height;
+#ifdef COLOR_MAN_THREADS
+	gint threads;
+#endif
 
 
 	pixbuf_width = gdk_pixbuf_get_width(pixbuf);
@@ -318,17 +384,40 @@ void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, g
 
 	w = MIN(w, pixbuf_width - x);
 	h = MIN(h, pixbuf_height - y);
+	if (w < 1 || h < 1) return;
 
-	pix += x * ((cc->has_alpha) ? 4 : 3);
-	for (i = 0; i < h; i++)
-		{
-		guchar *pbuf;
-
-		pbuf = pix + ((y + i) * rs);
+	band.transform = cc->transform;
+	band.pix = pix + y * rs + x * ((cc->has_alpha) ? 4 : 3);
+	band.rs = rs;
+	band.w = w;
+	band.h = h;
 
-		cmsDoTransform(cc->transform, pbuf, pbuf, w);
+#ifdef COLOR_MAN_THREADS
+	threads = color_man_threads(w * h);
+	if (threads > 1)
+		{
+		ParallelBatch *batch;
+		ColorManBand *bands;
+		gint band_h = (h + threads - 1) / threads;
+		gint i;
+
+		/* rows split in bands, one per thread */
+		bands = g_new(ColorManBand, threads);
+		batch = parallel_batch_new();
+		for (i = 0; i < threads && i * band_h < h; i++)
+			{
+			bands[i] = band;
+			bands[i].pix = band.pix + i * band_h * rs;
+			bands[i].h = MIN(band_h, h - i * band_h);
+			parallel_batch_push(batch, color_man_correct_band_thread, &bands[i]);
+			}
+		parallel_batch_wait(batch);
+		g_free(bands);
+		return;
 		}
+#endif
 
+	color_man_correct_band(&band);
 }
 
 static gboolean color_man_idle_cb(gpointer data)
@@ -362,7 +451,7 @@ static gboolean color_man_idle_cb(gpointer data)
 		return FALSE;
 		}
 
-	rh = COLOR_MAN_CHUNK_SIZE / width + 1;
+	rh = COLOR_MAN_CHUNK_SIZE * color_man_threads(width * height) / width + 1;
 	color_man_correct_region(cm, cm->pixbuf, 0, cm->row, width, rh);
 	if (cm->incremental_sync && cm->imd) image_area_changed(cm->imd, 0, cm->row, width, rh);
 	cm->row += rh;
@@ -524,6 +613,11 @@ void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, g
 	/* no op */
 }
 
+gboolean color_man_thread_safe(void)
+{
+	return TRUE;
+}
+
 void color_man_start_bg(ColorMan *cm, ColorManDoneFunc done_func, gpointer done_data)
 {
 	/* no op */
@@ -68,6 +68,10 @@ void color_man_free(ColorMan *cm);
 void color_man_update(void);
 
 void color_man_correct_region(ColorMan *cm, GdkPixbuf *pixbuf, gint x, gint y, gint w, gint h);
+/* TRUE when color_man_correct_region() can run in several threads at once,
+ * it uses threads itself for big regions then
+ */
+gboolean color_man_thread_safe(void);
 
 void color_man_start_bg(ColorMan *cm, ColorManDoneFunc don_func, gpointer done_data);
 
@@ -23,6 +23,7 @@
 #include "dupe.h"
 
 #include "cache.h"
+#include "cache-simdb.h"
 #include "collect.h"
 #include "collect-table.h"
 #include "dnd.h"
@@ -81,7 +82,8 @@ static GList *dupe_window_list = NULL;	/* list of open DupeWindow *s */
 static void dupe_match_unlink(DupeItem *a, DupeItem *b);
 static DupeItem *dupe_match_find_parent(DupeWindow *dw, DupeItem *child);
 
-static gint dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, gdouble *rank, gint fast);
+static gint dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, DigestType sum_type,
+		       gdouble *rank, gint fast);
 
 static void dupe_thumb_step(DupeWindow *dw);
 static gint dupe_check_cb(gpointer data);
@@ -307,7 +309,9 @@ static void dupe_item_free(DupeItem *di)
 {
 	file_data_unref(di->fd);
 	image_sim_free(di->simd);
+	image_sim_transfo_free(di->simd_transfo);
 	g_free(di->md5sum);
+	g_free(di->xxh64sum);
 	if (di->pixbuf) g_object_unref(di->pixbuf);
 
 	g_free(di);
@@ -377,6 +381,26 @@ static DupeItem *dupe_item_find_path(DupeWindow *dw, const gchar *path)
 	return di;
 }
 
+/*
+ * The checksum of DUPE_MATCH_SUM, md5 or the much faster xxh64.
+ * The cache keeps both, switching does not invalidate it. A check
+ * takes the type once, in dw->sum_type, as the workers read it.
+ */
+static DigestType dupe_sum_type(void)
+{
+	return options->duplicates_fast_checksum ? DIGEST_TYPE_XXH64 : DIGEST_TYPE_MD5;
+}
+
+static gchar **dupe_item_sum(DupeItem *di, DigestType sum_type)
+{
+	return (sum_type == DIGEST_TYPE_XXH64) ? &di->xxh64sum : &di->md5sum;
+}
+
+static void dupe_item_read_sum(DupeItem *di, DigestType sum_type)
+{
+	*dupe_item_sum(di, sum_type) = digest_text_from_file_utf8(sum_type, di->fd->path, "");
+}
+
 /*
  * ------------------------------------------------------------------
  * Image property cache
@@ -385,22 +409,11 @@ static DupeItem *dupe_item_find_path(DupeWindow *dw, const gchar *path)
 
 static void dupe_item_read_cache(DupeItem *di)
 {
-	gchar *path;
 	CacheData *cd;
 
 	if (!di) return;
 
-	path = cache_find_location(CACHE_TYPE_SIM, di->fd->path);
-	if (!path) return;
-
-	if (filetime(di->fd->path) != filetime(path))
-		{
-		g_free(path);
-		return;
-		}
-
-	cd = cache_sim_data_load(path);
-	g_free(path);
+	cd = cache_sim_db_load(di->fd->path);
 
 	if (cd)
 		{
@@ -418,40 +431,37 @@ static void dupe_item_read_cache(DupeItem *di)
 			{
 			di->md5sum = md5_digest_to_text(cd->md5sum);
 			}
+		if (!di->xxh64sum && cd->have_xxh64sum)
+			{
+			di->xxh64sum = digest_to_text(DIGEST_TYPE_XXH64, cd->xxh64sum);
+			}
 		cache_sim_data_free(cd);
 		}
 }
 
 static void dupe_item_write_cache(DupeItem *di)
 {
-	gchar *base;
-	mode_t mode = 0755;
+	CacheData *cd;
 
 	if (!di) return;
 
-	base = cache_get_location(CACHE_TYPE_SIM, di->fd->path, FALSE, &mode);
-	if (recursive_mkdir_if_not_exists(base, mode))
-		{
-		CacheData *cd;
-
-		cd = cache_sim_data_new();
-		cd->path = cache_get_location(CACHE_TYPE_SIM, di->fd->path, TRUE, NULL);
-
-		if (di->width != 0) cache_sim_data_set_dimensions(cd, di->width, di->height);
-		if (di->md5sum)
-			{
-			guchar digest[16];
-			if (md5_digest_from_text(di->md5sum, digest)) cache_sim_data_set_md5sum(cd, digest);
-			}
-		if (di->simd) cache_sim_data_set_similarity(cd, di->simd);
+	cd = cache_sim_data_new();
 
-		if (cache_sim_data_save(cd))
-			{
-			filetime_set(cd->path, filetime(di->fd->path));
-			}
-		cache_sim_data_free(cd);
+	if (di->width != 0) cache_sim_data_set_dimensions(cd, di->width, di->height);
+	if (di->md5sum)
+		{
+		guchar digest[16];
+		if (md5_digest_from_text(di->md5sum, digest)) cache_sim_data_set_md5sum(cd, digest);
 		}
-	g_free(base);
+	if (di->xxh64sum)
+		{
+		guchar digest[16];
+		if (digest_from_text(DIGEST_TYPE_XXH64, di->xxh64sum, digest)) cache_sim_data_set_xxh64sum(cd, digest);
+		}
+	if (di->simd) cache_sim_data_set_similarity(cd, di->simd);
+
+	cache_sim_db_save(di->fd->path, cd);
+	cache_sim_data_free(cd);
 }
 
 /*
@@ -990,7 +1000,7 @@ static GList *dupe_match_unlink_by_rank(DupeItem *child, DupeItem *parent, GList
 				dupe_match_link_clear(orphan, TRUE);
 				if (!dw->second_set || orphan->second)
 					{
-					dupe_match(orphan, child, dw->match_mask, &rank, FALSE);
+					dupe_match(orphan, child, dw->match_mask, dw->sum_type, &rank, FALSE);
 					dupe_match_link(orphan, child, rank);
 					}
 				list = g_list_remove(list, orphan);
@@ -1157,7 +1167,20 @@ static void dupe_match_rank(DupeWindow *dw)
  * ------------------------------------------------------------------
  */
 
-static gboolean dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, gdouble *rank, gint fast)
+static gdouble dupe_match_sim_threshold(DupeMatchType mask)
+{
+	if (mask & DUPE_MATCH_SIM_HIGH) return 0.95;
+	if (mask & DUPE_MATCH_SIM_MED) return 0.90;
+	if (mask & DUPE_MATCH_SIM_CUSTOM) return (gdouble)options->duplicates_similarity_threshold / 100.0;
+	return 0.85;
+}
+
+/*
+ * Only reads the items, the checksums, dimensions and similarity data
+ * are read by the setup stages of dupe_check_cb() before any compare.
+ */
+static gboolean dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, DigestType sum_type,
+			   gdouble *rank, gint fast)
 {
 	*rank = 0.0;
 
@@ -1185,16 +1208,18 @@ static gboolean dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, gdouble
 		}
 	if (mask & DUPE_MATCH_SUM)
 		{
-		if (!a->md5sum) a->md5sum = md5_text_from_file_utf8(a->fd->path, "");
-		if (!b->md5sum) b->md5sum = md5_text_from_file_utf8(b->fd->path, "");
-		if (a->md5sum[0] == '\0' ||
-		    b->md5sum[0] == '\0' ||
-		    strcmp(a->md5sum, b->md5sum) != 0) return FALSE;
+		gchar *sum_a = *dupe_item_sum(a, sum_type);
+		gchar *sum_b = *dupe_item_sum(b, sum_type);
+
+		/* no checksum was read when no other file could share it */
+		if (!sum_a || sum_a[0] == '\0' ||
+		    !sum_b || sum_b[0] == '\0' ||
+		    strcmp(sum_a, sum_b) != 0) return FALSE;
 		}
 	if (mask & DUPE_MATCH_DIM)
 		{
-		if (a->width == 0) image_load_dimensions(a->fd, &a->width, &a->height);
-		if (b->width == 0) image_load_dimensions(b->fd, &b->width, &b->height);
+		/* dimensions that could not be read do not match anything */
+		if (a->width == 0 && a->height == 0) return FALSE;
 		if (a->width != b->width || a->height != b->height) return FALSE;
 		}
 	if (mask & DUPE_MATCH_SIM_HIGH ||
@@ -1205,12 +1230,13 @@ static gboolean dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, gdouble
 		gdouble f;
 		gdouble m;
 
-		if (mask & DUPE_MATCH_SIM_HIGH) m = 0.95;
-		else if (mask & DUPE_MATCH_SIM_MED) m = 0.90;
-		else if (mask & DUPE_MATCH_SIM_CUSTOM) m = (gdouble)options->duplicates_similarity_threshold / 100.0;
-		else m = 0.85;
+		m = dupe_match_sim_threshold(mask);
 
-		if (fast)
+		if (fast && b->simd_transfo)
+			{
+			f = image_sim_transfo_compare_fast(a->simd, b->simd_transfo, m);
+			}
+		else if (fast)
 			{
 			f = image_sim_compare_fast(a->simd, b->simd, m);
 			}
@@ -1229,6 +1255,29 @@ static gboolean dupe_match(DupeItem *a, DupeItem *b, DupeMatchType mask, gdouble
 	return TRUE;
 }
 
+static gboolean dupe_match_mask_is_sim(DupeMatchType mask)
+{
+	return (mask & DUPE_MATCH_SIM_HIGH ||
+		mask & DUPE_MATCH_SIM_MED ||
+		mask & DUPE_MATCH_SIM_LOW ||
+		mask & DUPE_MATCH_SIM_CUSTOM);
+}
+
+/* the needle is compared against many items, prepare its rotated/mirrored grids once */
+static void dupe_needle_prepare(DupeItem *needle, DupeMatchType mask)
+{
+	if (dupe_match_mask_is_sim(mask))
+		{
+		needle->simd_transfo = image_sim_transfo_new(needle->simd);
+		}
+}
+
+static void dupe_needle_finish(DupeItem *needle)
+{
+	image_sim_transfo_free(needle->simd_transfo);
+	needle->simd_transfo = NULL;
+}
+
 static void dupe_list_check_match(DupeWindow *dw, DupeItem *needle, GList *start)
 {
 	GList *work;
@@ -1246,6 +1295,8 @@ static void dupe_list_check_match(DupeWindow *dw, DupeItem *needle, GList *start
 		work = g_list_last(dw->list);
 		}
 
+	dupe_needle_prepare(needle, dw->match_mask);
+
 	while (work)
 		{
 		DupeItem *di = work->data;
@@ -1260,14 +1311,645 @@ static void dupe_list_check_match(DupeWindow *dw, DupeItem *needle, GList *start
 			{
 			gdouble rank;
 
-			if (dupe_match(di, needle, dw->match_mask, &rank, TRUE))
+			if (dupe_match(di, needle, dw->match_mask, dw->sum_type, &rank, TRUE))
 				{
 				dupe_match_link(di, needle, rank);
 				}
 			}
 		}
+
+	dupe_needle_finish(needle);
 }
 
+/*
+ * ------------------------------------------------------------------
+ * Threaded comparison
+ * ------------------------------------------------------------------
+ */
+
+#ifdef HAVE_GTHREAD
+
+#define DUPE_CHECK_THREAD_CHUNK 8	/* needles taken by a worker at a time */
+#define DUPE_CHECK_THREAD_POLL 100	/* ms between merging results into the window */
+#define DUPE_CHECK_SUM_PARTIAL (64 * 1024)	/* bytes read from each end of a file for the partial checksum */
+
+enum {
+	DUPE_CHECK_SUM_STAGE_NONE = 0,
+	DUPE_CHECK_SUM_STAGE_PARTIAL,	/* checksums of the file ends */
+	DUPE_CHECK_SUM_STAGE_FULL	/* checksums of the whole files */
+};
+
+typedef struct _DupeCompareResult DupeCompareResult;
+struct _DupeCompareResult
+{
+	DupeItem *a;
+	DupeItem *b;
+	gdouble rank;
+};
+
+/*
+ * The workers only read the DupeItems, all the data dupe_match() needs
+ * was prepared by the setup stage of dupe_check_cb(). Matches are collected
+ * and linked later by the main thread in dupe_check_thread_merge().
+ */
+static GList *dupe_check_thread_match(DupeWindow *dw, DupeItem *di, DupeItem *needle, GList *results)
+{
+	gdouble rank;
+
+	if (dupe_match(di, needle, dw->thread_mask, dw->sum_type, &rank, TRUE))
+		{
+		DupeCompareResult *dcr = g_new(DupeCompareResult, 1);
+
+		dcr->a = di;
+		dcr->b = needle;
+		dcr->rank = rank;
+		results = g_list_prepend(results, dcr);
+		}
+
+	return results;
+}
+
+static GList *dupe_check_thread_needle(DupeWindow *dw, gint n, GList *results)
+{
+	DupeItem *needle = dw->thread_list[n];
+	gint i;
+
+	/* each needle is owned by one worker, the others never touch its simd_transfo */
+	dupe_needle_prepare(needle, dw->thread_mask);
+
+	if (dw->thread_bucket_table)
+		{
+		GArray *bucket = dw->thread_buckets[n];
+		DupeItem **haystack = dw->second_set ? dw->thread_second_list : dw->thread_list;
+
+		for (i = 0; bucket && i < (gint)bucket->len; i++)
+			{
+			gint c = g_array_index(bucket, gint, i);
+
+			/* simple compare: each pair once, against the items before the needle */
+			if (!dw->second_set && c >= n) break;
+
+			results = dupe_check_thread_match(dw, haystack[c], needle, results);
+			}
+		}
+	else if (dw->thread_index)
+		{
+		GArray *candidates;
+		DupeItem **haystack;
+
+		/* only the items within reach of the similarity threshold */
+		candidates = image_sim_index_find(dw->thread_index, needle->simd_transfo,
+						  dupe_match_sim_threshold(dw->thread_mask));
+		haystack = dw->second_set ? dw->thread_second_list : dw->thread_list;
+
+		for (i = 0; i < (gint)candidates->len; i++)
+			{
+			gint c = g_array_index(candidates, gint, i);
+
+			/* simple compare: each pair once, against the items before the needle */
+			if (!dw->second_set && c > n) break;
+
+			results = dupe_check_thread_match(dw, haystack[c], needle, results);
+			}
+		g_array_free(candidates, TRUE);
+		}
+	else if (dw->second_set)
+		{
+		/* speed opt: forward for second set, back for simple compare */
+		for (i = 0; i < dw->thread_second_count; i++)
+			{
+			results = dupe_check_thread_match(dw, dw->thread_second_list[i], needle, results);
+			}
+		}
+	else
+		{
+		for (i = n; i >= 0; i--)
+			{
+			results = dupe_check_thread_match(dw, dw->thread_list[i], needle, results);
+			}
+		}
+
+	dupe_needle_finish(needle);
+
+	return results;
+}
+
+static void dupe_check_thread_run(gpointer data, gpointer user_data)
+{
+	DupeWindow *dw = data;
+
+	while (!g_atomic_int_get(&dw->thread_abort))
+		{
+		GList *results = NULL;
+		gint start;
+		gint end;
+		gint n;
+
+		/* needles are taken from the end of the list, like the idle loop does,
+		 * so the biggest chunks of work are done first
+		 */
+		g_mutex_lock(dw->thread_mutex);
+		end = dw->thread_next;
+		start = MAX(end - DUPE_CHECK_THREAD_CHUNK, 0);
+		dw->thread_next = start;
+		g_mutex_unlock(dw->thread_mutex);
+
+		if (end == 0) break;
+
+		for (n = end - 1; n >= start && !g_atomic_int_get(&dw->thread_abort); n--)
+			{
+			results = dw->thread_func(dw, n, results);
+			}
+
+		g_mutex_lock(dw->thread_mutex);
+		dw->thread_results = g_list_concat(results, dw->thread_results);
+		dw->thread_done += end - start;
+		g_mutex_unlock(dw->thread_mutex);
+		}
+}
+
+static DupeItem **dupe_check_thread_list_to_array(GList *list, gint *count)
+{
+	DupeItem **array;
+	gint n = 0;
+
+	*count = g_list_length(list);
+	array = g_new(DupeItem *, *count);
+
+	while (list)
+		{
+		array[n] = list->data;
+		n++;
+		list = list->next;
+		}
+
+	return array;
+}
+
+static gboolean dupe_match_mask_is_exact(DupeMatchType mask)
+{
+	return (mask & (DUPE_MATCH_NAME | DUPE_MATCH_NAME_CI | DUPE_MATCH_SIZE | DUPE_MATCH_DATE |
+			DUPE_MATCH_DIM | DUPE_MATCH_SUM | DUPE_MATCH_PATH));
+}
+
+/*
+ * Items can only match if their keys are equal, NULL if the item can not match at all.
+ * The key is only used to group the items, dupe_match() still has the last word.
+ */
+static gchar *dupe_match_key(DupeItem *di, DupeMatchType mask, DigestType sum_type)
+{
+	GString *key = g_string_new(NULL);
+
+	if (mask & DUPE_MATCH_PATH)
+		{
+		/* as compared by utf8_compare(), case sensitive */
+		gchar *path_key = g_utf8_collate_key(di->fd->path, -1);
+
+		g_string_append_printf(key, "%s\n", path_key);
+		g_free(path_key);
+		}
+	if (mask & DUPE_MATCH_NAME)
+		{
+		g_string_append_printf(key, "%s\n", di->fd->collate_key_name);
+		}
+	if (mask & DUPE_MATCH_NAME_CI)
+		{
+		g_string_append_printf(key, "%s\n", di->fd->collate_key_name_nocase);
+		}
+	if (mask & DUPE_MATCH_SIZE)
+		{
+		g_string_append_printf(key, "%" G_GINT64_FORMAT "\n", (gint64)di->fd->size);
+		}
+	if (mask & DUPE_MATCH_DATE)
+		{
+		g_string_append_printf(key, "%" G_GINT64_FORMAT "\n", (gint64)di->fd->date);
+		}
+	if (mask & DUPE_MATCH_SUM)
+		{
+		gchar *sum = *dupe_item_sum(di, sum_type);
+
+		if (!sum || sum[0] == '\0')
+			{
+			g_string_free(key, TRUE);
+			return NULL;
+			}
+		g_string_append_printf(key, "%s\n", sum);
+		}
+	if (mask & DUPE_MATCH_DIM)
+		{
+		if (di->width == 0 && di->height == 0)
+			{
+			g_string_free(key, TRUE);
+			return NULL;
+			}
+		g_string_append_printf(key, "%dx%d\n", di->width, di->height);
+		}
+
+	return g_string_free(key, FALSE);
+}
+
+static void dupe_check_thread_bucket_free(gpointer data)
+{
+	g_array_free((GArray *)data, TRUE);
+}
+
+/*
+ * Groups the items compared against by their match key, each needle gets the
+ * bucket of items it can match. Only those are compared, pairwise work is left
+ * for similarity within a bucket.
+ */
+static void dupe_check_thread_buckets_new(DupeWindow *dw)
+{
+	DupeItem **items = dw->second_set ? dw->thread_second_list : dw->thread_list;
+	gint count = dw->second_set ? dw->thread_second_count : dw->thread_list_count;
+	gint i;
+
+	dw->thread_bucket_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, dupe_check_thread_bucket_free);
+
+	for (i = 0; i < count; i++)
+		{
+		gchar *key = dupe_match_key(items[i], dw->thread_mask, dw->sum_type);
+		GArray *bucket;
+
+		if (!key) continue;
+
+		bucket = g_hash_table_lookup(dw->thread_bucket_table, key);
+		if (!bucket)
+			{
+			bucket = g_array_new(FALSE, FALSE, sizeof(gint));
+			g_hash_table_insert(dw->thread_bucket_table, key, bucket);
+			}
+		else
+			{
+			g_free(key);
+			}
+		g_array_append_val(bucket, i);
+		}
+
+	dw->thread_buckets = g_new0(GArray *, dw->thread_list_count);
+	for (i = 0; i < dw->thread_list_count; i++)
+		{
+		gchar *key = dupe_match_key(dw->thread_list[i], dw->thread_mask, dw->sum_type);
+
+		if (!key) continue;
+
+		dw->thread_buckets[i] = g_hash_table_lookup(dw->thread_bucket_table, key);
+		g_free(key);
+		}
+
+	DEBUG_1("Grouped %d files into %d buckets", count, g_hash_table_size(dw->thread_bucket_table));
+}
+
+static ImageSimilarityIndex *dupe_check_thread_index_new(DupeItem **items, gint count)
+{
+	ImageSimilarityIndex *si;
+	ImageSimilarityData **sd;
+	gint i;
+
+	sd = g_new(ImageSimilarityData *, count);
+	for (i = 0; i < count; i++)
+		{
+		sd[i] = items[i]->simd;
+		}
+
+	si = image_sim_index_new(sd, count);
+	g_free(sd);
+
+	return si;
+}
+
+/* runs func on each item of thread_list */
+static void dupe_check_thread_pool_start(DupeWindow *dw, GList *(*func)(DupeWindow *dw, gint n, GList *results))
+{
+	gint threads;
+	gint i;
+
+	dw->thread_func = func;
+	dw->thread_next = dw->thread_list_count;
+	dw->thread_done = 0;
+	dw->thread_results = NULL;
+	g_atomic_int_set(&dw->thread_abort, FALSE);
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	dw->thread_mutex = g_new(GMutex, 1);
+	g_mutex_init(dw->thread_mutex);
+#else
+	dw->thread_mutex = g_mutex_new();
+#endif
+
+	threads = get_cpu_cores();
+	threads = CLAMP(threads, 1, dw->thread_list_count / DUPE_CHECK_THREAD_CHUNK + 1);
+
+	DEBUG_1("Running %d threads", threads);
+
+	dw->thread_pool = g_thread_pool_new(dupe_check_thread_run, NULL, threads, FALSE, NULL);
+	for (i = 0; i < threads; i++)
+		{
+		g_thread_pool_push(dw->thread_pool, dw, NULL);
+		}
+}
+
+static void dupe_check_thread_start(DupeWindow *dw)
+{
+	dw->thread_list = dupe_check_thread_list_to_array(dw->list, &dw->thread_list_count);
+	if (dw->second_set)
+		{
+		dw->thread_second_list = dupe_check_thread_list_to_array(dw->second_list, &dw->thread_second_count);
+		}
+	dw->thread_mask = dw->match_mask;
+	if (dupe_match_mask_is_exact(dw->thread_mask))
+		{
+		dupe_check_thread_buckets_new(dw);
+		}
+	else if (dupe_match_mask_is_sim(dw->thread_mask))
+		{
+		dw->thread_index = dupe_check_thread_index_new(dw->second_set ? dw->thread_second_list : dw->thread_list,
+							       dw->second_set ? dw->thread_second_count : dw->thread_list_count);
+		}
+
+	DEBUG_1("Comparing %d files", dw->thread_list_count);
+
+	dupe_check_thread_pool_start(dw, dupe_check_thread_needle);
+}
+
+static void dupe_check_thread_results_free(GList *results)
+{
+	GList *work = results;
+
+	while (work)
+		{
+		g_free(work->data);
+		work = work->next;
+		}
+	g_list_free(results);
+}
+
+/* returns TRUE if the workers were running */
+static gboolean dupe_check_thread_stop(DupeWindow *dw)
+{
+	if (!dw->thread_pool) return FALSE;
+
+	g_atomic_int_set(&dw->thread_abort, TRUE);
+	g_thread_pool_free(dw->thread_pool, TRUE, TRUE);
+	dw->thread_pool = NULL;
+
+	dupe_check_thread_results_free(dw->thread_results);
+	dw->thread_results = NULL;
+
+	if (dw->thread_sums)
+		{
+		gint i;
+
+		for (i = 0; i < dw->thread_list_count; i++) g_free(dw->thread_sums[i]);
+		g_free(dw->thread_sums);
+		dw->thread_sums = NULL;
+		}
+	dw->thread_sum_stage = DUPE_CHECK_SUM_STAGE_NONE;
+
+	g_free(dw->thread_list);
+	dw->thread_list = NULL;
+	dw->thread_list_count = 0;
+	g_free(dw->thread_second_list);
+	dw->thread_second_list = NULL;
+	dw->thread_second_count = 0;
+	image_sim_index_free(dw->thread_index);
+	dw->thread_index = NULL;
+	g_free(dw->thread_buckets);
+	dw->thread_buckets = NULL;
+	if (dw->thread_bucket_table) g_hash_table_destroy(dw->thread_bucket_table);
+	dw->thread_bucket_table = NULL;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_clear(dw->thread_mutex);
+	g_free(dw->thread_mutex);
+#else
+	g_mutex_free(dw->thread_mutex);
+#endif
+	dw->thread_mutex = NULL;
+
+	return TRUE;
+}
+
+/* links the matches found so far, returns TRUE when all needles are done */
+static gboolean dupe_check_thread_merge(DupeWindow *dw)
+{
+	GList *results;
+	GList *work;
+	gboolean done;
+
+	g_mutex_lock(dw->thread_mutex);
+	results = dw->thread_results;
+	dw->thread_results = NULL;
+	dw->setup_n = dw->thread_done;
+	done = (dw->thread_done >= dw->thread_list_count);
+	g_mutex_unlock(dw->thread_mutex);
+
+	work = results;
+	while (work)
+		{
+		DupeCompareResult *dcr = work->data;
+		work = work->next;
+
+		if (!dupe_match_link_exists(dcr->b, dcr->a))
+			{
+			dupe_match_link(dcr->a, dcr->b, dcr->rank);
+			}
+		}
+	dupe_check_thread_results_free(results);
+
+	return done;
+}
+
+/*
+ * Checksums are only needed for files that have a possible twin:
+ * files of a unique size are skipped, then files with unique ends,
+ * only the rest is read completely. Files left without a checksum
+ * have no match key and are never compared.
+ */
+
+static GList *dupe_check_thread_partial_sum(DupeWindow *dw, gint n, GList *results)
+{
+	DupeItem *di = dw->thread_list[n];
+	guchar digest[16];
+
+	/* the item belongs to this worker, cache and checksum are file i/o only */
+	if (!*dupe_item_sum(di, dw->sum_type) && options->thumbnails.enable_caching)
+		{
+		dupe_item_read_cache(di);
+		}
+
+	if (di->fd->size <= DUPE_CHECK_SUM_PARTIAL * 2)
+		{
+		/* the ends are the whole file, get the real checksum at once */
+		if (!*dupe_item_sum(di, dw->sum_type))
+			{
+			dupe_item_read_sum(di, dw->sum_type);
+			if (options->thumbnails.enable_caching)
+				{
+				dupe_item_write_cache(di);
+				}
+			}
+		dw->thread_sums[n] = g_strdup(*dupe_item_sum(di, dw->sum_type));
+		}
+	else if (digest_get_from_file_ends_utf8(DIGEST_TYPE_XXH64, di->fd->path, DUPE_CHECK_SUM_PARTIAL, digest))
+		{
+		/* never stored, the fast hash will do */
+		dw->thread_sums[n] = digest_to_text(DIGEST_TYPE_XXH64, digest);
+		}
+
+	return results;
+}
+
+static GList *dupe_check_thread_sum(DupeWindow *dw, gint n, GList *results)
+{
+	DupeItem *di = dw->thread_list[n];
+
+	dupe_item_read_sum(di, dw->sum_type);
+	if (options->thumbnails.enable_caching)
+		{
+		dupe_item_write_cache(di);
+		}
+
+	return results;
+}
+
+/*
+ * Returns the items that share their key with another item,
+ * if at least one of them still needs a checksum. NULL keys never match.
+ */
+static GList *dupe_check_sum_collisions(DupeItem **items, gchar **keys, gint count, DigestType sum_type)
+{
+	GHashTable *table;
+	GList *list = NULL;
+	gint i;
+
+	/* value: number of items with the key << 1 | one of them has no checksum */
+	table = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < count; i++)
+		{
+		gint v;
+
+		if (!keys[i]) continue;
+
+		v = GPOINTER_TO_INT(g_hash_table_lookup(table, keys[i]));
+		v = (((v >> 1) + 1) << 1) | (v & 1) | (*dupe_item_sum(items[i], sum_type) == NULL);
+		g_hash_table_insert(table, keys[i], GINT_TO_POINTER(v));
+		}
+
+	for (i = count - 1; i >= 0; i--)
+		{
+		gint v;
+
+		if (!keys[i]) continue;
+
+		v = GPOINTER_TO_INT(g_hash_table_lookup(table, keys[i]));
+		if ((v >> 1) > 1 && (v & 1)) list = g_list_prepend(list, items[i]);
+		}
+	g_hash_table_destroy(table);
+
+	return list;
+}
+
+static GList *dupe_check_sum_drop_known(GList *list, DigestType sum_type)
+{
+	GList *work = list;
+
+	while (work)
+		{
+		DupeItem *di = work->data;
+		GList *next = work->next;
+
+		if (*dupe_item_sum(di, sum_type)) list = g_list_delete_link(list, work);
+		work = next;
+		}
+
+	return list;
+}
+
+static void dupe_check_sum_start(DupeWindow *dw, GList *list, gint stage)
+{
+	dw->thread_list = dupe_check_thread_list_to_array(list, &dw->thread_list_count);
+	dw->thread_sums = g_new0(gchar *, dw->thread_list_count);
+	dw->thread_sum_stage = stage;
+	g_list_free(list);
+
+	DEBUG_1("Reading %s checksums of %d files",
+		(stage == DUPE_CHECK_SUM_STAGE_PARTIAL) ? "partial" : "full", dw->thread_list_count);
+
+	dupe_check_thread_pool_start(dw, (stage == DUPE_CHECK_SUM_STAGE_PARTIAL) ?
+				     dupe_check_thread_partial_sum : dupe_check_thread_sum);
+}
+
+/*
+ * Starts the next stage of the checksum pipeline, called when no stage
+ * runs yet or the running one is done. Returns FALSE when all checksums
+ * that can matter are read.
+ */
+static gboolean dupe_check_sum_next(DupeWindow *dw)
+{
+	GList *list = NULL;
+	DupeItem **items;
+	gchar **keys;
+	gint count;
+	gint i;
+
+	switch (dw->thread_sum_stage)
+		{
+		case DUPE_CHECK_SUM_STAGE_NONE:
+			/* same size first */
+			list = g_list_copy(dw->list);
+			if (dw->second_set) list = g_list_concat(list, g_list_copy(dw->second_list));
+			items = dupe_check_thread_list_to_array(list, &count);
+			g_list_free(list);
+
+			keys = g_new(gchar *, count);
+			for (i = 0; i < count; i++)
+				{
+				keys[i] = g_strdup_printf("%" G_GINT64_FORMAT, (gint64)items[i]->fd->size);
+				}
+			list = dupe_check_sum_collisions(items, keys, count, dw->sum_type);
+
+			for (i = 0; i < count; i++) g_free(keys[i]);
+			g_free(keys);
+			g_free(items);
+
+			if (!list) return FALSE;
+
+			dupe_check_sum_start(dw, list, DUPE_CHECK_SUM_STAGE_PARTIAL);
+			return TRUE;
+		case DUPE_CHECK_SUM_STAGE_PARTIAL:
+			/* then same size and same ends */
+			keys = g_new(gchar *, dw->thread_list_count);
+			for (i = 0; i < dw->thread_list_count; i++)
+				{
+				keys[i] = dw->thread_sums[i] ? g_strdup_printf("%" G_GINT64_FORMAT "\n%s",
+									      (gint64)dw->thread_list[i]->fd->size,
+									      dw->thread_sums[i]) : NULL;
+				}
+			list = dupe_check_sum_collisions(dw->thread_list, keys, dw->thread_list_count, dw->sum_type);
+
+			for (i = 0; i < dw->thread_list_count; i++) g_free(keys[i]);
+			g_free(keys);
+
+			/* files with a cached checksum are only needed as keys */
+			list = dupe_check_sum_drop_known(list, dw->sum_type);
+
+			dupe_check_thread_stop(dw);
+			if (!list) return FALSE;
+
+			dupe_check_sum_start(dw, list, DUPE_CHECK_SUM_STAGE_FULL);
+			return TRUE;
+		case DUPE_CHECK_SUM_STAGE_FULL:
+		default:
+			dupe_check_thread_stop(dw);
+			break;
+		}
+
+	return FALSE;
+}
+
+#endif /* HAVE_GTHREAD */
+
 /*
  * ------------------------------------------------------------------
  * Thumbnail handling
@@ -1392,6 +2074,10 @@ static void dupe_thumb_step(DupeWindow *dw)
 
 static void dupe_check_stop(DupeWindow *dw)
 {
+#ifdef HAVE_GTHREAD
+	dupe_check_thread_stop(dw);
+#endif
+
 	if (dw->idle_id || dw->img_loader || dw->thumb_loader)
 		{
 		g_source_remove(dw->idle_id);
@@ -1429,8 +2115,8 @@ static void dupe_loader_done_cb(ImageLoader *il, gpointer data)
 
 		if (di->width == 0 && di->height == 0)
 			{
-			di->width = gdk_pixbuf_get_width(pixbuf);
-			di->height = gdk_pixbuf_get_height(pixbuf);
+			/* the pixbuf is reduced, ask the loader */
+			image_loader_get_image_size(il, &di->width, &di->height);
 			}
 		if (options->thumbnails.enable_caching)
 			{
@@ -1476,6 +2162,31 @@ static gboolean dupe_check_cb(gpointer data)
 		if ((dw->match_mask & DUPE_MATCH_SUM) &&
 		    !(dw->setup_mask & DUPE_MATCH_SUM) )
 			{
+#ifdef HAVE_GTHREAD
+			if (dw->thread_pool)
+				{
+				if (!dupe_check_thread_merge(dw))
+					{
+					dupe_window_update_progress(dw, _("Reading checksums..."),
+						dw->thread_list_count == 0 ? 0.0 : (gdouble)dw->setup_n / dw->thread_list_count, FALSE);
+					return TRUE;
+					}
+				if (dupe_check_sum_next(dw)) return TRUE;
+
+				/* back to idle for the other stages */
+				dw->setup_mask |= DUPE_MATCH_SUM;
+				dupe_setup_reset(dw);
+				dw->idle_id = g_idle_add(dupe_check_cb, dw);
+				return FALSE;
+				}
+
+			if (dupe_check_sum_next(dw))
+				{
+				dupe_window_update_progress(dw, _("Reading checksums..."), 0.0, FALSE);
+				dw->idle_id = g_timeout_add(DUPE_CHECK_THREAD_POLL, dupe_check_cb, dw);
+				return FALSE;
+				}
+#else
 			if (!dw->setup_point) dw->setup_point = dw->list;
 
 			while (dw->setup_point)
@@ -1485,7 +2196,7 @@ static gboolean dupe_check_cb(gpointer data)
 				dw->setup_point = dupe_setup_point_step(dw, dw->setup_point);
 				dw->setup_n++;
 
-				if (!di->md5sum)
+				if (!*dupe_item_sum(di, dw->sum_type))
 					{
 					dupe_window_update_progress(dw, _("Reading checksums..."),
 						dw->setup_count == 0 ? 0.0 : (gdouble)(dw->setup_n - 1) / dw->setup_count, FALSE);
@@ -1493,10 +2204,10 @@ static gboolean dupe_check_cb(gpointer data)
 					if (options->thumbnails.enable_caching)
 						{
 						dupe_item_read_cache(di);
-						if (di->md5sum) return TRUE;
+						if (*dupe_item_sum(di, dw->sum_type)) return TRUE;
 						}
 
-					di->md5sum = md5_text_from_file_utf8(di->fd->path, "");
+					dupe_item_read_sum(di, dw->sum_type);
 					if (options->thumbnails.enable_caching)
 						{
 						dupe_item_write_cache(di);
@@ -1504,6 +2215,7 @@ static gboolean dupe_check_cb(gpointer data)
 					return TRUE;
 					}
 				}
+#endif
 			dw->setup_mask |= DUPE_MATCH_SUM;
 			dupe_setup_reset(dw);
 			}
@@ -1568,7 +2280,9 @@ static gboolean dupe_check_cb(gpointer data)
 						}
 
 					dw->img_loader = image_loader_new(di->fd);
+					image_loader_set_queue_priority(dw->img_loader, IMAGE_LOADER_PRIORITY_BACKGROUND);
 					image_loader_set_buffer_size(dw->img_loader, 8);
+					image_loader_set_requested_size(dw->img_loader, IMAGE_SIM_LOAD_SIZE, IMAGE_SIM_LOAD_SIZE);
 					g_signal_connect(G_OBJECT(dw->img_loader), "error", (GCallback)dupe_loader_done_cb, dw);
 					g_signal_connect(G_OBJECT(dw->img_loader), "done", (GCallback)dupe_loader_done_cb, dw);
 
@@ -1596,6 +2310,30 @@ static gboolean dupe_check_cb(gpointer data)
 		dw->setup_count = g_list_length(dw->list);
 		}
 
+#ifdef HAVE_GTHREAD
+	if (dw->working)
+		{
+		if (!dw->thread_pool)
+			{
+			/* the workers report back in batches, poll instead of spinning in idle */
+			dupe_check_thread_start(dw);
+			dw->idle_id = g_timeout_add(DUPE_CHECK_THREAD_POLL, dupe_check_cb, dw);
+			return FALSE;
+			}
+
+		if (!dupe_check_thread_merge(dw))
+			{
+			dupe_window_update_progress(dw, _("Comparing..."), dw->setup_count == 0 ? 0.0 : (gdouble) dw->setup_n / dw->setup_count, FALSE);
+			return TRUE;
+			}
+
+		dupe_check_thread_stop(dw);
+		dw->working = NULL;
+		dw->idle_id = g_idle_add(dupe_check_cb, dw);
+		return FALSE;
+		}
+#endif
+
 	if (!dw->working)
 		{
 		if (dw->setup_count > 0)
@@ -1631,7 +2369,17 @@ static gboolean dupe_check_cb(gpointer data)
 
 static void dupe_check_start(DupeWindow *dw)
 {
+#ifdef HAVE_GTHREAD
+	if (dupe_check_thread_stop(dw) && dw->idle_id)
+		{
+		/* drop the result polling, setup runs in idle */
+		g_source_remove(dw->idle_id);
+		dw->idle_id = 0;
+		}
+#endif
+
 	dw->setup_done = FALSE;
+	dw->sum_type = dupe_sum_type();
 
 	dw->setup_count = g_list_length(dw->list);
 	if (dw->second_set) dw->setup_count += g_list_length(dw->second_list);
@@ -1657,9 +2405,15 @@ static void dupe_check_start(DupeWindow *dw)
 
 static void dupe_item_remove(DupeWindow *dw, DupeItem *di)
 {
+	gboolean restart = FALSE;
+
 	if (!di) return;
 
 	/* handle things that may be in progress... */
+#ifdef HAVE_GTHREAD
+	/* the workers use a snapshot of the lists, restart them without this item */
+	restart = dupe_check_thread_stop(dw);
+#endif
 	if (dw->working && dw->working->data == di)
 		{
 		dw->working = dw->working->prev;
@@ -1738,6 +2492,20 @@ static void dupe_item_remove(DupeWindow *dw, DupeItem *di)
 		}
 	dupe_item_free(di);
 
+	if (restart && !dw->setup_done)
+		{
+		/* checksums already read are kept, the pipeline starts over in idle */
+		if (dw->idle_id) g_source_remove(dw->idle_id);
+		dw->idle_id = g_idle_add(dupe_check_cb, dw);
+		}
+	else if (restart)
+		{
+		/* matches already linked are kept, the next poll starts new workers */
+		dw->working = g_list_last(dw->list);
+		dw->setup_count = g_list_length(dw->list);
+		dupe_setup_reset(dw);
+		}
+
 	dupe_window_update_count(dw, FALSE);
 }
 
@@ -1989,6 +2757,7 @@ static void dupe_display_stats(DupeWindow *dw, DupeItem *di)
 	dupe_display_label(gd->vbox, "dimensions:", buf);
 	g_free(buf);
 	dupe_display_label(gd->vbox, "md5sum:", (di->md5sum) ? di->md5sum : "not generated");
+	dupe_display_label(gd->vbox, "xxh64sum:", (di->xxh64sum) ? di->xxh64sum : "not generated");
 
 	dupe_display_label(gd->vbox, "thumbprint:", (di->simd) ? "" : "not generated");
 	if (di->simd)
@@ -2964,6 +3733,14 @@ static void dupe_window_rotation_invariant_cb(GtkWidget *widget, gpointer data)
 	dupe_window_recompare(dw);
 }
 
+static void dupe_window_fast_checksum_cb(GtkWidget *widget, gpointer data)
+{
+	DupeWindow *dw = data;
+
+	options->duplicates_fast_checksum = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+	dupe_window_recompare(dw);
+}
+
 static void dupe_window_custom_threshold_cb(GtkWidget *widget, gpointer data)
 {
 	DupeWindow *dw = data;
@@ -3264,6 +4041,7 @@ DupeWindow *dupe_window_new()
 
 	dw = g_new0(DupeWindow, 1);
 
+	dw->sum_type = dupe_sum_type();
 	dw->match_mask = DUPE_MATCH_NAME;
 	if (options->duplicates_match == DUPE_MATCH_NAME) dw->match_mask = DUPE_MATCH_NAME;
 	if (options->duplicates_match == DUPE_MATCH_SIZE) dw->match_mask = DUPE_MATCH_SIZE;
@@ -3397,6 +4175,14 @@ DupeWindow *dupe_window_new()
 	gtk_box_pack_start(GTK_BOX(status_box), dw->button_rotation_invariant, FALSE, FALSE, PREF_PAD_SPACE);
 	gtk_widget_show(dw->button_rotation_invariant);
 
+	button = gtk_check_button_new_with_label(_("Fast checksum"));
+	gtk_widget_set_tooltip_text(GTK_WIDGET(button), _("Compare by xxh64 instead of md5 checksums, much faster on big files"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), options->duplicates_fast_checksum);
+	g_signal_connect(G_OBJECT(button), "toggled",
+			 G_CALLBACK(dupe_window_fast_checksum_cb), dw);
+	gtk_box_pack_start(GTK_BOX(status_box), button, FALSE, FALSE, PREF_PAD_SPACE);
+	gtk_widget_show(button);
+
 	button = gtk_check_button_new_with_label(_("Compare two file sets"));
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), dw->second_set);
 	g_signal_connect(G_OBJECT(button), "toggled",
@@ -22,6 +22,7 @@
 #ifndef DUPE_H
 #define DUPE_H
 
+#include "md5-util.h"
 #include "similar.h"
 
 /* match methods */
@@ -57,10 +58,12 @@ struct _DupeItem
 	FileData *fd;
 
 	gchar *md5sum;
+	gchar *xxh64sum;
 	gint width;
 	gint height;
 
 	ImageSimilarityData *simd;
+	ImageSimilarityTransfo *simd_transfo;	/* only while compared as the needle */
 
 	/* thumb */
 	GdkPixbuf *pixbuf;
@@ -104,9 +107,29 @@ struct _DupeWindow
 	gint setup_n;			/* these are merely for speed optimization */
 	GList *setup_point;		/* ditto */
 	DupeMatchType setup_mask;	/* ditto */
+	DigestType sum_type;		/* of DUPE_MATCH_SUM, taken when a check starts */
 	guint64 setup_time;
 	guint64 setup_time_count;
 
+	/* threaded comparison */
+	GThreadPool *thread_pool;
+	GMutex *thread_mutex;
+	DupeItem **thread_list;		/* snapshot of list, the needles */
+	gint thread_list_count;
+	DupeItem **thread_second_list;	/* snapshot of second_list */
+	gint thread_second_count;
+	DupeMatchType thread_mask;
+	ImageSimilarityIndex *thread_index;	/* over the items compared against, for similarity */
+	GHashTable *thread_bucket_table;	/* items compared against, by match key */
+	GArray **thread_buckets;		/* the bucket of each needle */
+	gint thread_next;		/* needles below this index are not taken yet */
+	gint thread_done;		/* needles compared */
+	gint thread_abort;
+	GList *thread_results;		/* matches waiting to be linked by the main thread */
+	GList *(*thread_func)(DupeWindow *dw, gint n, GList *results);	/* work on thread_list[n] */
+	gint thread_sum_stage;		/* checksum pipeline, see dupe_check_sum_next() */
+	gchar **thread_sums;		/* partial checksums of thread_list */
+
 	DupeItem *click_item;		/* for popup menu */
 
 	ThumbLoader *thumb_loader;
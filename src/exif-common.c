@@ -659,6 +659,257 @@ static void zd_tz(ZoneDetectResult *results, gchar **timezone, gchar **countryna
 	g_free(timezone_id);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * timezone database
+ *-----------------------------------------------------------------------------
+ */
+
+#define EXIF_TIMEZONE_CACHE_SIZE 64	/* positions with their results kept */
+#define EXIF_TIMEZONE_THREAD_MIN 16	/* positions, below this they are looked up in place */
+
+typedef struct _ExifTimezoneCacheEntry ExifTimezoneCacheEntry;
+struct _ExifTimezoneCacheEntry
+{
+	gfloat latitude;
+	gfloat longitude;
+	gboolean found;
+	gchar *timezone;
+	gchar *countryname;
+	gchar *countryalpha2;
+};
+
+/* the database is opened on first use and kept, lookups only read the
+ * mapped file and need no locking; the cache is under the mutex
+ */
+static ZoneDetect *exif_timezone_db = NULL;
+static GList *exif_timezone_cache = NULL;	/* most recently used first */
+static GMutex *exif_timezone_mutex = NULL;
+
+static void exif_timezone_lock(void)
+{
+	static gsize init = 0;
+
+	if (g_once_init_enter(&init))
+		{
+#if GLIB_CHECK_VERSION(2,32,0)
+		exif_timezone_mutex = g_new(GMutex, 1);
+		g_mutex_init(exif_timezone_mutex);
+#else
+		exif_timezone_mutex = g_mutex_new();
+#endif
+		g_once_init_leave(&init, 1);
+		}
+
+	g_mutex_lock(exif_timezone_mutex);
+}
+
+static void exif_timezone_unlock(void)
+{
+	g_mutex_unlock(exif_timezone_mutex);
+}
+
+/* called with the lock held */
+static ZoneDetect *exif_timezone_db_get(void)
+{
+	static gboolean opened = FALSE;
+	gchar *zd_path;
+
+	if (opened) return exif_timezone_db;
+	opened = TRUE;
+
+	zd_path = g_build_filename(GQ_BIN_DIR, TIMEZONE_DATABASE, NULL);
+	if (g_file_test(zd_path, G_FILE_TEST_EXISTS))
+		{
+		exif_timezone_db = ZDOpenDatabase(zd_path);
+		if (!exif_timezone_db)
+			{
+			log_printf("Error: Init of timezone database %s failed\n", zd_path);
+			}
+		}
+	g_free(zd_path);
+
+	return exif_timezone_db;
+}
+
+static void exif_timezone_cache_entry_free(ExifTimezoneCacheEntry *ce)
+{
+	g_free(ce->timezone);
+	g_free(ce->countryname);
+	g_free(ce->countryalpha2);
+	g_free(ce);
+}
+
+/* called with the lock held */
+static gboolean exif_timezone_cache_get(ExifTimezone *tz)
+{
+	GList *work;
+
+	work = exif_timezone_cache;
+	while (work)
+		{
+		ExifTimezoneCacheEntry *ce = work->data;
+
+		if (ce->latitude == (gfloat)tz->latitude && ce->longitude == (gfloat)tz->longitude)
+			{
+			exif_timezone_cache = g_list_remove_link(exif_timezone_cache, work);
+			exif_timezone_cache = g_list_concat(work, exif_timezone_cache);
+
+			tz->found = ce->found;
+			tz->timezone = g_strdup(ce->timezone);
+			tz->countryname = g_strdup(ce->countryname);
+			tz->countryalpha2 = g_strdup(ce->countryalpha2);
+			return TRUE;
+			}
+		work = work->next;
+		}
+
+	return FALSE;
+}
+
+/* called with the lock held */
+static void exif_timezone_cache_put(ExifTimezone *tz)
+{
+	ExifTimezoneCacheEntry *ce;
+	GList *work;
+
+	ce = g_new0(ExifTimezoneCacheEntry, 1);
+	ce->latitude = (gfloat)tz->latitude;
+	ce->longitude = (gfloat)tz->longitude;
+	ce->found = tz->found;
+	ce->timezone = g_strdup(tz->timezone);
+	ce->countryname = g_strdup(tz->countryname);
+	ce->countryalpha2 = g_strdup(tz->countryalpha2);
+
+	exif_timezone_cache = g_list_prepend(exif_timezone_cache, ce);
+	if (g_list_length(exif_timezone_cache) > EXIF_TIMEZONE_CACHE_SIZE)
+		{
+		work = g_list_last(exif_timezone_cache);
+		exif_timezone_cache_entry_free(work->data);
+		exif_timezone_cache = g_list_delete_link(exif_timezone_cache, work);
+		}
+}
+
+static void exif_timezone_lookup_db(ZoneDetect *db, ExifTimezone *tz)
+{
+	ZoneDetectResult *results;
+
+	results = ZDLookup(db, (gfloat)tz->latitude, (gfloat)tz->longitude, NULL);
+	if (results)
+		{
+		zd_tz(results, &tz->timezone, &tz->countryname, &tz->countryalpha2);
+		tz->found = TRUE;
+		ZDFreeResults(results);
+		}
+}
+
+typedef struct _ExifTimezoneJob ExifTimezoneJob;
+struct _ExifTimezoneJob
+{
+	ZoneDetect *db;
+	GPtrArray *misses;
+	guint threads;
+};
+
+#ifdef HAVE_GTHREAD
+static void exif_timezone_lookup_thread(gpointer data, gpointer user_data)
+{
+	ExifTimezoneJob *job = user_data;
+	guint n;
+
+	/* each thread takes every threads-th position, no locking needed */
+	for (n = GPOINTER_TO_UINT(data) - 1; n < job->misses->len; n += job->threads)
+		{
+		exif_timezone_lookup_db(job->db, g_ptr_array_index(job->misses, n));
+		}
+}
+#endif
+
+static void exif_timezone_lookup_misses(ExifTimezoneJob *job)
+{
+	guint n;
+
+#ifdef HAVE_GTHREAD
+	if (job->misses->len >= EXIF_TIMEZONE_THREAD_MIN)
+		{
+		GThreadPool *pool;
+
+		job->threads = MIN(job->misses->len / (EXIF_TIMEZONE_THREAD_MIN / 2), (guint)get_cpu_cores());
+		pool = g_thread_pool_new(exif_timezone_lookup_thread, job, job->threads, TRUE, NULL);
+		if (pool)
+			{
+			for (n = 1; n <= job->threads; n++)
+				{
+				g_thread_pool_push(pool, GUINT_TO_POINTER(n), NULL);
+				}
+			/* waits for all of them */
+			g_thread_pool_free(pool, FALSE, TRUE);
+			return;
+			}
+		}
+#endif
+
+	for (n = 0; n < job->misses->len; n++)
+		{
+		exif_timezone_lookup_db(job->db, g_ptr_array_index(job->misses, n));
+		}
+}
+
+void exif_timezone_lookup_list(ExifTimezone *tz, guint count)
+{
+	ExifTimezoneJob job;
+	guint n;
+
+	job.misses = g_ptr_array_new();
+	job.threads = 1;
+
+	exif_timezone_lock();
+	job.db = exif_timezone_db_get();
+	for (n = 0; n < count; n++)
+		{
+		tz[n].found = FALSE;
+		tz[n].timezone = NULL;
+		tz[n].countryname = NULL;
+		tz[n].countryalpha2 = NULL;
+		if (job.db && !exif_timezone_cache_get(&tz[n])) g_ptr_array_add(job.misses, &tz[n]);
+		}
+	exif_timezone_unlock();
+
+	if (job.misses->len == 0)
+		{
+		g_ptr_array_free(job.misses, TRUE);
+		return;
+		}
+
+	exif_timezone_lookup_misses(&job);
+
+	exif_timezone_lock();
+	for (n = 0; n < job.misses->len; n++)
+		{
+		exif_timezone_cache_put(g_ptr_array_index(job.misses, n));
+		}
+	exif_timezone_unlock();
+
+	g_ptr_array_free(job.misses, TRUE);
+}
+
+gboolean exif_timezone_lookup(ExifTimezone *tz)
+{
+	exif_timezone_lookup_list(tz, 1);
+
+	return tz->found;
+}
+
+void exif_timezone_clear(ExifTimezone *tz)
+{
+	g_free(tz->timezone);
+	g_free(tz->countryname);
+	g_free(tz->countryalpha2);
+	tz->timezone = NULL;
+	tz->countryname = NULL;
+	tz->countryalpha2 = NULL;
+}
+
 /**
  * @brief Gets timezone data from an exif structure
  * @param[in] exif
@@ -684,9 +935,7 @@ static gboolean exif_build_tz_data(ExifData *exif, gchar **exif_date_time, gchar
 	gchar *lat_min;
 	gchar *lon_deg;
 	gchar *lon_min;
-	gchar *zd_path;
-	ZoneDetect *cd;
-	ZoneDetectResult *results;
+	ExifTimezone tz;
 	gboolean ret = FALSE;
 
 	text_latitude = exif_get_data_as_text(exif, "Exif.GPSInfo.GPSLatitude");
@@ -713,26 +962,15 @@ static gboolean exif_build_tz_data(ExifData *exif, gchar **exif_date_time, gchar
 			longitude = -longitude;
 			}
 
-		zd_path = g_build_filename(GQ_BIN_DIR, TIMEZONE_DATABASE, NULL);
-		if (g_file_test(zd_path, G_FILE_TEST_EXISTS))
+		tz.latitude = latitude;
+		tz.longitude = longitude;
+		if (exif_timezone_lookup(&tz))
 			{
-			cd = ZDOpenDatabase(zd_path);
-			if (cd)
-				{
-				results = ZDLookup(cd, latitude, longitude, NULL);
-				if (results)
-					{
-					zd_tz(results, timezone, countryname, countryalpha2);
-					ret = TRUE;
-					}
-				}
-			else
-				{
-				log_printf("Error: Init of timezone database %s failed\n", zd_path);
-				}
-			ZDCloseDatabase(cd);
+			*timezone = tz.timezone;
+			*countryname = tz.countryname;
+			*countryalpha2 = tz.countryalpha2;
+			ret = TRUE;
 			}
-		g_free(zd_path);
 		}
 
 	if (ret && text_date && text_time)
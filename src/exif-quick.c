@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "main.h"
+#include "exif-quick.h"
+
+#include "jpeg_parser.h"
+#include "ui_fileops.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/* one read, big enough for a whole exif APP1 segment of a jpeg */
+#define EXIF_QUICK_HEADER_SIZE (64 * 1024)
+
+/* jpeg segments looked at before giving up, the exif and xmp ones come first */
+#define EXIF_QUICK_SEGMENTS_MAX 64
+
+#define EXIF_QUICK_THREAD_MIN 32	/* files, below this they are read in place */
+#define EXIF_QUICK_THREAD_MAX 16	/* reading waits on the disk, not the cpu */
+
+#define EXIF_QUICK_EXIF_MAGIC "Exif\0\0"
+#define EXIF_QUICK_EXIF_MAGIC_LEN 6
+#define EXIF_QUICK_XMP_MAGIC "http://ns.adobe.com/xap/1.0/"
+#define EXIF_QUICK_XMP_MAGIC_LEN 29	/* including the terminating 0 */
+
+#define EXIF_QUICK_FORMAT_ASCII 2
+#define EXIF_QUICK_FORMAT_SHORT 3
+#define EXIF_QUICK_FORMAT_LONG 4
+
+#define EXIF_QUICK_TAG_ORIENTATION		0x0112
+#define EXIF_QUICK_TAG_XMP			0x02bc
+#define EXIF_QUICK_TAG_RATING			0x4746
+#define EXIF_QUICK_TAG_EXIF_IFD			0x8769
+#define EXIF_QUICK_TAG_DATE_TIME_ORIGINAL	0x9003
+#define EXIF_QUICK_TAG_DATE_TIME_DIGITIZED	0x9004
+
+typedef struct _ExifQuickParse ExifQuickParse;
+struct _ExifQuickParse
+{
+	ExifQuickData *eq;
+	guint exif_offset;	/* of the exif sub-IFD, 0 for none */
+	gboolean error;		/* a value is outside of the data read */
+};
+
+/* same conversion as read_exif_time_data() */
+static gboolean exif_quick_parse_date(const guchar *text, guint len, time_t *date)
+{
+	gchar buf[20];
+	struct tm time_str;
+	gint year, month, day, hour, min, sec;
+
+	len = MIN(len, sizeof(buf) - 1);
+	memcpy(buf, text, len);
+	buf[len] = '\0';
+
+	if (sscanf(buf, "%4d:%2d:%2d %2d:%2d:%2d", &year, &month, &day, &hour, &min, &sec) != 6) return FALSE;
+
+	memset(&time_str, 0, sizeof(time_str));
+	time_str.tm_year  = year - 1900;
+	time_str.tm_mon   = month - 1;
+	time_str.tm_mday  = day;
+	time_str.tm_hour  = hour;
+	time_str.tm_min   = min;
+	time_str.tm_sec   = sec;
+	time_str.tm_isdst = 0;
+
+	*date = mktime(&time_str);
+	return TRUE;
+}
+
+static void exif_quick_parse_date_entry(ExifQuickParse *qp, const guchar *tiff, guint offset,
+					guint size, TiffByteOrder bo, ExifQuickFlags flag, time_t *date)
+{
+	guint format;
+	guint count;
+	guint data_offset;
+
+	format = tiff_byte_get_int16(tiff + offset + TIFF_TIFD_OFFSET_FORMAT, bo);
+	count = tiff_byte_get_int32(tiff + offset + TIFF_TIFD_OFFSET_COUNT, bo);
+	if (format != EXIF_QUICK_FORMAT_ASCII) return;
+
+	if (count > 4)
+		{
+		data_offset = tiff_byte_get_int32(tiff + offset + TIFF_TIFD_OFFSET_DATA, bo);
+		if (data_offset > size || count > size - data_offset)
+			{
+			qp->error = TRUE;
+			return;
+			}
+		}
+	else
+		{
+		data_offset = offset + TIFF_TIFD_OFFSET_DATA;
+		}
+
+	/* an empty or blank date is the same as none */
+	if (exif_quick_parse_date(tiff + data_offset, count, date)) qp->eq->found |= flag;
+}
+
+static gint exif_quick_parse_entry(const guchar *tiff, guint offset,
+				   guint size, TiffByteOrder bo,
+				   gpointer data)
+{
+	ExifQuickParse *qp = data;
+	ExifQuickData *eq = qp->eq;
+	guint tag;
+	guint format;
+
+	tag = tiff_byte_get_int16(tiff + offset + TIFF_TIFD_OFFSET_TAG, bo);
+	format = tiff_byte_get_int16(tiff + offset + TIFF_TIFD_OFFSET_FORMAT, bo);
+
+	switch (tag)
+		{
+		case EXIF_QUICK_TAG_ORIENTATION:
+			if (format == EXIF_QUICK_FORMAT_SHORT)
+				{
+				eq->orientation = tiff_byte_get_int16(tiff + offset + TIFF_TIFD_OFFSET_DATA, bo);
+				eq->found |= EXIF_QUICK_ORIENTATION;
+				}
+			break;
+		case EXIF_QUICK_TAG_RATING:
+			if (format == EXIF_QUICK_FORMAT_SHORT)
+				{
+				eq->rating = tiff_byte_get_int16(tiff + offset + TIFF_TIFD_OFFSET_DATA, bo);
+				eq->found |= EXIF_QUICK_RATING;
+				}
+			break;
+		case EXIF_QUICK_TAG_XMP:
+			eq->found |= EXIF_QUICK_XMP;
+			break;
+		case EXIF_QUICK_TAG_EXIF_IFD:
+			if (format == EXIF_QUICK_FORMAT_LONG)
+				{
+				qp->exif_offset = tiff_byte_get_int32(tiff + offset + TIFF_TIFD_OFFSET_DATA, bo);
+				}
+			break;
+		case EXIF_QUICK_TAG_DATE_TIME_ORIGINAL:
+			exif_quick_parse_date_entry(qp, tiff, offset, size, bo,
+						    EXIF_QUICK_DATE, &eq->exifdate);
+			break;
+		case EXIF_QUICK_TAG_DATE_TIME_DIGITIZED:
+			exif_quick_parse_date_entry(qp, tiff, offset, size, bo,
+						    EXIF_QUICK_DATE_DIGITIZED, &eq->exifdate_digitized);
+			break;
+		default:
+			break;
+		}
+
+	return 0;
+}
+
+/* IFD0 and the exif sub-IFD, they have to be within the data read */
+static gboolean exif_quick_parse_tiff(const guchar *tiff, guint size, ExifQuickData *eq)
+{
+	ExifQuickParse qp;
+	TiffByteOrder bo;
+	guint offset;
+
+	if (!tiff_directory_offset(tiff, size, &offset, &bo)) return FALSE;
+
+	qp.eq = eq;
+	qp.exif_offset = 0;
+	qp.error = FALSE;
+
+	if (tiff_parse_IFD_table(tiff, offset, size, bo, NULL, exif_quick_parse_entry, &qp) != 0) return FALSE;
+
+	if (qp.exif_offset)
+		{
+		offset = qp.exif_offset;
+		qp.exif_offset = 0;
+		if (offset >= size ||
+		    tiff_parse_IFD_table(tiff, offset, size, bo, NULL, exif_quick_parse_entry, &qp) != 0) return FALSE;
+		}
+
+	return !qp.error;
+}
+
+/*
+ * Walks the segments up to the image data. The exif one has to be within
+ * the data read, the headers of the later ones are read as needed, just to
+ * see if there is xmp.
+ */
+static gboolean exif_quick_parse_jpeg(gint fd, const guchar *data, guint len, ExifQuickData *eq)
+{
+	gboolean exif_done = FALSE;
+	guint offset = 2;
+	guint segments;
+
+	for (segments = 0; segments < EXIF_QUICK_SEGMENTS_MAX; segments++)
+		{
+		guchar head[4 + EXIF_QUICK_XMP_MAGIC_LEN];
+		const guchar *seg;
+		guint length;
+
+		if (offset + sizeof(head) <= len)
+			{
+			seg = data + offset;
+			}
+		else
+			{
+			memset(head, 0, sizeof(head));
+			if (pread(fd, head, sizeof(head), offset) < 4) return FALSE;
+			seg = head;
+			}
+
+		if (seg[0] != JPEG_MARKER) return FALSE;
+		if (seg[1] == JPEG_MARKER_SOS || seg[1] == JPEG_MARKER_EOI) return TRUE;
+
+		length = ((guint)seg[2] << 8) + seg[3];
+		if (length < 2) return FALSE;
+
+		if (seg[1] == JPEG_MARKER_APP1)
+			{
+			if (!exif_done && length >= 2 + EXIF_QUICK_EXIF_MAGIC_LEN &&
+			    memcmp(seg + 4, EXIF_QUICK_EXIF_MAGIC, EXIF_QUICK_EXIF_MAGIC_LEN) == 0)
+				{
+				guint tiff_offset = offset + 4 + EXIF_QUICK_EXIF_MAGIC_LEN;
+
+				if (tiff_offset >= len) return FALSE;
+				if (!exif_quick_parse_tiff(data + tiff_offset,
+							   MIN(offset + 2 + length, len) - tiff_offset, eq)) return FALSE;
+				exif_done = TRUE;
+				}
+			else if (length >= 2 + EXIF_QUICK_XMP_MAGIC_LEN &&
+				 memcmp(seg + 4, EXIF_QUICK_XMP_MAGIC, EXIF_QUICK_XMP_MAGIC_LEN) == 0)
+				{
+				eq->found |= EXIF_QUICK_XMP;
+				if (exif_done) return TRUE;
+				}
+			}
+
+		offset += 2 + length;
+		}
+
+	return FALSE;
+}
+
+gboolean exif_quick_read(const gchar *path, ExifQuickData *eq)
+{
+	gchar *pathl;
+	guchar *data;
+	gssize len;
+	gint fd;
+
+	memset(eq, 0, sizeof(ExifQuickData));
+
+	pathl = path_from_utf8(path);
+	fd = open(pathl, O_RDONLY);
+	g_free(pathl);
+	if (fd < 0) return FALSE;
+
+	data = g_malloc(EXIF_QUICK_HEADER_SIZE);
+	len = read(fd, data, EXIF_QUICK_HEADER_SIZE);
+	if (len >= 4)
+		{
+		if (data[0] == JPEG_MARKER && data[1] == JPEG_MARKER_SOI)
+			{
+			eq->valid = exif_quick_parse_jpeg(fd, data, len, eq);
+			}
+		else
+			{
+			/* tiff and the raw formats based on it */
+			eq->valid = exif_quick_parse_tiff(data, len, eq);
+			}
+		}
+
+	g_free(data);
+	close(fd);
+
+	if (!eq->valid) eq->found = 0;
+	return eq->valid;
+}
+
+typedef struct _ExifQuickJob ExifQuickJob;
+struct _ExifQuickJob
+{
+	gchar **paths;
+	ExifQuickData *eq;
+	guint count;
+	guint threads;
+};
+
+#ifdef HAVE_GTHREAD
+static void exif_quick_read_thread(gpointer data, gpointer user_data)
+{
+	ExifQuickJob *job = user_data;
+	guint n;
+
+	/* each thread takes every threads-th file, no locking needed */
+	for (n = GPOINTER_TO_UINT(data) - 1; n < job->count; n += job->threads)
+		{
+		exif_quick_read(job->paths[n], &job->eq[n]);
+		}
+}
+#endif
+
+void exif_quick_read_list(gchar **paths, ExifQuickData *eq, guint count)
+{
+	ExifQuickJob job;
+	guint n;
+
+	job.paths = paths;
+	job.eq = eq;
+	job.count = count;
+	job.threads = 1;
+
+#ifdef HAVE_GTHREAD
+	if (count >= EXIF_QUICK_THREAD_MIN)
+		{
+		GThreadPool *pool;
+
+		job.threads = MIN(count / (EXIF_QUICK_THREAD_MIN / 4), EXIF_QUICK_THREAD_MAX);
+		pool = g_thread_pool_new(exif_quick_read_thread, &job, job.threads, TRUE, NULL);
+		if (pool)
+			{
+			for (n = 1; n <= job.threads; n++)
+				{
+				g_thread_pool_push(pool, GUINT_TO_POINTER(n), NULL);
+				}
+			/* waits for all of them */
+			g_thread_pool_free(pool, FALSE, TRUE);
+			return;
+			}
+		}
+#endif
+
+	for (n = 0; n < job.count; n++)
+		{
+		exif_quick_read(job.paths[n], &job.eq[n]);
+		}
+}
+
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EXIF_QUICK_H
+#define EXIF_QUICK_H
+
+/*
+ * A few exif values read straight from the start of jpeg and tiff
+ * based files, without going through exif_read_fd(). Meant for reading
+ * them from many files at once, for sorting.
+ *
+ * Only the file itself is looked at, the callers have to check for xmp
+ * sidecars and unwritten metadata.
+ */
+
+typedef enum {
+	EXIF_QUICK_DATE			= 1 << 0,	/* Exif.Photo.DateTimeOriginal */
+	EXIF_QUICK_DATE_DIGITIZED	= 1 << 1,	/* Exif.Photo.DateTimeDigitized */
+	EXIF_QUICK_ORIENTATION		= 1 << 2,	/* Exif.Image.Orientation */
+	EXIF_QUICK_RATING		= 1 << 3,	/* Exif.Image.Rating */
+	EXIF_QUICK_XMP			= 1 << 4	/* the file has embedded xmp, which may override these */
+} ExifQuickFlags;
+
+typedef struct _ExifQuickData ExifQuickData;
+struct _ExifQuickData
+{
+	gboolean valid;		/* the headers were read, values not found are not in the exif */
+	ExifQuickFlags found;
+
+	time_t exifdate;
+	time_t exifdate_digitized;
+	gint orientation;
+	gint rating;
+};
+
+gboolean exif_quick_read(const gchar *path, ExifQuickData *eq);
+
+/* reads count files into eq, on several threads for many of them */
+void exif_quick_read_list(gchar **paths, ExifQuickData *eq, guint count);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
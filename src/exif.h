@@ -168,5 +168,25 @@ void exif_free_preview(guchar *buf);
 
 gchar *metadata_file_info(FileData *fd, const gchar *key, MetadataFormat format);
 
+/* timezone and country at a GPS position, from the timezone database;
+ * recent positions are cached
+ */
+typedef struct _ExifTimezone ExifTimezone;
+struct _ExifTimezone
+{
+	gdouble latitude;
+	gdouble longitude;
+
+	gboolean found;
+	gchar *timezone;		/* in the form "Europe/London" */
+	gchar *countryname;		/* in the form "United Kingdom" */
+	gchar *countryalpha2;		/* in the form "GB" */
+};
+
+gboolean exif_timezone_lookup(ExifTimezone *tz);
+/* looks up count positions at once, on several threads for many of them */
+void exif_timezone_lookup_list(ExifTimezone *tz, guint count);
+void exif_timezone_clear(ExifTimezone *tz);
+
 #endif
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
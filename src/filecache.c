@@ -24,13 +24,20 @@
 /* Set to TRUE to add file cache dumps to the debug output */
 const gboolean debug_file_cache = FALSE;
 
-/* this implements a simple LRU algorithm */
+/* this implements a simple LRU algorithm,
+ * the queue is ordered from the most recently used entry,
+ * the hash table finds the queue link of a FileData */
 
 struct _FileCacheData {
 	FileCacheReleaseFunc release;
-	GList *list;
+	GQueue queue;		/* FileCacheEntry */
+	GHashTable *table;	/* FileData -> GList link in queue */
 	gulong max_size;
 	gulong size;
+
+	gulong hits;
+	gulong misses;
+	gulong evictions;
 };
 
 typedef struct _FileCacheEntry FileCacheEntry;
@@ -47,70 +54,86 @@ FileCacheData *file_cache_new(FileCacheReleaseFunc release, gulong max_size)
 	FileCacheData *fc = g_new(FileCacheData, 1);
 
 	fc->release = release;
-	fc->list = NULL;
+	g_queue_init(&fc->queue);
+	fc->table = g_hash_table_new(g_direct_hash, g_direct_equal);
 	fc->max_size = max_size;
 	fc->size = 0;
 
+	fc->hits = 0;
+	fc->misses = 0;
+	fc->evictions = 0;
+
 	file_data_register_notify_func(file_cache_notify_cb, fc, NOTIFY_PRIORITY_HIGH);
 
 	return fc;
 }
 
+static void file_cache_entry_free(FileCacheData *fc, GList *link)
+{
+	FileCacheEntry *fe = link->data;
+
+	g_hash_table_remove(fc->table, fe->fd);
+	g_queue_delete_link(&fc->queue, link);
+
+	fc->size -= fe->size;
+	fc->release(fe->fd);
+	file_data_unref(fe->fd);
+	g_free(fe);
+}
+
 gboolean file_cache_get(FileCacheData *fc, FileData *fd)
 {
-	GList *work;
+	GList *link;
 
 	g_assert(fc && fd);
 
-	work = fc->list;
-	while (work)
+	link = g_hash_table_lookup(fc->table, fd);
+	if (!link)
 		{
-		FileCacheEntry *fce = work->data;
-		if (fce->fd == fd)
-			{
-			/* entry exists */
-			DEBUG_2("cache hit: fc=%p %s", fc, fd->path);
-			if (work == fc->list) return TRUE; /* already at the beginning */
-			/* move it to the beginning */
-			DEBUG_2("cache move to front: fc=%p %s", fc, fd->path);
-			fc->list = g_list_remove_link(fc->list, work);
-			fc->list = g_list_concat(work, fc->list);
-
-			if (file_data_check_changed_files(fd)) {
-				/* file has been changed, cance entry is no longer valid */
-				file_cache_remove_fd(fc, fd);
-				return FALSE;
-			}
-			if (debug_file_cache) file_cache_dump(fc);
-			return TRUE;
-			}
-		work = work->next;
+		DEBUG_2("cache miss: fc=%p %s", fc, fd->path);
+		fc->misses++;
+		return FALSE;
 		}
-	DEBUG_2("cache miss: fc=%p %s", fc, fd->path);
-	return FALSE;
+
+	/* entry exists */
+	DEBUG_2("cache hit: fc=%p %s", fc, fd->path);
+	if (link != fc->queue.head)
+		{
+		/* move it to the beginning */
+		DEBUG_2("cache move to front: fc=%p %s", fc, fd->path);
+		g_queue_unlink(&fc->queue, link);
+		g_queue_push_head_link(&fc->queue, link);
+		}
+
+	if (file_data_check_changed_files(fd))
+		{
+		/* file has been changed, cache entry is no longer valid */
+		file_cache_remove_fd(fc, fd);
+		fc->misses++;
+		return FALSE;
+		}
+
+	fc->hits++;
+	if (debug_file_cache) file_cache_dump(fc);
+	return TRUE;
 }
 
 void file_cache_set_size(FileCacheData *fc, gulong size)
 {
-	GList *work;
-	FileCacheEntry *last_fe;
+	gulong evictions = fc->evictions;
 
 	if (debug_file_cache) file_cache_dump(fc);
 
-	work = g_list_last(fc->list);
-	while (fc->size > size && work)
+	while (fc->size > size && fc->queue.tail)
+		{
+		DEBUG_2("cache evict: fc=%p %s", fc, ((FileCacheEntry *)fc->queue.tail->data)->fd->path);
+		fc->evictions++;
+		file_cache_entry_free(fc, fc->queue.tail);
+		}
+
+	if (fc->evictions != evictions)
 		{
-		GList *prev;
-		last_fe = work->data;
-		prev = work->prev;
-		fc->list = g_list_delete_link(fc->list, work);
-		work = prev;
-
-		DEBUG_2("file changed - cache remove: fc=%p %s", fc, last_fe->fd->path);
-		fc->size -= last_fe->size;
-		fc->release(last_fe->fd);
-		file_data_unref(last_fe->fd);
-		g_free(last_fe);
+		DEBUG_1("cache stats: fc=%p hits:%lu misses:%lu evictions:%lu", fc, fc->hits, fc->misses, fc->evictions);
 		}
 }
 
@@ -118,13 +141,14 @@ void file_cache_put(FileCacheData *fc, FileData *fd, gulong size)
 {
 	FileCacheEntry *fe;
 
-	if (file_cache_get(fc, fd)) return;
+	if (g_hash_table_lookup(fc->table, fd) && file_cache_get(fc, fd)) return;
 
 	DEBUG_2("cache add: fc=%p %s", fc, fd->path);
 	fe = g_new(FileCacheEntry, 1);
 	fe->fd = file_data_ref(fd);
 	fe->size = size;
-	fc->list = g_list_prepend(fc->list, fe);
+	g_queue_push_head(&fc->queue, fe);
+	g_hash_table_insert(fc->table, fe->fd, fc->queue.head);
 	fc->size += size;
 
 	file_cache_set_size(fc, fc->max_size);
@@ -148,37 +172,24 @@ void file_cache_set_max_size(FileCacheData *fc, gulong size)
 
 static void file_cache_remove_fd(FileCacheData *fc, FileData *fd)
 {
-	GList *work;
-	FileCacheEntry *fe;
+	GList *link;
 
 	if (debug_file_cache) file_cache_dump(fc);
 
-	work = fc->list;
-	while (work)
-		{
-		GList *current = work;
-		fe = work->data;
-		work = work->next;
-
-		if (fe->fd == fd)
-			{
-			fc->list = g_list_delete_link(fc->list, current);
+	link = g_hash_table_lookup(fc->table, fd);
+	if (!link) return;
 
-			DEBUG_1("cache remove: fc=%p %s", fc, fe->fd->path);
-			fc->size -= fe->size;
-			fc->release(fe->fd);
-			file_data_unref(fe->fd);
-			g_free(fe);
-			}
-		}
+	DEBUG_1("cache remove: fc=%p %s", fc, fd->path);
+	file_cache_entry_free(fc, link);
 }
 
 void file_cache_dump(FileCacheData *fc)
 {
-	GList *work = fc->list;
+	GList *work = fc->queue.head;
 	gulong n = 0;
 
-	DEBUG_1("cache dump: fc=%p max size:%ld size:%ld", fc, fc->max_size, fc->size);
+	DEBUG_1("cache dump: fc=%p max size:%ld size:%ld entries:%u", fc, fc->max_size, fc->size, fc->queue.length);
+	DEBUG_1("cache stats: fc=%p hits:%lu misses:%lu evictions:%lu", fc, fc->hits, fc->misses, fc->evictions);
 
 	while (work)
 		{
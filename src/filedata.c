@@ -24,6 +24,7 @@
 
 #include "filefilter.h"
 #include "cache.h"
+#include "cache-metadb.h"
 #include "thumb_standard.h"
 #include "ui_fileops.h"
 #include "metadata.h"
@@ -32,9 +33,11 @@
 #include "secure_save.h"
 
 #include "exif.h"
+#include "exif-quick.h"
 #include "misc.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <grp.h>
 
 #ifdef DEBUG_FILEDATA
@@ -583,48 +586,231 @@ void read_rating_data(FileData *file)
 		}
 }
 
+/*
+ * Exif values of a whole list are taken from the metadata index first,
+ * then read with exif_quick_read_list(), only from the file headers.
+ * Files with xmp sidecars, unwritten metadata or a format it can not read
+ * are left to the exif_read_fd() path.
+ */
+
+/* the values in the metadata index */
+#define FILE_DATA_SORT_DATA (EXIF_QUICK_DATE | EXIF_QUICK_DATE_DIGITIZED | EXIF_QUICK_ORIENTATION | EXIF_QUICK_RATING)
+
+static gboolean file_data_exif_quick_usable(FileData *fd)
+{
+#ifdef HAVE_EXIV2
+	gchar *sidecar_path;
+#endif
+
+	/* already read, reading the values again is cheap */
+	if (fd->exif) return FALSE;
+
+	/* unwritten data overide the file */
+	if (fd->modified_xmp) return FALSE;
+
+#ifdef HAVE_EXIV2
+	/* see exif_read_fd(), xmp in sidecars is synced with the exif */
+	sidecar_path = file_data_get_sidecar_path(fd, TRUE);
+	if (!sidecar_path) sidecar_path = cache_find_location(CACHE_TYPE_XMP_METADATA, fd->path);
+	if (sidecar_path)
+		{
+		g_free(sidecar_path);
+		return FALSE;
+		}
+#endif
+
+	return TRUE;
+}
+
+/* sets the values from eq, returns FALSE when the file has to be read the usual way */
+static gboolean file_data_exif_quick_apply(FileData *fd, ExifQuickData *eq, ExifQuickFlags need)
+{
+	gboolean done = TRUE;
+
+	if (!eq->valid) return FALSE;
+
+	/* dates not in the exif may still be in embedded xmp */
+	if (need & EXIF_QUICK_DATE)
+		{
+		if (eq->found & EXIF_QUICK_DATE) fd->exifdate = eq->exifdate;
+		else if (eq->found & EXIF_QUICK_XMP) done = FALSE;
+		}
+	if (need & EXIF_QUICK_DATE_DIGITIZED)
+		{
+		if (eq->found & EXIF_QUICK_DATE_DIGITIZED) fd->exifdate_digitized = eq->exifdate_digitized;
+		else if (eq->found & EXIF_QUICK_XMP) done = FALSE;
+		}
+	if (need & EXIF_QUICK_ORIENTATION && !fd->exif_orientation)
+		{
+		if (eq->found & EXIF_QUICK_ORIENTATION) fd->exif_orientation = eq->orientation;
+		else if (eq->found & EXIF_QUICK_XMP) done = FALSE;
+		else fd->exif_orientation = EXIF_ORIENTATION_TOP_LEFT;
+		}
+	if (need & EXIF_QUICK_RATING)
+		{
+#ifdef HAVE_EXIV2
+		/* the rating is xmp, the exif one counts only without embedded xmp */
+		if (eq->found & EXIF_QUICK_XMP) done = FALSE;
+		else if (eq->found & EXIF_QUICK_RATING) fd->rating = eq->rating;
+#else
+		/* the exif parser does not read xmp at all */
+		done = FALSE;
+#endif
+		}
+
+	return done;
+}
+
+static gboolean file_data_exif_quick_needed(FileData *fd, ExifQuickFlags need)
+{
+	return ((need & EXIF_QUICK_DATE && fd->exifdate <= 0) ||
+		(need & EXIF_QUICK_DATE_DIGITIZED && fd->exifdate_digitized <= 0) ||
+		(need & EXIF_QUICK_ORIENTATION && !fd->exif_orientation) ||
+		(need & EXIF_QUICK_RATING && fd->rating == STAR_RATING_NOT_READ));
+}
+
+/* returns the files still to be read with exif_read_fd() */
+static GList *file_data_exif_quick_read(GList *files, ExifQuickFlags need)
+{
+	GList *slow = NULL;
+	GPtrArray *quick;
+	gchar **paths;
+	ExifQuickData *eq;
+	guint n;
+
+	quick = g_ptr_array_new();
+	while (files)
+		{
+		FileData *fd = files->data;
+
+		if (!file_data_exif_quick_needed(fd, need) ||
+		    (!fd->modified_xmp && cache_meta_db_load_sort_data(fd)))
+			{
+			/* already known */
+			}
+		else if (file_data_exif_quick_usable(fd))
+			{
+			g_ptr_array_add(quick, fd);
+			}
+		else
+			{
+			slow = g_list_prepend(slow, fd);
+			}
+		files = files->next;
+		}
+
+	if (quick->len == 0)
+		{
+		g_ptr_array_free(quick, TRUE);
+		return slow;
+		}
+
+	paths = g_new(gchar *, quick->len);
+	eq = g_new(ExifQuickData, quick->len);
+	for (n = 0; n < quick->len; n++)
+		{
+		paths[n] = ((FileData *)g_ptr_array_index(quick, n))->path;
+		}
+
+	exif_quick_read_list(paths, eq, quick->len);
+
+	for (n = 0; n < quick->len; n++)
+		{
+		FileData *fd = g_ptr_array_index(quick, n);
+
+		if (!file_data_exif_quick_apply(fd, &eq[n], need))
+			{
+			slow = g_list_prepend(slow, fd);
+			}
+		else if ((need & FILE_DATA_SORT_DATA) == FILE_DATA_SORT_DATA)
+			{
+			cache_meta_db_save_sort_data(fd);
+			}
+		}
+
+	DEBUG_1("%s exif quick read: %u files, %u left", get_exec_time(), quick->len, g_list_length(slow));
+
+	g_free(eq);
+	g_free(paths);
+	g_ptr_array_free(quick, TRUE);
+
+	return slow;
+}
+
+GList *read_exif_sort_data_quick(GList *files)
+{
+	return file_data_exif_quick_read(files, FILE_DATA_SORT_DATA);
+}
+
+void read_exif_sort_data(FileData *file)
+{
+	read_exif_time_data(file);
+	read_exif_time_digitized_data(file);
+	if (file->rating == STAR_RATING_NOT_READ) read_rating_data(file);
+	if (!file->exif_orientation)
+		{
+		file->exif_orientation = metadata_read_int(file, ORIENTATION_KEY, EXIF_ORIENTATION_TOP_LEFT);
+		}
+
+	/* unwritten data are not indexed */
+	if (!file->modified_xmp) cache_meta_db_save_sort_data(file);
+}
+
 void set_exif_time_data(GList *files)
 {
+	GList *slow;
+	GList *work;
+
 	DEBUG_1("%s set_exif_time_data: ...", get_exec_time());
 
-	while (files)
+	slow = file_data_exif_quick_read(files, EXIF_QUICK_DATE);
+	work = slow;
+	while (work)
 		{
-		FileData *file = files->data;
+		FileData *file = work->data;
 
 		read_exif_time_data(file);
-		files = files->next;
+		work = work->next;
 		}
+	g_list_free(slow);
 }
 
 void set_exif_time_digitized_data(GList *files)
 {
+	GList *slow;
+	GList *work;
+
 	DEBUG_1("%s set_exif_time_digitized_data: ...", get_exec_time());
 
-	while (files)
+	slow = file_data_exif_quick_read(files, EXIF_QUICK_DATE_DIGITIZED);
+	work = slow;
+	while (work)
 		{
-		FileData *file = files->data;
+		FileData *file = work->data;
 
 		read_exif_time_digitized_data(file);
-		files = files->next;
+		work = work->next;
 		}
+	g_list_free(slow);
 }
 
 void set_rating_data(GList *files)
 {
-	gchar *rating_str;
+	GList *slow;
+	GList *work;
+
 	DEBUG_1("%s set_rating_data: ...", get_exec_time());
 
-	while (files)
+	slow = file_data_exif_quick_read(files, EXIF_QUICK_RATING);
+	work = slow;
+	while (work)
 		{
-		FileData *file = files->data;
-		rating_str = metadata_read_string(file, RATING_KEY, METADATA_PLAIN);
-		if (rating_str )
-			{
-			file->rating = atoi(rating_str);
-			g_free(rating_str);
-			}
-		files = files->next;
+		FileData *file = work->data;
+
+		read_rating_data(file);
+		work = work->next;
 		}
+	g_list_free(slow);
 }
 
 FileData *file_data_new_no_grouping(const gchar *path_utf8)
@@ -1339,6 +1525,94 @@ static gboolean is_hidden_file(const gchar *name)
  *-----------------------------------------------------------------------------
  */
 
+#define FILELIST_READ_THREAD_MIN 256	/* entries, below this they are stat'ed in place */
+#define FILELIST_READ_THREAD_MAX 16	/* stat is waiting on the disk or network, not the cpu */
+
+typedef struct _FileListReadEntry FileListReadEntry;
+struct _FileListReadEntry
+{
+	gchar *name;
+	struct stat st;
+	gint error;		/* errno of the stat, 0 on success */
+};
+
+typedef struct _FileListReadJob FileListReadJob;
+struct _FileListReadJob
+{
+	gint dir_fd;
+	gint stat_flags;
+	FileListReadEntry *entries;
+	guint count;
+	guint threads;
+};
+
+static void filelist_read_stat(FileListReadJob *job, guint n)
+{
+	FileListReadEntry *entry = &job->entries[n];
+
+	entry->error = (fstatat(job->dir_fd, entry->name, &entry->st, job->stat_flags) < 0) ? errno : 0;
+}
+
+#ifdef HAVE_GTHREAD
+static void filelist_read_stat_thread(gpointer data, gpointer user_data)
+{
+	FileListReadJob *job = user_data;
+	guint n;
+
+	/* each thread takes every threads-th entry, no locking needed */
+	for (n = GPOINTER_TO_UINT(data) - 1; n < job->count; n += job->threads)
+		{
+		filelist_read_stat(job, n);
+		}
+}
+#endif
+
+static void filelist_read_stat_all(FileListReadJob *job)
+{
+	guint n;
+
+#ifdef HAVE_GTHREAD
+	if (job->count >= FILELIST_READ_THREAD_MIN)
+		{
+		GThreadPool *pool;
+
+		job->threads = MIN(job->count / (FILELIST_READ_THREAD_MIN / 4), FILELIST_READ_THREAD_MAX);
+		pool = g_thread_pool_new(filelist_read_stat_thread, job, job->threads, TRUE, NULL);
+		if (pool)
+			{
+			for (n = 1; n <= job->threads; n++)
+				{
+				g_thread_pool_push(pool, GUINT_TO_POINTER(n), NULL);
+				}
+			/* waits for all of them */
+			g_thread_pool_free(pool, FALSE, TRUE);
+			return;
+			}
+		}
+#endif
+
+	for (n = 0; n < job->count; n++)
+		{
+		filelist_read_stat(job, n);
+		}
+}
+
+static gboolean filelist_read_skip_dir(const gchar *name)
+{
+	/* we ignore the .thumbnails dir for cleanliness */
+	return ((name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) ||
+		strcmp(name, GQ_CACHE_LOCAL_THUMB) == 0 ||
+		strcmp(name, GQ_CACHE_LOCAL_METADATA) == 0 ||
+		strcmp(name, THUMB_FOLDER_LOCAL) == 0);
+}
+
+/*
+ * The directory is read first, entries that can not be used are dropped
+ * by name and by d_type where the filesystem provides it. The rest is
+ * stat'ed relative to the directory, on several threads for big ones.
+ * The list is then built in directory order, the sidecar grouping does
+ * not depend on which stat finished first.
+ */
 static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList **dirs, gboolean follow_symlinks)
 {
 	DIR *dp;
@@ -1347,8 +1621,10 @@ static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList *
 	GList *dlist = NULL;
 	GList *flist = NULL;
 	GList *xmp_files = NULL;
-	gint (*stat_func)(const gchar *path, struct stat *buf);
 	GHashTable *basename_hash = NULL;
+	GArray *entries;
+	FileListReadJob job;
+	guint n;
 
 	g_assert(files || dirs);
 
@@ -1367,40 +1643,62 @@ static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList *
 
 	if (files) basename_hash = file_data_basename_hash_new();
 
-	if (follow_symlinks)
-		stat_func = stat;
-	else
-		stat_func = lstat;
+	entries = g_array_new(FALSE, FALSE, sizeof(FileListReadEntry));
 
 	while ((dir = readdir(dp)) != NULL)
 		{
-		struct stat ent_sbuf;
+		FileListReadEntry entry;
 		const gchar *name = dir->d_name;
-		gchar *filepath;
+		gboolean want_dir;
+		gboolean want_file;
 
 		if (!options->file_filter.show_hidden_files && is_hidden_file(name))
 			continue;
 
+		want_dir = (dirs && !filelist_read_skip_dir(name));
+		want_file = (files && filter_name_exists(name));
+		if (!want_dir && !want_file) continue;
+
+#ifdef DT_UNKNOWN
+		/* the type is known without a stat, symlinks still need one when followed */
+		if (dir->d_type == DT_DIR && !want_dir) continue;
+		if (dir->d_type == DT_REG && !want_file) continue;
+		if (dir->d_type == DT_LNK && !follow_symlinks && !want_file) continue;
+#endif
+
+		entry.name = g_strdup(name);
+		entry.error = 0;
+		g_array_append_val(entries, entry);
+		}
+
+	job.dir_fd = dirfd(dp);
+	job.stat_flags = follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+	job.entries = (FileListReadEntry *)entries->data;
+	job.count = entries->len;
+	job.threads = 1;
+	filelist_read_stat_all(&job);
+
+	for (n = 0; n < job.count; n++)
+		{
+		FileListReadEntry *entry = &job.entries[n];
+		const gchar *name = entry->name;
+		gchar *filepath;
+
 		filepath = g_build_filename(pathl, name, NULL);
-		if (stat_func(filepath, &ent_sbuf) >= 0)
+		if (entry->error == 0)
 			{
-			if (S_ISDIR(ent_sbuf.st_mode))
+			if (S_ISDIR(entry->st.st_mode))
 				{
-				/* we ignore the .thumbnails dir for cleanliness */
-				if (dirs &&
-				    !(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) &&
-				    strcmp(name, GQ_CACHE_LOCAL_THUMB) != 0 &&
-				    strcmp(name, GQ_CACHE_LOCAL_METADATA) != 0 &&
-				    strcmp(name, THUMB_FOLDER_LOCAL) != 0)
+				if (dirs && !filelist_read_skip_dir(name))
 					{
-					dlist = g_list_prepend(dlist, file_data_new_local(filepath, &ent_sbuf, TRUE));
+					dlist = g_list_prepend(dlist, file_data_new_local(filepath, &entry->st, TRUE));
 					}
 				}
 			else
 				{
 				if (files && filter_name_exists(name))
 					{
-					FileData *fd = file_data_new_local(filepath, &ent_sbuf, FALSE);
+					FileData *fd = file_data_new_local(filepath, &entry->st, FALSE);
 					flist = g_list_prepend(flist, fd);
 					if (fd->sidecar_priority && !fd->disable_grouping)
 						{
@@ -1414,14 +1712,16 @@ static gboolean filelist_read_real(const gchar *dir_path, GList **files, GList *
 			}
 		else
 			{
-			if (errno == EOVERFLOW)
+			if (entry->error == EOVERFLOW)
 				{
 				log_printf("stat(): EOVERFLOW, skip '%s'", filepath);
 				}
 			}
 		g_free(filepath);
+		g_free(entry->name);
 		}
 
+	g_array_free(entries, TRUE);
 	closedir(dp);
 
 	g_free(pathl);
@@ -168,6 +168,13 @@ gboolean file_data_unregister_real_time_monitor(FileData *fd);
 void read_exif_time_data(FileData *file);
 void read_exif_time_digitized_data(FileData *file);
 
+/* sets the exif dates, rating and exif orientation from the metadata index
+ * or the file headers where that is possible, returns the files left to
+ * read_exif_sort_data(), which reads them the usual way and indexes them
+ */
+GList *read_exif_sort_data_quick(GList *files);
+void read_exif_sort_data(FileData *file);
+
 gboolean marks_list_save(gchar *path, gboolean clear);
 gboolean marks_list_load(const gchar *path);
 void marks_clear_all();
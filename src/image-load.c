@@ -31,6 +31,7 @@
 
 #include "exif.h"
 #include "filedata.h"
+#include "misc.h"
 #include "ui_fileops.h"
 #include "gq-marshal.h"
 
@@ -60,6 +61,9 @@ static void image_loader_init(GTypeInstance *instance, gpointer g_class);
 static void image_loader_class_init(ImageLoaderClass *class);
 static void image_loader_finalize(GObject *object);
 static void image_loader_stop(ImageLoader *il);
+#ifdef HAVE_GTHREAD
+static gboolean image_loader_thread_cancel(ImageLoader *il);
+#endif
 
 GType image_loader_get_type(void)
 {
@@ -106,10 +110,15 @@ static void image_loader_init(GTypeInstance *instance, gpointer g_class)
 	il->requested_height = 0;
 	il->actual_width = 0;
 	il->actual_height = 0;
+	il->image_width = 0;
+	il->image_height = 0;
 	il->shrunk = FALSE;
 
 	il->can_destroy = TRUE;
 
+	il->queue_priority = IMAGE_LOADER_PRIORITY_CURRENT;
+	il->queued = FALSE;
+
 #ifdef HAVE_GTHREAD
 #if GLIB_CHECK_VERSION(2,32,0)
 	il->data_mutex = g_new(GMutex, 1);
@@ -535,6 +544,8 @@ static void image_loader_size_cb(gpointer loader,
 	g_mutex_lock(il->data_mutex);
 	il->actual_width = width;
 	il->actual_height = height;
+	il->image_width = width;
+	il->image_height = height;
 	if (il->requested_width < 1 || il->requested_height < 1)
 		{
 		g_mutex_unlock(il->data_mutex);
@@ -552,6 +563,7 @@ static void image_loader_size_cb(gpointer loader,
 	while (mime_types[n] && !scale)
 		{
 		if (strstr(mime_types[n], "jpeg")) scale = TRUE;
+		if (strstr(mime_types[n], "tiff")) scale = TRUE;
 		n++;
 		}
 	g_strfreev(mime_types);
@@ -874,6 +886,13 @@ static void image_loader_stop(ImageLoader *il)
 
 	if (il->thread)
 		{
+#ifdef HAVE_GTHREAD
+		if (image_loader_thread_cancel(il))
+			{
+			/* still queued, it never ran */
+			il->can_destroy = TRUE;
+			}
+#endif
 		/* stop loader in the other thread */
 		g_mutex_lock(il->data_mutex);
 		il->stopping = TRUE;
@@ -960,25 +979,61 @@ static gboolean image_loader_start_idle(ImageLoader *il)
 /* execution via thread */
 
 #ifdef HAVE_GTHREAD
+/*
+ * Loaders wait in one queue per ImageLoaderPriority and only one per cpu
+ * core runs at a time. The current image and read-ahead may take one more
+ * thread, so they never wait behind thumbnails, and running low priority
+ * loaders pause while they decode.
+ */
 static GThreadPool *image_loader_thread_pool = NULL;
 
 static GCond *image_loader_prio_cond = NULL;
 static GMutex *image_loader_prio_mutex = NULL;
-static gint image_loader_prio_num = 0;
+static gint image_loader_prio_num = 0;		/* running high priority loaders */
 
+static GQueue image_loader_queue[IMAGE_LOADER_PRIORITY_COUNT];
+static gint image_loader_running = 0;
+static gint image_loader_workers = 0;
 
-static void image_loader_thread_enter_high(void)
+
+static gboolean image_loader_priority_is_high(ImageLoaderPriority priority)
 {
-	g_mutex_lock(image_loader_prio_mutex);
-	image_loader_prio_num++;
-	g_mutex_unlock(image_loader_prio_mutex);
+	return (priority < IMAGE_LOADER_PRIORITY_THUMB);
+}
+
+/* hands queued loaders to the pool while there are free threads,
+ * image_loader_prio_mutex must be locked */
+static void image_loader_thread_dispatch(void)
+{
+	gint i;
+
+	for (i = 0; i < IMAGE_LOADER_PRIORITY_COUNT; i++)
+		{
+		gint limit = image_loader_workers + (image_loader_priority_is_high(i) ? 1 : 0);
+
+		while (image_loader_running < limit && !g_queue_is_empty(&image_loader_queue[i]))
+			{
+			ImageLoader *il = g_queue_pop_head(&image_loader_queue[i]);
+
+			il->queued = FALSE;
+			image_loader_running++;
+			if (image_loader_priority_is_high(il->queue_priority)) image_loader_prio_num++;
+
+			g_thread_pool_push(image_loader_thread_pool, il, NULL);
+			}
+		}
 }
 
-static void image_loader_thread_leave_high(void)
+static void image_loader_thread_finish(ImageLoaderPriority priority)
 {
 	g_mutex_lock(image_loader_prio_mutex);
-	image_loader_prio_num--;
-	if (image_loader_prio_num == 0) g_cond_broadcast(image_loader_prio_cond); /* wake up all low prio threads */
+	image_loader_running--;
+	if (image_loader_priority_is_high(priority))
+		{
+		image_loader_prio_num--;
+		if (image_loader_prio_num == 0) g_cond_broadcast(image_loader_prio_cond); /* wake up all low prio threads */
+		}
+	image_loader_thread_dispatch();
 	g_mutex_unlock(image_loader_prio_mutex);
 }
 
@@ -993,41 +1048,60 @@ static void image_loader_thread_wait_high(void)
 	g_mutex_unlock(image_loader_prio_mutex);
 }
 
+/* takes a loader out of its queue, FALSE if it was already handed to a thread */
+static gboolean image_loader_thread_cancel(ImageLoader *il)
+{
+	gboolean ret = FALSE;
+
+	if (!image_loader_prio_mutex) return FALSE;
+
+	g_mutex_lock(image_loader_prio_mutex);
+	if (il->queued)
+		{
+		g_queue_remove(&image_loader_queue[il->queue_priority], il);
+		il->queued = FALSE;
+		ret = TRUE;
+		}
+	g_mutex_unlock(image_loader_prio_mutex);
+
+	return ret;
+}
+
 
 static void image_loader_thread_run(gpointer data, gpointer user_data)
 {
 	ImageLoader *il = data;
-	gboolean cont;
+	ImageLoaderPriority priority = il->queue_priority;
+	gboolean cont = FALSE;
 	gboolean err;
 
-	if (il->idle_priority > G_PRIORITY_DEFAULT_IDLE)
+	if (!image_loader_priority_is_high(priority))
 		{
 		/* low prio, wait untill high prio tasks finishes */
 		image_loader_thread_wait_high();
 		}
-	else
+
+	/* it may have been stopped while waiting for a thread */
+	if (!image_loader_get_stopping(il))
 		{
-		/* high prio */
-		image_loader_thread_enter_high();
-		}
+		err = !image_loader_begin(il);
 
-	err = !image_loader_begin(il);
+		if (err)
+			{
+			/*
+			loader failed, we have to send signal
+			(idle mode returns the image_loader_begin return value directly)
+			(success is always reported indirectly from image_loader_begin)
+			*/
+			image_loader_emit_error(il);
+			}
 
-	if (err)
-		{
-		/*
-		loader failed, we have to send signal
-		(idle mode returns the image_loader_begin return value directly)
-		(success is always reported indirectly from image_loader_begin)
-		*/
-		image_loader_emit_error(il);
+		cont = !err;
 		}
 
-	cont = !err;
-
 	while (cont && !image_loader_get_is_done(il) && !image_loader_get_stopping(il))
 		{
-		if (il->idle_priority > G_PRIORITY_DEFAULT_IDLE)
+		if (!image_loader_priority_is_high(priority))
 			{
 			/* low prio, wait untill high prio tasks finishes */
 			image_loader_thread_wait_high();
@@ -1036,11 +1110,7 @@ static void image_loader_thread_run(gpointer data, gpointer user_data)
 		}
 	image_loader_stop_loader(il);
 
-	if (il->idle_priority <= G_PRIORITY_DEFAULT_IDLE)
-		{
-		/* high prio */
-		image_loader_thread_leave_high();
-		}
+	image_loader_thread_finish(priority);
 
 	g_mutex_lock(il->data_mutex);
 	il->can_destroy = TRUE;
@@ -1062,7 +1132,8 @@ static gboolean image_loader_start_thread(ImageLoader *il)
 
         if (!image_loader_thread_pool)
 		{
-		image_loader_thread_pool = g_thread_pool_new(image_loader_thread_run, NULL, -1, FALSE, NULL);
+		image_loader_workers = get_cpu_cores();
+		image_loader_thread_pool = g_thread_pool_new(image_loader_thread_run, NULL, image_loader_workers + 1, FALSE, NULL);
 #if GLIB_CHECK_VERSION(2,32,0)
 		if (!image_loader_prio_cond) image_loader_prio_cond = g_new(GCond, 1);
 		g_cond_init(image_loader_prio_cond);
@@ -1076,8 +1147,12 @@ static gboolean image_loader_start_thread(ImageLoader *il)
 
 	il->can_destroy = FALSE; /* ImageLoader can't be freed until image_loader_thread_run finishes */
 
-	g_thread_pool_push(image_loader_thread_pool, il, NULL);
-	DEBUG_1("Thread pool num threads: %d", g_thread_pool_get_num_threads(image_loader_thread_pool));
+	g_mutex_lock(image_loader_prio_mutex);
+	il->queued = TRUE;
+	g_queue_push_tail(&image_loader_queue[il->queue_priority], il);
+	image_loader_thread_dispatch();
+	DEBUG_1("Thread pool running: %d, queued: %u", image_loader_running, g_queue_get_length(&image_loader_queue[il->queue_priority]));
+	g_mutex_unlock(image_loader_prio_mutex);
 
 	return TRUE;
 }
@@ -1139,6 +1214,31 @@ void image_loader_set_priority(ImageLoader *il, gint priority)
 
 	if (il->thread) return; /* can't change prio if the thread already runs */
 	il->idle_priority = priority;
+	il->queue_priority = (priority > G_PRIORITY_DEFAULT_IDLE) ? IMAGE_LOADER_PRIORITY_THUMB : IMAGE_LOADER_PRIORITY_CURRENT;
+}
+
+void image_loader_set_queue_priority(ImageLoader *il, ImageLoaderPriority priority)
+{
+	if (!il) return;
+
+#ifdef HAVE_GTHREAD
+	if (il->thread && image_loader_prio_mutex)
+		{
+		/* a running loader keeps its priority */
+		g_mutex_lock(image_loader_prio_mutex);
+		if (il->queued && il->queue_priority != priority)
+			{
+			g_queue_remove(&image_loader_queue[il->queue_priority], il);
+			il->queue_priority = priority;
+			g_queue_push_tail(&image_loader_queue[priority], il);
+			image_loader_thread_dispatch();
+			}
+		g_mutex_unlock(image_loader_prio_mutex);
+		return;
+		}
+#endif
+
+	il->queue_priority = priority;
 }
 
 
@@ -1195,6 +1295,24 @@ gboolean image_loader_get_shrunk(ImageLoader *il)
 	return ret;
 }
 
+gboolean image_loader_get_image_size(ImageLoader *il, gint *width, gint *height)
+{
+	gboolean ret;
+	if (!il) return FALSE;
+
+	g_mutex_lock(il->data_mutex);
+	/* a preview picked for the requested size says nothing about the image */
+	ret = (il->image_width > 0 && il->image_height > 0 &&
+	       !(il->preview && il->requested_width > 0));
+	if (ret)
+		{
+		if (width) *width = il->image_width;
+		if (height) *height = il->image_height;
+		}
+	g_mutex_unlock(il->data_mutex);
+	return ret;
+}
+
 const gchar *image_loader_get_error(ImageLoader *il)
 {
 	const gchar *ret = NULL;
@@ -55,6 +55,15 @@ struct _ImageLoaderBackend
 };
 
 
+/* order in which threaded loaders get a decoding thread */
+typedef enum {
+	IMAGE_LOADER_PRIORITY_CURRENT,		/* the image shown */
+	IMAGE_LOADER_PRIORITY_READ_AHEAD,	/* images shown next */
+	IMAGE_LOADER_PRIORITY_THUMB,		/* thumbnails */
+	IMAGE_LOADER_PRIORITY_BACKGROUND,	/* cache, search and duplicates data */
+	IMAGE_LOADER_PRIORITY_COUNT
+} ImageLoaderPriority;
+
 //typedef struct _ImageLoader ImageLoader;
 typedef struct _ImageLoaderClass ImageLoaderClass;
 
@@ -78,6 +87,9 @@ struct _ImageLoader
 	gint actual_width;
 	gint actual_height;
 
+	gint image_width;		/* size reported by the backend, before shrinking */
+	gint image_height;
+
 	gboolean shrunk;
 
 	gboolean done;
@@ -100,6 +112,9 @@ struct _ImageLoader
 	GCond *can_destroy_cond;
 	gboolean thread;
 
+	ImageLoaderPriority queue_priority;
+	gboolean queued;	/* waiting for a thread, protected by the scheduler lock */
+
 	guchar *mapped_file;
 	gsize read_buffer_size;
 	guint idle_read_loop_count;
@@ -125,7 +140,7 @@ void image_loader_free(ImageLoader *il);
 void image_loader_delay_area_ready(ImageLoader *il, gboolean enable);
 
 /* Speed up loading when you only need at most width x height size image,
- * only the jpeg GdkPixbuf loader benefits from it - so there is no
+ * only the jpeg and tiff loaders benefit from it - so there is no
  * guarantee that the image will scale down to the requested size..
  */
 void image_loader_set_requested_size(ImageLoader *il, gint width, gint height);
@@ -137,6 +152,13 @@ void image_loader_set_buffer_size(ImageLoader *il, guint size);
  */
 void image_loader_set_priority(ImageLoader *il, gint priority);
 
+/* the thread scheduling priority, default is IMAGE_LOADER_PRIORITY_CURRENT
+ * or IMAGE_LOADER_PRIORITY_THUMB after image_loader_set_priority() with
+ * a priority lower than G_PRIORITY_DEFAULT_IDLE.
+ * A loader still waiting for a thread is moved to the new queue.
+ */
+void image_loader_set_queue_priority(ImageLoader *il, ImageLoaderPriority priority);
+
 gboolean image_loader_start(ImageLoader *il);
 
 
@@ -145,6 +167,8 @@ gdouble image_loader_get_percent(ImageLoader *il);
 gboolean image_loader_get_is_done(ImageLoader *il);
 FileData *image_loader_get_fd(ImageLoader *il);
 gboolean image_loader_get_shrunk(ImageLoader *il);
+/* dimensions of the loaded image before shrinking, FALSE if unknown */
+gboolean image_loader_get_image_size(ImageLoader *il, gint *width, gint *height);
 const gchar *image_loader_get_error(ImageLoader *il);
 
 gboolean image_load_dimensions(FileData *fd, gint *width, gint *height);
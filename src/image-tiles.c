@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "main.h"
+#include "image-tiles.h"
+
+#include "image_load_tiff.h"
+#include "ui_fileops.h"
+
+#include <stdio.h>
+
+/* size of the source tiles, in pixels of the tile */
+#define IMAGE_TILES_SIZE 512
+/* source tiles kept besides the visible ones */
+#define IMAGE_TILES_CACHE_SIZE 32
+
+struct _ImageTiles
+{
+	gint ref;
+
+	gint width;
+	gint height;
+
+#ifdef HAVE_TIFF
+	ImageLoaderTiffRegion *tiff;
+#endif
+};
+
+/* reads the first bytes of the file, to try only the backends that can read it */
+static gboolean image_tiles_read_magic(const gchar *path, guchar *buf, gsize len)
+{
+	gchar *pathl;
+	FILE *f;
+	gboolean ret;
+
+	pathl = path_from_utf8(path);
+	f = fopen(pathl, "rb");
+	g_free(pathl);
+	if (!f) return FALSE;
+
+	ret = (fread(buf, 1, len, f) == len);
+	fclose(f);
+
+	return ret;
+}
+
+ImageTiles *image_tiles_new(FileData *fd)
+{
+	ImageTiles *tiles;
+	guchar magic[4];
+
+	if (!fd || !image_tiles_read_magic(fd->path, magic, sizeof(magic))) return NULL;
+
+	tiles = g_new0(ImageTiles, 1);
+	tiles->ref = 1;
+
+#ifdef HAVE_TIFF
+	if ((magic[0] == 'I' && magic[1] == 'I' && magic[2] == 42 && magic[3] == 0) ||
+	    (magic[0] == 'M' && magic[1] == 'M' && magic[2] == 0 && magic[3] == 42))
+		{
+		tiles->tiff = image_loader_tiff_region_new(fd->path);
+		if (tiles->tiff)
+			{
+			image_loader_tiff_region_get_size(tiles->tiff, &tiles->width, &tiles->height);
+			return tiles;
+			}
+		}
+#endif
+
+	g_free(tiles);
+	return NULL;
+}
+
+ImageTiles *image_tiles_ref(ImageTiles *tiles)
+{
+	if (tiles) tiles->ref++;
+	return tiles;
+}
+
+void image_tiles_unref(ImageTiles *tiles)
+{
+	if (!tiles) return;
+
+	tiles->ref--;
+	if (tiles->ref > 0) return;
+
+#ifdef HAVE_TIFF
+	image_loader_tiff_region_free(tiles->tiff);
+#endif
+	g_free(tiles);
+}
+
+void image_tiles_get_size(ImageTiles *tiles, gint *width, gint *height)
+{
+	if (width) *width = tiles->width;
+	if (height) *height = tiles->height;
+}
+
+static gint image_tiles_request_cb(PixbufRenderer *pr, gint x, gint y,
+				   gint width, gint height, GdkPixbuf *pixbuf, gpointer data)
+{
+#ifdef HAVE_TIFF
+	ImageTiles *tiles = data;
+
+	if (tiles->tiff) return image_loader_tiff_region_read(tiles->tiff, x, y, width, height, pixbuf);
+#endif
+
+	return FALSE;
+}
+
+void image_tiles_set_renderer(ImageTiles *tiles, PixbufRenderer *pr, gdouble zoom)
+{
+	pixbuf_renderer_set_tiles_reduced(pr, TRUE);
+	pixbuf_renderer_set_tiles(pr, tiles->width, tiles->height,
+				  IMAGE_TILES_SIZE, IMAGE_TILES_SIZE, IMAGE_TILES_CACHE_SIZE,
+				  image_tiles_request_cb, NULL, tiles, zoom);
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef IMAGE_TILES_H
+#define IMAGE_TILES_H
+
+#include "pixbuf-renderer.h"
+
+/*
+ * Shows an image file in a PixbufRenderer as source tiles, decoded from
+ * the file region by region when they come into view, instead of loading
+ * all of it. Only for the formats that can be read that way.
+ */
+
+typedef struct _ImageTiles ImageTiles;
+
+/* returns NULL when fd can not be read in regions */
+ImageTiles *image_tiles_new(FileData *fd);
+ImageTiles *image_tiles_ref(ImageTiles *tiles);
+void image_tiles_unref(ImageTiles *tiles);
+
+void image_tiles_get_size(ImageTiles *tiles, gint *width, gint *height);
+
+/* makes pr request its tiles from tiles, which must be kept until pr shows something else */
+void image_tiles_set_renderer(ImageTiles *tiles, PixbufRenderer *pr, gdouble zoom);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -31,8 +31,10 @@
 #include "histogram.h"
 #include "image-load.h"
 #include "image-overlay.h"
+#include "image-tiles.h"
 #include "layout.h"
 #include "layout_image.h"
+#include "pixbuf-cache.h"
 #include "pixbuf-renderer.h"
 #include "pixbuf_util.h"
 #include "ui_fileops.h"
@@ -46,6 +48,7 @@ static GList *image_list = NULL;
 
 static void image_update_title(ImageWindow *imd);
 static void image_read_ahead_start(ImageWindow *imd);
+static ImageLoader *image_read_ahead_window_take(ImageWindow *imd, FileData *fd);
 static void image_cache_set(ImageWindow *imd, FileData *fd);
 
 // For draw rectangle function
@@ -676,6 +679,42 @@ gboolean image_get_desaturate(ImageWindow *imd)
  *-------------------------------------------------------------------
  */
 
+/* the tiles of fd if it is above the configured size, to be shown in tiles;
+ * those are never decoded whole, so not read ahead either
+ */
+static ImageTiles *image_tiles_for_file(FileData *fd)
+{
+	ImageTiles *tiles;
+	gint width;
+	gint height;
+
+	if (options->image.tiled_view_min_size <= 0) return NULL;
+	if (fd->user_orientation && fd->user_orientation != EXIF_ORIENTATION_TOP_LEFT) return NULL;
+
+	tiles = image_tiles_new(fd);
+	if (!tiles) return NULL;
+
+	image_tiles_get_size(tiles, &width, &height);
+	if ((gint64)width * height < (gint64)options->image.tiled_view_min_size * 1000000)
+		{
+		image_tiles_unref(tiles);
+		return NULL;
+		}
+
+	return tiles;
+}
+
+static gboolean image_read_ahead_tiled(FileData *fd)
+{
+	ImageTiles *tiles = image_tiles_for_file(fd);
+
+	if (!tiles) return FALSE;
+
+	DEBUG_1("no read ahead, shown in tiles: %s", fd->path);
+	image_tiles_unref(tiles);
+	return TRUE;
+}
+
 static void image_read_ahead_cancel(ImageWindow *imd)
 {
 	DEBUG_1("%s read ahead cancelled for :%s", get_exec_time(), imd->read_ahead_fd ? imd->read_ahead_fd->path : "null");
@@ -724,9 +763,12 @@ static void image_read_ahead_start(ImageWindow *imd)
 	/* still loading ?, do later */
 	if (imd->il /*|| imd->cm*/) return;
 
+	if (image_read_ahead_tiled(imd->read_ahead_fd)) return;
+
 	DEBUG_1("%s read ahead started for :%s", get_exec_time(), imd->read_ahead_fd->path);
 
 	imd->read_ahead_il = image_loader_new(imd->read_ahead_fd);
+	image_loader_set_queue_priority(imd->read_ahead_il, IMAGE_LOADER_PRIORITY_READ_AHEAD);
 
 	image_loader_delay_area_ready(imd->read_ahead_il, TRUE); /* we will need the area_ready signals later */
 
@@ -750,6 +792,15 @@ static void image_read_ahead_set(ImageWindow *imd, FileData *fd)
 
 	DEBUG_1("read ahead set to :%s", imd->read_ahead_fd->path);
 
+	/* it may be loading already as part of the window */
+	imd->read_ahead_il = image_read_ahead_window_take(imd, fd);
+	if (imd->read_ahead_il)
+		{
+		g_signal_connect(G_OBJECT(imd->read_ahead_il), "error", (GCallback)image_read_ahead_error_cb, imd);
+		g_signal_connect(G_OBJECT(imd->read_ahead_il), "done", (GCallback)image_read_ahead_done_cb, imd);
+		return;
+		}
+
 	image_read_ahead_start(imd);
 }
 
@@ -759,20 +810,55 @@ static void image_read_ahead_set(ImageWindow *imd, FileData *fd)
  *-------------------------------------------------------------------
  */
 
+#define IMAGE_CACHE_PRESSURE_INTERVAL 5 /* seconds between checks of the memory pressure */
+
+static FileCacheData *image_get_cache(void);
+
+/* the images evicted from the decoded cache, compressed */
+static PixbufCache *image_get_compressed_cache(void)
+{
+	static PixbufCache *cache = NULL;
+	if (!cache) cache = pixbuf_cache_new(0);
+	return cache;
+}
+
 static void image_cache_release_cb(FileData *fd)
 {
+	pixbuf_cache_put(image_get_compressed_cache(), fd, fd->pixbuf);
 	g_object_unref(fd->pixbuf);
 	fd->pixbuf = NULL;
 }
 
+static gboolean image_cache_pressure_cb(gpointer data)
+{
+	image_get_cache(); /* shrinks the caches to the current limits */
+	return TRUE;
+}
+
 static FileCacheData *image_get_cache(void)
 {
 	static FileCacheData *cache = NULL;
-	if (!cache) cache = file_cache_new(image_cache_release_cb, 1);
-	file_cache_set_max_size(cache, (gulong)options->image.image_cache_max * 1048576); /* update from options */
+	gulong percent = pixbuf_cache_memory_percent();
+
+	if (!cache)
+		{
+		cache = file_cache_new(image_cache_release_cb, 1);
+		g_timeout_add_seconds(IMAGE_CACHE_PRESSURE_INTERVAL, image_cache_pressure_cb, NULL);
+		}
+
+	/* update from options, less under memory pressure */
+	pixbuf_cache_set_max_size(image_get_compressed_cache(),
+				  (gulong)options->image.image_cache_compressed_max * 1048576 / 100 * percent);
+	file_cache_set_max_size(cache, (gulong)options->image.image_cache_max * 1048576 / 100 * percent);
 	return cache;
 }
 
+/* decoded or compressed in the cache, it does not need to be loaded */
+static gboolean image_cache_has(FileData *fd)
+{
+	return file_cache_get(image_get_cache(), fd) || pixbuf_cache_has(image_get_compressed_cache(), fd);
+}
+
 static void image_cache_set(ImageWindow *imd, FileData *fd)
 {
 	g_assert(fd->pixbuf);
@@ -786,6 +872,16 @@ static gint image_cache_get(ImageWindow *imd)
 	gint success;
 
 	success = file_cache_get(image_get_cache(), imd->image_fd);
+	if (!success && !imd->image_fd->pixbuf)
+		{
+		GdkPixbuf *pixbuf = pixbuf_cache_get(image_get_compressed_cache(), imd->image_fd);
+		if (pixbuf)
+			{
+			imd->image_fd->pixbuf = pixbuf;
+			image_cache_set(imd, imd->image_fd);
+			success = TRUE;
+			}
+		}
 	if (success)
 		{
 		g_assert(imd->image_fd->pixbuf);
@@ -796,6 +892,216 @@ static gint image_cache_get(ImageWindow *imd)
 	return success;
 }
 
+/*
+ *-------------------------------------------------------------------
+ * read ahead window, more images loaded into the cache
+ *-------------------------------------------------------------------
+ */
+
+#define IMAGE_READ_AHEAD_WINDOW_MIN 1	/* images of the window while no size is known */
+
+typedef struct _ImageReadAhead ImageReadAhead;
+struct _ImageReadAhead
+{
+	ImageWindow *imd;
+	FileData *fd;
+	ImageLoader *il;	/* NULL until started */
+};
+
+static void image_read_ahead_window_free(ImageReadAhead *ra)
+{
+	image_loader_free(ra->il);
+	file_data_unref(ra->fd);
+	g_free(ra);
+}
+
+static GList *image_read_ahead_window_find(GList *list, FileData *fd)
+{
+	GList *work;
+
+	for (work = list; work; work = work->next)
+		{
+		ImageReadAhead *ra = work->data;
+
+		if (ra->fd == fd) return work;
+		}
+
+	return NULL;
+}
+
+static void image_read_ahead_window_done_cb(ImageLoader *il, gpointer data)
+{
+	ImageReadAhead *ra = data;
+	ImageWindow *imd = ra->imd;
+
+	DEBUG_1("%s read ahead window done for :%s", get_exec_time(), ra->fd->path);
+
+	if (!ra->fd->pixbuf)
+		{
+		ra->fd->pixbuf = image_loader_get_pixbuf(ra->il);
+		if (ra->fd->pixbuf)
+			{
+			g_object_ref(ra->fd->pixbuf);
+			image_cache_set(imd, ra->fd);
+			}
+		}
+
+	if (ra->fd->pixbuf)
+		{
+		imd->read_ahead_size = (gulong)gdk_pixbuf_get_rowstride(ra->fd->pixbuf) *
+				       (gulong)gdk_pixbuf_get_height(ra->fd->pixbuf);
+		}
+
+	imd->read_ahead_window = g_list_remove(imd->read_ahead_window, ra);
+	image_read_ahead_window_free(ra);
+}
+
+static void image_read_ahead_window_error_cb(ImageLoader *il, gpointer data)
+{
+	/* we even treat errors as success, maybe at least some of the file was ok */
+	image_read_ahead_window_done_cb(il, data);
+}
+
+static void image_read_ahead_window_start(ImageWindow *imd)
+{
+	GList *work;
+
+	/* still loading ?, do later */
+	if (imd->il) return;
+
+	work = imd->read_ahead_window;
+	while (work)
+		{
+		ImageReadAhead *ra = work->data;
+		work = work->next;
+
+		if (ra->il) continue;
+
+		if (image_read_ahead_tiled(ra->fd))
+			{
+			imd->read_ahead_window = g_list_remove(imd->read_ahead_window, ra);
+			image_read_ahead_window_free(ra);
+			continue;
+			}
+
+		DEBUG_1("%s read ahead window started for :%s", get_exec_time(), ra->fd->path);
+
+		ra->il = image_loader_new(ra->fd);
+		image_loader_set_queue_priority(ra->il, IMAGE_LOADER_PRIORITY_READ_AHEAD);
+
+		image_loader_delay_area_ready(ra->il, TRUE); /* in case it is shown before it is done */
+
+		g_signal_connect(G_OBJECT(ra->il), "error", (GCallback)image_read_ahead_window_error_cb, ra);
+		g_signal_connect(G_OBJECT(ra->il), "done", (GCallback)image_read_ahead_window_done_cb, ra);
+
+		if (!image_loader_start(ra->il))
+			{
+			imd->read_ahead_window = g_list_remove(imd->read_ahead_window, ra);
+			image_read_ahead_window_free(ra);
+			}
+		}
+}
+
+static void image_read_ahead_window_cancel(ImageWindow *imd)
+{
+	GList *work;
+
+	for (work = imd->read_ahead_window; work; work = work->next)
+		{
+		image_read_ahead_window_free(work->data);
+		}
+	g_list_free(imd->read_ahead_window);
+	imd->read_ahead_window = NULL;
+}
+
+/* returns the running loader of a window image, it is removed from the window */
+static ImageLoader *image_read_ahead_window_take(ImageWindow *imd, FileData *fd)
+{
+	GList *work;
+	ImageReadAhead *ra;
+	ImageLoader *il;
+
+	work = image_read_ahead_window_find(imd->read_ahead_window, fd);
+	if (!work) return NULL;
+
+	ra = work->data;
+	il = ra->il;
+	ra->il = NULL;
+	if (il) g_signal_handlers_disconnect_matched(G_OBJECT(il), G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, ra);
+
+	imd->read_ahead_window = g_list_delete_link(imd->read_ahead_window, work);
+	image_read_ahead_window_free(ra);
+
+	return il;
+}
+
+static void image_read_ahead_window_set(ImageWindow *imd, GList *list)
+{
+	GList *old;
+	GList *work;
+	GdkPixbuf *pixbuf;
+	gulong budget;
+	gulong size;
+	gint count = 0;
+
+	old = imd->read_ahead_window;
+	imd->read_ahead_window = NULL;
+
+	/* the images are expected to be about as big as the current one, the
+	 * window has to fit into the cache together with it and the next image;
+	 * while the current one is not decoded yet the last decoded one is used */
+	budget = (gulong)options->image.image_cache_max * 1048576;
+	pixbuf = image_get_pixbuf(imd);
+	if (pixbuf)
+		{
+		imd->read_ahead_size = (gulong)gdk_pixbuf_get_rowstride(pixbuf) * (gulong)gdk_pixbuf_get_height(pixbuf);
+		}
+	size = imd->read_ahead_size;
+
+	for (work = list; work; work = work->next)
+		{
+		FileData *fd = work->data;
+		ImageReadAhead *ra;
+		GList *found;
+
+		if (budget == 0 || size * (count + 3) > budget) break;
+		if (size == 0 && count >= IMAGE_READ_AHEAD_WINDOW_MIN) break;
+		count++;
+
+		if (!fd || fd == imd->image_fd || fd == imd->read_ahead_fd) continue;
+		if (image_read_ahead_window_find(imd->read_ahead_window, fd)) continue;
+		if (image_cache_has(fd)) continue;
+
+		found = image_read_ahead_window_find(old, fd);
+		if (found)
+			{
+			/* keep it loading */
+			ra = found->data;
+			old = g_list_delete_link(old, found);
+			}
+		else
+			{
+			ra = g_new0(ImageReadAhead, 1);
+			ra->imd = imd;
+			ra->fd = file_data_ref(fd);
+			}
+
+		imd->read_ahead_window = g_list_append(imd->read_ahead_window, ra);
+		}
+
+	/* the rest is not needed any more, e.g. after a change of direction */
+	for (work = old; work; work = work->next)
+		{
+		ImageReadAhead *ra = work->data;
+
+		DEBUG_1("%s read ahead window cancelled for :%s", get_exec_time(), ra->fd->path);
+		image_read_ahead_window_free(ra);
+		}
+	g_list_free(old);
+
+	image_read_ahead_window_start(imd);
+}
+
 /*
  *-------------------------------------------------------------------
  * loading
@@ -884,6 +1190,7 @@ static void image_load_done_cb(ImageLoader *il, gpointer data)
 //	image_post_process(imd, TRUE);
 
 	image_read_ahead_start(imd);
+	image_read_ahead_window_start(imd);
 }
 
 static void image_load_size_cb(ImageLoader *il, guint width, guint height, gpointer data)
@@ -921,6 +1228,25 @@ static void image_load_set_signals(ImageWindow *imd, gboolean override_old_signa
 
 /* this read ahead is located here merely for the callbacks, above */
 
+/* shows the image of a loader that was started as read ahead */
+static void image_load_adopt(ImageWindow *imd, ImageLoader *il)
+{
+	imd->il = il;
+	image_loader_set_queue_priority(imd->il, IMAGE_LOADER_PRIORITY_CURRENT);
+
+	image_load_set_signals(imd, TRUE);
+
+	g_object_set(G_OBJECT(imd->pr), "loading", TRUE, NULL);
+	image_state_set(imd, IMAGE_STATE_LOADING);
+
+	if (!imd->delay_flip)
+		{
+		image_change_pixbuf(imd, image_loader_get_pixbuf(imd->il), image_zoom_get(imd), TRUE);
+		}
+
+	image_loader_delay_area_ready(imd->il, FALSE); /* send the delayed area_ready signals */
+}
+
 static gboolean image_read_ahead_check(ImageWindow *imd)
 {
 	if (!imd->read_ahead_fd) return FALSE;
@@ -934,21 +1260,9 @@ static gboolean image_read_ahead_check(ImageWindow *imd)
 
 	if (imd->read_ahead_il)
 		{
-		imd->il = imd->read_ahead_il;
+		image_load_adopt(imd, imd->read_ahead_il);
 		imd->read_ahead_il = NULL;
 
-		image_load_set_signals(imd, TRUE);
-
-		g_object_set(G_OBJECT(imd->pr), "loading", TRUE, NULL);
-		image_state_set(imd, IMAGE_STATE_LOADING);
-
-		if (!imd->delay_flip)
-			{
-			image_change_pixbuf(imd, image_loader_get_pixbuf(imd->il), image_zoom_get(imd), TRUE);
-			}
-
-		image_loader_delay_area_ready(imd->il, FALSE); /* send the delayed area_ready signals */
-
 		file_data_unref(imd->read_ahead_fd);
 		imd->read_ahead_fd = NULL;
 		return TRUE;
@@ -968,6 +1282,66 @@ static gboolean image_read_ahead_check(ImageWindow *imd)
 	return FALSE;
 }
 
+static gboolean image_read_ahead_window_check(ImageWindow *imd)
+{
+	ImageLoader *il;
+
+	if (imd->il || !imd->image_fd) return FALSE;
+
+	il = image_read_ahead_window_take(imd, imd->image_fd);
+	if (!il) return FALSE;
+
+	image_load_adopt(imd, il);
+	return TRUE;
+}
+
+static void image_change_tiles(ImageWindow *imd, ImageTiles *tiles, gdouble zoom)
+{
+	gpointer old_tiles = imd->tiles;
+
+	pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, NULL, NULL, FALSE);
+	if (imd->cm)
+		{
+		color_man_free(imd->cm);
+		imd->cm = NULL;
+		}
+
+	imd->tiles = image_tiles_ref(tiles);
+	image_tiles_set_renderer(tiles, (PixbufRenderer *)imd->pr, zoom);
+	image_tiles_unref(old_tiles);
+
+	/* the tiles are drawn as they are stored */
+	imd->orientation = EXIF_ORIENTATION_TOP_LEFT;
+	pixbuf_renderer_set_orientation((PixbufRenderer *)imd->pr, imd->orientation);
+
+	if (imd->color_profile_enable)
+		{
+		image_post_process_color(imd, 0, FALSE);
+		}
+
+	if (imd->cm || imd->desaturate)
+		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
+
+	image_state_set(imd, IMAGE_STATE_IMAGE);
+}
+
+/* images above the configured size are not loaded, but decoded in tiles as they come into view */
+static gboolean image_load_tiles(ImageWindow *imd, FileData *fd)
+{
+	ImageTiles *tiles;
+
+	tiles = image_tiles_for_file(fd);
+	if (!tiles) return FALSE;
+
+	image_change_tiles(imd, tiles, image_zoom_get(imd));
+	image_tiles_unref(tiles);
+
+	image_read_ahead_start(imd);
+	image_read_ahead_window_start(imd);
+
+	return TRUE;
+}
+
 static gboolean image_load_begin(ImageWindow *imd, FileData *fd)
 {
 	DEBUG_1("%s image begin", get_exec_time());
@@ -989,6 +1363,18 @@ static gboolean image_load_begin(ImageWindow *imd, FileData *fd)
 		return TRUE;
 		}
 
+	if (image_read_ahead_window_check(imd))
+		{
+		DEBUG_1("from read ahead window: %s", imd->image_fd->path);
+		return TRUE;
+		}
+
+	if (image_load_tiles(imd, fd))
+		{
+		DEBUG_1("in tiles: %s", imd->image_fd->path);
+		return TRUE;
+		}
+
 	if (!imd->delay_flip && image_get_pixbuf(imd))
 		{
 		PixbufRenderer *pr;
@@ -1344,6 +1730,9 @@ void image_change_pixbuf(ImageWindow *imd, GdkPixbuf *pixbuf, gdouble zoom, gboo
 
 	if (pixbuf) g_object_unref(pixbuf);
 
+	image_tiles_unref(imd->tiles);
+	imd->tiles = NULL;
+
 	if (imd->color_profile_enable)
 		{
 		image_post_process_color(imd, 0, FALSE); /* TODO: error handling */
@@ -1467,6 +1856,10 @@ void image_move_from_image(ImageWindow *imd, ImageWindow *source)
 
 	pixbuf_renderer_move(PIXBUF_RENDERER(imd->pr), PIXBUF_RENDERER(source->pr));
 
+	image_tiles_unref(imd->tiles);
+	imd->tiles = source->tiles;
+	source->tiles = NULL;
+
 	if (imd->cm || imd->desaturate)
 		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
 	else
@@ -1529,6 +1922,9 @@ void image_copy_from_image(ImageWindow *imd, ImageWindow *source)
 
 	pixbuf_renderer_copy(PIXBUF_RENDERER(imd->pr), PIXBUF_RENDERER(source->pr));
 
+	image_tiles_unref(imd->tiles);
+	imd->tiles = image_tiles_ref(source->tiles);
+
 	if (imd->cm || imd->desaturate)
 		pixbuf_renderer_set_post_process_func((PixbufRenderer *)imd->pr, image_post_process_tile_color_cb, (gpointer) imd, (imd->cm != NULL) );
 	else
@@ -1546,7 +1942,7 @@ void image_area_changed(ImageWindow *imd, gint x, gint y, gint width, gint heigh
 
 void image_reload(ImageWindow *imd)
 {
-	if (pixbuf_renderer_get_tiles((PixbufRenderer *)imd->pr)) return;
+	if (pixbuf_renderer_get_tiles((PixbufRenderer *)imd->pr) && !imd->tiles) return;
 
 	image_change_complete(imd, image_zoom_get(imd));
 }
@@ -1721,13 +2117,11 @@ void image_stereo_pixbuf_set(ImageWindow *imd, StereoPixbufData stereo_mode)
 
 /* read ahead */
 
-void image_prebuffer_set(ImageWindow *imd, FileData *fd)
+static void image_prebuffer_set_next(ImageWindow *imd, FileData *fd)
 {
-	if (pixbuf_renderer_get_tiles((PixbufRenderer *)imd->pr)) return;
-
 	if (fd)
 		{
-		if (!file_cache_get(image_get_cache(), fd))
+		if (!image_cache_has(fd))
 			{
 			image_read_ahead_set(imd, fd);
 			}
@@ -1738,6 +2132,29 @@ void image_prebuffer_set(ImageWindow *imd, FileData *fd)
 		}
 }
 
+void image_prebuffer_set(ImageWindow *imd, FileData *fd)
+{
+	if (pixbuf_renderer_get_tiles((PixbufRenderer *)imd->pr)) return;
+
+	image_read_ahead_window_set(imd, NULL);
+	image_prebuffer_set_next(imd, fd);
+}
+
+void image_prebuffer_set_list(ImageWindow *imd, GList *list)
+{
+	if (pixbuf_renderer_get_tiles((PixbufRenderer *)imd->pr)) return;
+
+	if (!list)
+		{
+		image_prebuffer_set(imd, NULL);
+		return;
+		}
+
+	/* the next image first, it may take over a loader of the old window */
+	image_prebuffer_set_next(imd, list->data);
+	image_read_ahead_window_set(imd, list->next);
+}
+
 static void image_notify_cb(FileData *fd, NotifyType type, gpointer data)
 {
 	ImageWindow *imd = data;
@@ -2010,6 +2427,9 @@ static void image_free(ImageWindow *imd)
 	image_reset(imd);
 
 	image_read_ahead_cancel(imd);
+	image_read_ahead_window_cancel(imd);
+
+	image_tiles_unref(imd->tiles);
 
 	file_data_unref(imd->image_fd);
 	g_free(imd->title);
@@ -2155,6 +2575,9 @@ ImageWindow *image_new(gboolean frame)
 	imd->pr = GTK_WIDGET(pixbuf_renderer_new());
 	DEBUG_NAME(imd->pr);
 
+	/* color correction and desaturation of tiles are safe in threads */
+	pixbuf_renderer_set_post_process_threaded((PixbufRenderer *)imd->pr, color_man_thread_safe());
+
 	image_options_set(imd);
 
 	imd->widget = gtk_vbox_new(0, 0);
@@ -110,6 +110,9 @@ void image_stereo_pixbuf_set(ImageWindow *imd, StereoPixbufData stereo_mode);
 
 /* read ahead, pass NULL to cancel */
 void image_prebuffer_set(ImageWindow *imd, FileData *fd);
+/* read ahead of several images, the next one to be shown first,
+ * the others are loaded into the image cache as far as it fits */
+void image_prebuffer_set_list(ImageWindow *imd, GList *list);
 
 /* auto refresh */
 void image_auto_refresh_enable(ImageWindow *imd, gboolean enable);
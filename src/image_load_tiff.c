@@ -29,6 +29,7 @@
 
 #include "image-load.h"
 #include "image_load_tiff.h"
+#include "ui_fileops.h"
 
 #ifdef HAVE_TIFF
 
@@ -135,6 +136,750 @@ tiff_load_unmap_file (thandle_t handle, tdata_t data, toff_t offset)
 {
 }
 
+#define TIFF_STRIP_READ_SIZE (4 * 1048576)	/* most bytes of a strip read in parts */
+
+/*
+ * Like TIFFReadRGBAStrip() and TIFFReadRGBATile(), for any area of the image.
+ * The rows and columns of raster are flipped from the orientation of the
+ * file to the one given, with ORIENTATION_BOTLEFT as those functions do it;
+ * with the orientation of the file they are as stored, top row first.
+ */
+static gboolean image_loader_tiff_read_rgba(TIFF *tiff, uint32 x, uint32 y, uint32 width, uint32 height,
+					    uint16 orientation, uint32 *raster)
+{
+	TIFFRGBAImage img;
+	char emsg[1024];
+	gboolean ret;
+
+	if (!TIFFRGBAImageOK(tiff, emsg) || !TIFFRGBAImageBegin(&img, tiff, 0, emsg))
+		{
+		DEBUG_1("TIFF reading: %s", emsg);
+		return FALSE;
+		}
+
+	img.req_orientation = orientation;
+	img.row_offset = y;
+	img.col_offset = x;
+	ret = TIFFRGBAImageGet(&img, raster, width, height);
+	TIFFRGBAImageEnd(&img);
+
+	return ret;
+}
+
+/*
+ * Reading some rows of a strip still has libtiff allocate and decode it
+ * from its start, only strips up to TIFF_STRIP_READ_SIZE are read in parts.
+ */
+static gboolean image_loader_tiff_strips_bounded(TIFF *tiff)
+{
+	tsize_t size;
+
+	if (TIFFIsTiled(tiff)) return TRUE;
+
+	size = TIFFStripSize(tiff);
+	return (size > 0 && size <= TIFF_STRIP_READ_SIZE);
+}
+
+/* rows of a strip read at a time into a raster of width pixels */
+static uint32 image_loader_tiff_strip_rows(TIFF *tiff, uint32 width, uint32 height)
+{
+	uint32 rowsperstrip;
+	uint32 rows_max = MAX(1, TIFF_STRIP_READ_SIZE / ((gsize)width * sizeof(uint32)));
+
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+	if (rowsperstrip == 0 || rowsperstrip > rows_max) rowsperstrip = rows_max;
+	if (rowsperstrip > height) rowsperstrip = height;
+
+	return rowsperstrip;
+}
+
+/*
+ * Reduced size loading, used when the requested size is smaller than the image.
+ * A smaller resolution stored in the file is used if there is one, and the
+ * strips or tiles are box averaged to the requested size as they are read,
+ * so the full size image is never held in memory.
+ */
+
+typedef struct _ImageLoaderTiffShrink ImageLoaderTiffShrink;
+struct _ImageLoaderTiffShrink
+{
+	ImageLoaderTiff *lt;
+	gint width;
+	gint height;
+	uint16 orientation;		/* of the file, rows and columns are read as stored */
+	gboolean flip_rows;		/* stored bottom to top */
+
+	guchar *pixels;			/* of the reduced pixbuf */
+	gint dest_width;
+	gint dest_height;
+	gint rowstride;
+
+	gint *col_dest;			/* destination column of each stored column */
+	gint *col_count;		/* source columns of each destination column */
+	guint64 *sum;			/* RGBA sums of the destination row in progress */
+	gint dest_row;
+	gint rows;			/* source rows in sum */
+};
+
+static void image_loader_tiff_shrink_flush(ImageLoaderTiffShrink *ts)
+{
+	guchar *p;
+	gint x;
+	gint c;
+
+	if (ts->rows == 0) return;
+
+	p = ts->pixels + ts->dest_row * ts->rowstride;
+	for (x = 0; x < ts->dest_width; x++)
+		{
+		guint64 n = (guint64)ts->col_count[x] * ts->rows;
+
+		for (c = 0; c < 4; c++)
+			{
+			*p = (guchar)((ts->sum[x * 4 + c] + n / 2) / n);
+			p++;
+			}
+		}
+
+	ts->lt->area_updated_cb(ts->lt, 0, ts->dest_row, ts->dest_width, 1, ts->lt->data);
+
+	memset(ts->sum, 0, sizeof(guint64) * 4 * ts->dest_width);
+	ts->rows = 0;
+}
+
+/* stored rows, they must be added in the order they are stored */
+static void image_loader_tiff_shrink_row(ImageLoaderTiffShrink *ts, gint row, const uint32 *line)
+{
+	gint dest_row;
+	gint x;
+
+	if (ts->flip_rows) row = ts->height - 1 - row;
+	dest_row = (gint)((gint64)row * ts->dest_height / ts->height);
+
+	if (dest_row != ts->dest_row)
+		{
+		image_loader_tiff_shrink_flush(ts);
+		ts->dest_row = dest_row;
+		}
+
+	for (x = 0; x < ts->width; x++)
+		{
+		guint64 *sum = ts->sum + ts->col_dest[x] * 4;
+		uint32 pixel = line[x];
+
+		sum[0] += TIFFGetR(pixel);
+		sum[1] += TIFFGetG(pixel);
+		sum[2] += TIFFGetB(pixel);
+		sum[3] += TIFFGetA(pixel);
+		}
+	ts->rows++;
+}
+
+static gboolean image_loader_tiff_shrink_strips(ImageLoaderTiffShrink *ts, TIFF *tiff)
+{
+	uint32 rowsperstrip;
+	uint32 *raster;
+	gint row;
+
+	rowsperstrip = image_loader_tiff_strip_rows(tiff, ts->width, ts->height);
+
+	raster = g_try_malloc((gsize)ts->width * rowsperstrip * sizeof(uint32));
+	if (!raster)
+		{
+		DEBUG_1("Insufficient memory to read TIFF strip: %u rows", rowsperstrip);
+		return FALSE;
+		}
+
+	for (row = 0; row < ts->height && !ts->lt->abort; row += rowsperstrip)
+		{
+		gint rows_to_write = MIN((gint)rowsperstrip, ts->height - row);
+		gint i_row;
+
+		if (!image_loader_tiff_read_rgba(tiff, 0, row, ts->width, rows_to_write, ts->orientation, raster)) break;
+
+		for (i_row = 0; i_row < rows_to_write; i_row++)
+			{
+			image_loader_tiff_shrink_row(ts, row + i_row, raster + (gsize)i_row * ts->width);
+			}
+		}
+
+	g_free(raster);
+	return TRUE;
+}
+
+static gboolean image_loader_tiff_shrink_tiles(ImageLoaderTiffShrink *ts, TIFF *tiff)
+{
+	uint32 tile_width;
+	uint32 tile_height;
+	uint32 *tile;
+	uint32 *band;
+	gint x;
+	gint y;
+
+	if (!TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tile_width) ||
+	    !TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tile_height))
+		{
+		DEBUG_1("Could not get tile size (bad TIFF file)");
+		return FALSE;
+		}
+
+	tile = g_try_malloc((gsize)tile_width * tile_height * sizeof(uint32));
+	band = g_try_malloc((gsize)ts->width * tile_height * sizeof(uint32));
+	if (!tile || !band)
+		{
+		DEBUG_1("Insufficient memory to read TIFF tiles: %ux%u", tile_width, tile_height);
+		g_free(tile);
+		g_free(band);
+		return FALSE;
+		}
+
+	for (y = 0; y < ts->height && !ts->lt->abort; y += tile_height)
+		{
+		gint rows = MIN((gint)tile_height, ts->height - y);
+		gint i_row;
+
+		for (x = 0; x < ts->width; x += tile_width)
+			{
+			gint cols = MIN((gint)tile_width, ts->width - x);
+
+			if (!image_loader_tiff_read_rgba(tiff, x, y, cols, rows, ts->orientation, tile))
+				{
+				memset(tile, 0, (gsize)tile_width * tile_height * sizeof(uint32));
+				}
+
+			for (i_row = 0; i_row < rows; i_row++)
+				{
+				memcpy(band + (gsize)i_row * ts->width + x,
+				       tile + (gsize)i_row * cols,
+				       cols * sizeof(uint32));
+				}
+			}
+
+		for (i_row = 0; i_row < rows; i_row++)
+			{
+			image_loader_tiff_shrink_row(ts, y + i_row, band + (gsize)i_row * ts->width);
+			}
+		}
+
+	g_free(tile);
+	g_free(band);
+	return TRUE;
+}
+
+static gboolean image_loader_tiff_reduced_fits(TIFF *tiff, gint width, gint height,
+					       guint requested_width, guint requested_height,
+					       uint32 *level_width, uint32 *level_height)
+{
+	uint32 subfiletype = 0;
+
+	if (!TIFFGetField(tiff, TIFFTAG_SUBFILETYPE, &subfiletype) ||
+	    !(subfiletype & FILETYPE_REDUCEDIMAGE)) return FALSE;
+
+	if (!TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, level_width) ||
+	    !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, level_height)) return FALSE;
+
+	if (*level_width < requested_width || *level_height < requested_height) return FALSE;
+
+	/* same aspect ratio, not some unrelated thumbnail */
+	if (ABS((gint64)*level_width * height - (gint64)*level_height * width) > (gint64)*level_width * height / 50) return FALSE;
+
+	return TRUE;
+}
+
+/* switches to the smallest reduced resolution image that is not smaller than requested */
+static void image_loader_tiff_select_reduced(TIFF *tiff, guint requested_width, guint requested_height,
+					     gint *width, gint *height)
+{
+	toff_t best_offset = 0;
+	uint32 best_width = *width;
+	uint32 best_height = *height;
+	uint32 level_width;
+	uint32 level_height;
+	toff_t *sub_offsets = NULL;
+	uint16 sub_count = 0;
+	toff_t *offsets;
+	gint i;
+
+	/* reduced images in sub directories of the image */
+	if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &sub_count, &offsets) && sub_count > 0)
+		{
+		sub_offsets = g_new(toff_t, sub_count);
+		memcpy(sub_offsets, offsets, sub_count * sizeof(toff_t));
+		}
+	for (i = 0; i < sub_count; i++)
+		{
+		if (TIFFSetSubDirectory(tiff, sub_offsets[i]) &&
+		    image_loader_tiff_reduced_fits(tiff, *width, *height, requested_width, requested_height, &level_width, &level_height) &&
+		    level_width < best_width)
+			{
+			best_offset = sub_offsets[i];
+			best_width = level_width;
+			best_height = level_height;
+			}
+		}
+	g_free(sub_offsets);
+
+	/* and the following directories */
+	for (i = 1; TIFFSetDirectory(tiff, i); i++)
+		{
+		if (image_loader_tiff_reduced_fits(tiff, *width, *height, requested_width, requested_height, &level_width, &level_height) &&
+		    level_width < best_width)
+			{
+			best_offset = TIFFCurrentDirOffset(tiff);
+			best_width = level_width;
+			best_height = level_height;
+			}
+		}
+
+	if (best_offset && TIFFSetSubDirectory(tiff, best_offset))
+		{
+		DEBUG_1("TIFF reduced resolution %ux%u used for %dx%d", best_width, best_height, *width, *height);
+		*width = best_width;
+		*height = best_height;
+		return;
+		}
+
+	TIFFSetDirectory(tiff, 0);
+}
+
+static gboolean image_loader_tiff_load_reduced(ImageLoaderTiff *lt, TIFF *tiff, gint width, gint height)
+{
+	ImageLoaderTiffShrink ts;
+	gboolean flip_cols;
+	gboolean ret;
+	gint x;
+
+	memset(&ts, 0, sizeof(ts));
+	ts.lt = lt;
+	ts.width = width;
+	ts.height = height;
+	ts.dest_width = CLAMP((gint)lt->requested_width, 1, width);
+	ts.dest_height = CLAMP((gint)lt->requested_height, 1, height);
+
+	/* the strips and tiles are read as stored and placed by the orientation */
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &ts.orientation);
+	ts.flip_rows = (ts.orientation == ORIENTATION_BOTLEFT || ts.orientation == ORIENTATION_BOTRIGHT ||
+			ts.orientation == ORIENTATION_LEFTBOT || ts.orientation == ORIENTATION_RIGHTBOT);
+	flip_cols = (ts.orientation == ORIENTATION_TOPRIGHT || ts.orientation == ORIENTATION_BOTRIGHT ||
+		     ts.orientation == ORIENTATION_RIGHTTOP || ts.orientation == ORIENTATION_RIGHTBOT);
+
+	lt->pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, ts.dest_width, ts.dest_height);
+	if (!lt->pixbuf)
+		{
+		DEBUG_1("Insufficient memory to open TIFF file");
+		return FALSE;
+		}
+	ts.pixels = gdk_pixbuf_get_pixels(lt->pixbuf);
+	ts.rowstride = gdk_pixbuf_get_rowstride(lt->pixbuf);
+
+	lt->area_prepared_cb(lt, lt->data);
+
+	ts.col_dest = g_new(gint, width);
+	ts.col_count = g_new0(gint, ts.dest_width);
+	ts.sum = g_new0(guint64, ts.dest_width * 4);
+	for (x = 0; x < width; x++)
+		{
+		gint col = flip_cols ? width - 1 - x : x;
+
+		ts.col_dest[x] = (gint)((gint64)col * ts.dest_width / width);
+		ts.col_count[ts.col_dest[x]]++;
+		}
+
+	if (TIFFIsTiled(tiff))
+		{
+		ret = image_loader_tiff_shrink_tiles(&ts, tiff);
+		}
+	else
+		{
+		ret = image_loader_tiff_shrink_strips(&ts, tiff);
+		}
+	image_loader_tiff_shrink_flush(&ts);
+
+	g_free(ts.col_dest);
+	g_free(ts.col_count);
+	g_free(ts.sum);
+
+	return ret;
+}
+
+/*
+ * Region reading, to show huge files as the source tiles of a PixbufRenderer.
+ * Only the tiles or strips of the file under a region are decoded, from the
+ * smallest reduced resolution image that is still big enough for the scale
+ * the region is shown at. Decoded tiles and strips are kept for a while.
+ * Files with strips too big to be read in parts are loaded as a whole.
+ */
+
+#define TIFF_REGION_LEVELS_MAX 16
+#define TIFF_REGION_CACHE_SIZE (64 * 1048576)	/* bytes of decoded blocks */
+
+typedef struct _ImageLoaderTiffLevel ImageLoaderTiffLevel;
+struct _ImageLoaderTiffLevel
+{
+	toff_t offset;			/* of the directory */
+	uint32 width;
+	uint32 height;
+};
+
+/* a decoded tile or strip */
+typedef struct _ImageLoaderTiffBlock ImageLoaderTiffBlock;
+struct _ImageLoaderTiffBlock
+{
+	gint level;
+	gint x;				/* area in the level */
+	gint y;
+	gint w;
+	gint h;
+	gint stride;			/* pixels in a row of raster */
+	gint rows;			/* rows in raster, bottom row first */
+	uint32 *raster;
+};
+
+struct _ImageLoaderTiffRegion
+{
+	TIFF *tiff;
+	gint width;
+	gint height;
+
+	ImageLoaderTiffLevel levels[TIFF_REGION_LEVELS_MAX];	/* biggest first */
+	gint level_count;
+	gint level_current;		/* of the current directory */
+
+	GList *blocks;			/* most recently used first */
+	gsize blocks_size;
+};
+
+static void image_loader_tiff_region_add_level(ImageLoaderTiffRegion *tr, toff_t offset, uint32 width, uint32 height)
+{
+	gint i;
+
+	if (tr->level_count >= TIFF_REGION_LEVELS_MAX) return;
+
+	/* keep them sorted by size */
+	i = tr->level_count;
+	while (i > 0 && tr->levels[i - 1].width < width)
+		{
+		tr->levels[i] = tr->levels[i - 1];
+		i--;
+		}
+	tr->levels[i].offset = offset;
+	tr->levels[i].width = width;
+	tr->levels[i].height = height;
+	tr->level_count++;
+}
+
+ImageLoaderTiffRegion *image_loader_tiff_region_new(const gchar *path)
+{
+	ImageLoaderTiffRegion *tr;
+	TIFF *tiff;
+	gchar *pathl;
+	uint32 width;
+	uint32 height;
+	uint16 orientation;
+	uint32 level_width;
+	uint32 level_height;
+	toff_t *offsets;
+	toff_t *sub_offsets = NULL;
+	uint16 sub_count = 0;
+	gint i;
+
+	TIFFSetWarningHandler(NULL);
+
+	pathl = path_from_utf8(path);
+	tiff = TIFFOpen(pathl, "r");
+	g_free(pathl);
+	if (!tiff) return NULL;
+
+	if (!TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) ||
+	    !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height) ||
+	    width == 0 || height == 0 || width > G_MAXINT || height > G_MAXINT)
+		{
+		TIFFClose(tiff);
+		return NULL;
+		}
+
+	/* the tiles are placed as they are stored */
+	if (TIFFGetField(tiff, TIFFTAG_ORIENTATION, &orientation) && orientation != ORIENTATION_TOPLEFT)
+		{
+		DEBUG_1("TIFF region reading: orientation %d not supported: %s", orientation, path);
+		TIFFClose(tiff);
+		return NULL;
+		}
+
+	/* huge strips would be decoded whole for every block of them */
+	if (!image_loader_tiff_strips_bounded(tiff))
+		{
+		DEBUG_1("TIFF region reading: strips too big: %s", path);
+		TIFFClose(tiff);
+		return NULL;
+		}
+
+	tr = g_new0(ImageLoaderTiffRegion, 1);
+	tr->tiff = tiff;
+	tr->width = width;
+	tr->height = height;
+
+	image_loader_tiff_region_add_level(tr, TIFFCurrentDirOffset(tiff), width, height);
+
+	/* reduced images in sub directories of the image */
+	if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &sub_count, &offsets) && sub_count > 0)
+		{
+		sub_offsets = g_new(toff_t, sub_count);
+		memcpy(sub_offsets, offsets, sub_count * sizeof(toff_t));
+		}
+	for (i = 0; i < sub_count; i++)
+		{
+		if (TIFFSetSubDirectory(tiff, sub_offsets[i]) &&
+		    image_loader_tiff_reduced_fits(tiff, width, height, 0, 0, &level_width, &level_height) &&
+		    image_loader_tiff_strips_bounded(tiff))
+			{
+			image_loader_tiff_region_add_level(tr, sub_offsets[i], level_width, level_height);
+			}
+		}
+	g_free(sub_offsets);
+
+	/* and the following directories */
+	for (i = 1; TIFFSetDirectory(tiff, i); i++)
+		{
+		if (image_loader_tiff_reduced_fits(tiff, width, height, 0, 0, &level_width, &level_height) &&
+		    image_loader_tiff_strips_bounded(tiff))
+			{
+			image_loader_tiff_region_add_level(tr, TIFFCurrentDirOffset(tiff), level_width, level_height);
+			}
+		}
+
+	TIFFSetSubDirectory(tiff, tr->levels[0].offset);
+	tr->level_current = 0;
+
+	DEBUG_1("TIFF region reading: %dx%d, %d levels: %s", tr->width, tr->height, tr->level_count, path);
+
+	return tr;
+}
+
+static void image_loader_tiff_block_free(ImageLoaderTiffBlock *block)
+{
+	g_free(block->raster);
+	g_free(block);
+}
+
+void image_loader_tiff_region_free(ImageLoaderTiffRegion *tr)
+{
+	if (!tr) return;
+
+	while (tr->blocks)
+		{
+		image_loader_tiff_block_free(tr->blocks->data);
+		tr->blocks = g_list_delete_link(tr->blocks, tr->blocks);
+		}
+
+	TIFFClose(tr->tiff);
+	g_free(tr);
+}
+
+void image_loader_tiff_region_get_size(ImageLoaderTiffRegion *tr, gint *width, gint *height)
+{
+	if (width) *width = tr->width;
+	if (height) *height = tr->height;
+}
+
+static ImageLoaderTiffBlock *image_loader_tiff_block_read(ImageLoaderTiffRegion *tr, gint level, gint x, gint y)
+{
+	ImageLoaderTiffLevel *lv = &tr->levels[level];
+	ImageLoaderTiffBlock *block;
+	uint32 block_width;
+	uint32 block_height;
+
+	if (tr->level_current != level)
+		{
+		if (!TIFFSetSubDirectory(tr->tiff, lv->offset)) return NULL;
+		tr->level_current = level;
+		}
+
+	block = g_new0(ImageLoaderTiffBlock, 1);
+	block->level = level;
+
+	if (TIFFIsTiled(tr->tiff))
+		{
+		if (!TIFFGetField(tr->tiff, TIFFTAG_TILEWIDTH, &block_width) ||
+		    !TIFFGetField(tr->tiff, TIFFTAG_TILELENGTH, &block_height) ||
+		    block_width == 0 || block_height == 0)
+			{
+			g_free(block);
+			return NULL;
+			}
+
+		block->x = x - x % block_width;
+		block->y = y - y % block_height;
+		block->w = MIN(block_width, lv->width - block->x);
+		block->h = MIN(block_height, lv->height - block->y);
+		block->stride = block_width;
+		/* partial tiles are at the bottom of the raster too */
+		block->rows = block_height;
+
+		block->raster = g_try_malloc((gsize)block_width * block_height * sizeof(uint32));
+		if (block->raster && !TIFFReadRGBATile(tr->tiff, block->x, block->y, block->raster))
+			{
+			memset(block->raster, 0, (gsize)block_width * block_height * sizeof(uint32));
+			}
+		}
+	else
+		{
+		/* a whole strip if it is small enough, otherwise only some of its rows */
+		block_height = image_loader_tiff_strip_rows(tr->tiff, lv->width, lv->height);
+
+		block->x = 0;
+		block->y = y - y % block_height;
+		block->w = lv->width;
+		block->h = MIN(block_height, lv->height - block->y);
+		block->stride = lv->width;
+		block->rows = block->h;
+
+		block->raster = g_try_malloc((gsize)lv->width * block_height * sizeof(uint32));
+		if (block->raster && !image_loader_tiff_read_rgba(tr->tiff, 0, block->y, lv->width, block->h,
+										 ORIENTATION_BOTLEFT, block->raster))
+			{
+			memset(block->raster, 0, (gsize)lv->width * block_height * sizeof(uint32));
+			}
+		}
+
+	if (!block->raster)
+		{
+		DEBUG_1("Insufficient memory to read TIFF region");
+		g_free(block);
+		return NULL;
+		}
+
+	return block;
+}
+
+static ImageLoaderTiffBlock *image_loader_tiff_block_get(ImageLoaderTiffRegion *tr, gint level, gint x, gint y)
+{
+	ImageLoaderTiffBlock *block;
+	GList *work;
+
+	for (work = tr->blocks; work; work = work->next)
+		{
+		block = work->data;
+		if (block->level == level &&
+		    x >= block->x && x < block->x + block->w &&
+		    y >= block->y && y < block->y + block->h)
+			{
+			if (work != tr->blocks)
+				{
+				tr->blocks = g_list_remove_link(tr->blocks, work);
+				tr->blocks = g_list_concat(work, tr->blocks);
+				}
+			return block;
+			}
+		}
+
+	block = image_loader_tiff_block_read(tr, level, x, y);
+	if (!block) return NULL;
+
+	tr->blocks = g_list_prepend(tr->blocks, block);
+	tr->blocks_size += (gsize)block->stride * block->rows * sizeof(uint32);
+
+	while (tr->blocks_size > TIFF_REGION_CACHE_SIZE && tr->blocks->next)
+		{
+		GList *last = g_list_last(tr->blocks);
+		ImageLoaderTiffBlock *old = last->data;
+
+		tr->blocks_size -= (gsize)old->stride * old->rows * sizeof(uint32);
+		image_loader_tiff_block_free(old);
+		tr->blocks = g_list_delete_link(tr->blocks, last);
+		}
+
+	return block;
+}
+
+gboolean image_loader_tiff_region_read(ImageLoaderTiffRegion *tr, gint x, gint y, gint width, gint height,
+				       GdkPixbuf *dest)
+{
+	ImageLoaderTiffLevel *lv;
+	guchar *pixels;
+	gint rowstride;
+	gint n_channels;
+	gint w;
+	gint h;
+	gint *cols;
+	gint level;
+	gint i;
+	gint dx;
+	gint dy;
+
+	w = gdk_pixbuf_get_width(dest);
+	h = gdk_pixbuf_get_height(dest);
+	pixels = gdk_pixbuf_get_pixels(dest);
+	rowstride = gdk_pixbuf_get_rowstride(dest);
+	n_channels = gdk_pixbuf_get_n_channels(dest);
+
+	if (width < 1 || height < 1) return FALSE;
+
+	/* the smallest level with as many pixels as dest for the area */
+	level = 0;
+	for (i = 1; i < tr->level_count; i++)
+		{
+		if ((gint64)tr->levels[i].width * width < (gint64)tr->width * w ||
+		    (gint64)tr->levels[i].height * height < (gint64)tr->height * h) break;
+		level = i;
+		}
+	lv = &tr->levels[level];
+
+	/* column of the level for each column of dest, -1 outside of the image */
+	cols = g_new(gint, w);
+	for (dx = 0; dx < w; dx++)
+		{
+		gint64 ix = x + (gint64)dx * width / w;
+
+		cols[dx] = (ix < tr->width) ? (gint)(ix * lv->width / tr->width) : -1;
+		}
+
+	for (dy = 0; dy < h; dy++)
+		{
+		ImageLoaderTiffBlock *block = NULL;
+		guchar *p = pixels + dy * rowstride;
+		gint64 iy = y + (gint64)dy * height / h;
+		gint sy;
+
+		if (iy >= tr->height)
+			{
+			memset(p, 0, w * n_channels);
+			continue;
+			}
+		sy = (gint)(iy * lv->height / tr->height);
+
+		for (dx = 0; dx < w; dx++)
+			{
+			gint sx = cols[dx];
+			uint32 pixel = 0;
+
+			if (sx >= 0)
+				{
+				if (!block ||
+				    sx < block->x || sx >= block->x + block->w ||
+				    sy < block->y || sy >= block->y + block->h)
+					{
+					block = image_loader_tiff_block_get(tr, level, sx, sy);
+					}
+				if (block)
+					{
+					pixel = block->raster[(gsize)(block->rows - 1 - (sy - block->y)) * block->stride + (sx - block->x)];
+					}
+				}
+
+			p[0] = TIFFGetR(pixel);
+			p[1] = TIFFGetG(pixel);
+			p[2] = TIFFGetB(pixel);
+			if (n_channels == 4) p[3] = TIFFGetA(pixel);
+			p += n_channels;
+			}
+		}
+
+	g_free(cols);
+
+	return TRUE;
+}
+
 static gboolean image_loader_tiff_load (gpointer loader, const guchar *buf, gsize count, GError **error)
 {
 	ImageLoaderTiff *lt = (ImageLoaderTiff *) loader;
@@ -204,6 +949,26 @@ static gboolean image_loader_tiff_load (gpointer loader, const guchar *buf, gsiz
 	lt->requested_height = height;
 	lt->size_cb(loader, lt->requested_width, lt->requested_height, lt->data);
 
+	if (lt->requested_width < (guint)width || lt->requested_height < (guint)height)
+		{
+		gint level_width = width;
+		gint level_height = height;
+
+		image_loader_tiff_select_reduced(tiff, lt->requested_width, lt->requested_height, &level_width, &level_height);
+		if (image_loader_tiff_strips_bounded(tiff))
+			{
+			gboolean ret;
+
+			ret = image_loader_tiff_load_reduced(lt, tiff, level_width, level_height);
+			TIFFClose(tiff);
+			return ret;
+			}
+
+		/* each strip would be decoded whole many times, load it once at full size */
+		DEBUG_1("TIFF strips too big to be read reduced, loading at full size");
+		TIFFSetDirectory(tiff, 0);
+		}
+
 	pixels = g_try_malloc (bytes);
 
 	if (!pixels)
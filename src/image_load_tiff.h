@@ -24,6 +24,19 @@
 
 #ifdef HAVE_TIFF
 void image_loader_backend_set_tiff(ImageLoaderBackend *funcs);
+
+/* reads areas of a TIFF file at full size coordinates without loading all of it */
+typedef struct _ImageLoaderTiffRegion ImageLoaderTiffRegion;
+
+ImageLoaderTiffRegion *image_loader_tiff_region_new(const gchar *path);
+void image_loader_tiff_region_free(ImageLoaderTiffRegion *tr);
+void image_loader_tiff_region_get_size(ImageLoaderTiffRegion *tr, gint *width, gint *height);
+
+/* fills dest with the area x, y, width, height of the image, scaled to the size of dest;
+ * a reduced resolution image of the file is used when it is big enough
+ */
+gboolean image_loader_tiff_region_read(ImageLoaderTiffRegion *tr, gint x, gint y, gint width, gint height,
+				       GdkPixbuf *dest);
 #endif
 
 #endif
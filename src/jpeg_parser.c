@@ -60,18 +60,6 @@ gboolean jpeg_segment_find(const guchar *data, guint size,
 }
 
 
-typedef enum {
-	TIFF_BYTE_ORDER_INTEL,
-	TIFF_BYTE_ORDER_MOTOROLA
-} TiffByteOrder;
-
-#define TIFF_TIFD_OFFSET_TAG 0
-#define TIFF_TIFD_OFFSET_FORMAT 2
-#define TIFF_TIFD_OFFSET_COUNT 4
-#define TIFF_TIFD_OFFSET_DATA 8
-#define TIFF_TIFD_SIZE 12
-
-
 
 guint16 tiff_byte_get_int16(const guchar *f, TiffByteOrder bo)
 {
@@ -157,11 +145,6 @@ gint tiff_directory_offset(const guchar *data, const guint len,
 	return (*offset < len);
 }
 
-typedef gint (* FuncParseIFDEntry)(const guchar *tiff, guint offset,
-				 guint size, TiffByteOrder bo,
-				 gpointer data);
-
-
 gint tiff_parse_IFD_table(const guchar *tiff, guint offset,
 			  guint size, TiffByteOrder bo,
 			  guint *next_offset,
@@ -25,6 +25,7 @@
 #define JPEG_MARKER		0xFF
 #define JPEG_MARKER_SOI		0xD8
 #define JPEG_MARKER_EOI		0xD9
+#define JPEG_MARKER_SOS		0xDA
 #define JPEG_MARKER_APP1	0xE1
 #define JPEG_MARKER_APP2	0xE2
 
@@ -44,6 +45,34 @@ gboolean jpeg_segment_find(const guchar *data, guint size,
 			    guchar app_marker, const gchar *magic, guint magic_len,
 			    guint *seg_offset, guint *seg_length);
 
+typedef enum {
+	TIFF_BYTE_ORDER_INTEL,
+	TIFF_BYTE_ORDER_MOTOROLA
+} TiffByteOrder;
+
+#define TIFF_TIFD_OFFSET_TAG 0
+#define TIFF_TIFD_OFFSET_FORMAT 2
+#define TIFF_TIFD_OFFSET_COUNT 4
+#define TIFF_TIFD_OFFSET_DATA 8
+#define TIFF_TIFD_SIZE 12
+
+guint16 tiff_byte_get_int16(const guchar *f, TiffByteOrder bo);
+guint32 tiff_byte_get_int32(const guchar *f, TiffByteOrder bo);
+void tiff_byte_put_int16(guchar *f, guint16 n, TiffByteOrder bo);
+void tiff_byte_put_int32(guchar *f, guint32 n, TiffByteOrder bo);
+
+gint tiff_directory_offset(const guchar *data, const guint len,
+				guint *offset, TiffByteOrder *bo);
+
+typedef gint (* FuncParseIFDEntry)(const guchar *tiff, guint offset,
+				 guint size, TiffByteOrder bo,
+				 gpointer data);
+
+gint tiff_parse_IFD_table(const guchar *tiff, guint offset,
+			  guint size, TiffByteOrder bo,
+			  guint *next_offset,
+			  FuncParseIFDEntry parse_entry, gpointer data);
+
 
 typedef struct _MPOData MPOData;
 typedef struct _MPOEntry MPOEntry;
@@ -1325,6 +1325,46 @@ void layout_image_set_fd(LayoutWindow *lw, FileData *fd)
 	layout_image_animate_new_file(lw);
 }
 
+/* read_ahead_fd first, when it is a neighbour of fd followed by more
+ * images in the same direction and a few in the other direction */
+static GList *layout_image_read_ahead_list(LayoutWindow *lw, FileData *fd, FileData *read_ahead_fd)
+{
+	GList *list;
+	gint index;
+	gint step;
+	gint i;
+
+	if (!read_ahead_fd) return NULL;
+
+	list = g_list_prepend(NULL, read_ahead_fd);
+
+	index = layout_list_get_index(lw, fd);
+	step = layout_list_get_index(lw, read_ahead_fd) - index;
+	if (index < 0 || (step != 1 && step != -1)) return list;
+
+	for (i = 2; i <= options->image.read_ahead_count; i++)
+		{
+		FileData *ahead;
+
+		if (index + i * step < 0) break;
+		ahead = layout_list_get_fd(lw, index + i * step);
+		if (!ahead) break;
+		list = g_list_prepend(list, ahead);
+		}
+
+	for (i = 1; i <= options->image.read_ahead_behind; i++)
+		{
+		FileData *behind;
+
+		if (index - i * step < 0) break;
+		behind = layout_list_get_fd(lw, index - i * step);
+		if (!behind) break;
+		list = g_list_prepend(list, behind);
+		}
+
+	return g_list_reverse(list);
+}
+
 void layout_image_set_with_ahead(LayoutWindow *lw, FileData *fd, FileData *read_ahead_fd)
 {
 	if (!layout_valid(&lw)) return;
@@ -1340,7 +1380,13 @@ This should be handled at the caller: in vflist_select_image
 		}
 */
 	layout_image_set_fd(lw, fd);
-	if (options->image.enable_read_ahead) image_prebuffer_set(lw->image, read_ahead_fd);
+	if (options->image.enable_read_ahead)
+		{
+		GList *list = layout_image_read_ahead_list(lw, fd, read_ahead_fd);
+
+		image_prebuffer_set_list(lw->image, list);
+		g_list_free(list);
+		}
 }
 
 void layout_image_set_index(LayoutWindow *lw, gint index)
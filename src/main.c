@@ -33,6 +33,7 @@
 #include "main.h"
 
 #include "cache.h"
+#include "cache-metadb.h"
 #include "collect.h"
 #include "collect-io.h"
 #include "filedata.h"
@@ -705,6 +706,7 @@ static void exit_program_final(void)
 	remote_close(remote_connection);
 
 	collect_manager_flush();
+	cache_meta_db_flush();
 
 	save_options(options);
 	keys_save();
@@ -37,6 +37,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
 #include "md5-util.h"
 
 
@@ -328,43 +332,358 @@ md5_get_digest(const guchar *buffer, gint buffer_size, guchar digest[16])
 
 }
 
+/*
+ * xxh64, a fast non-cryptographic hash by Yann Collet,
+ * see https://github.com/Cyan4973/xxHash for the specification.
+ */
+
+#define XXH64_PRIME1 G_GUINT64_CONSTANT(11400714785074694791)
+#define XXH64_PRIME2 G_GUINT64_CONSTANT(14029467366897019727)
+#define XXH64_PRIME3 G_GUINT64_CONSTANT(1609587929392839161)
+#define XXH64_PRIME4 G_GUINT64_CONSTANT(9650029242287828579)
+#define XXH64_PRIME5 G_GUINT64_CONSTANT(2870177450012600261)
+
+#define XXH64_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline guint64 xxh64_read64(const guchar *p)
+{
+	return (guint64)p[0] | (guint64)p[1] << 8 | (guint64)p[2] << 16 | (guint64)p[3] << 24 |
+	       (guint64)p[4] << 32 | (guint64)p[5] << 40 | (guint64)p[6] << 48 | (guint64)p[7] << 56;
+}
+
+static inline guint32 xxh64_read32(const guchar *p)
+{
+	return (guint32)p[0] | (guint32)p[1] << 8 | (guint32)p[2] << 16 | (guint32)p[3] << 24;
+}
+
+static inline guint64 xxh64_round(guint64 acc, guint64 input)
+{
+	acc += input * XXH64_PRIME2;
+	acc = XXH64_ROTL(acc, 31);
+	return acc * XXH64_PRIME1;
+}
+
+static inline guint64 xxh64_merge_round(guint64 acc, guint64 val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+void xxh64_init(XXH64Context *ctx, guint64 seed)
+{
+	ctx->v[0] = seed + XXH64_PRIME1 + XXH64_PRIME2;
+	ctx->v[1] = seed + XXH64_PRIME2;
+	ctx->v[2] = seed;
+	ctx->v[3] = seed - XXH64_PRIME1;
+	ctx->seed = seed;
+	ctx->total_len = 0;
+	ctx->mem_size = 0;
+}
+
+static inline void xxh64_stripe(XXH64Context *ctx, const guchar *p)
+{
+	ctx->v[0] = xxh64_round(ctx->v[0], xxh64_read64(p));
+	ctx->v[1] = xxh64_round(ctx->v[1], xxh64_read64(p + 8));
+	ctx->v[2] = xxh64_round(ctx->v[2], xxh64_read64(p + 16));
+	ctx->v[3] = xxh64_round(ctx->v[3], xxh64_read64(p + 24));
+}
+
+void xxh64_update(XXH64Context *ctx, const guchar *buf, gsize len)
+{
+	const guchar *end = buf + len;
+
+	ctx->total_len += len;
+
+	if (ctx->mem_size + len < 32)
+		{
+		memcpy(ctx->mem + ctx->mem_size, buf, len);
+		ctx->mem_size += len;
+		return;
+		}
+
+	if (ctx->mem_size)
+		{
+		gsize fill = 32 - ctx->mem_size;
+
+		memcpy(ctx->mem + ctx->mem_size, buf, fill);
+		xxh64_stripe(ctx, ctx->mem);
+		buf += fill;
+		ctx->mem_size = 0;
+		}
+
+	while (buf + 32 <= end)
+		{
+		xxh64_stripe(ctx, buf);
+		buf += 32;
+		}
+
+	if (buf < end)
+		{
+		memcpy(ctx->mem, buf, end - buf);
+		ctx->mem_size = end - buf;
+		}
+}
+
+guint64 xxh64_final(XXH64Context *ctx)
+{
+	const guchar *p = ctx->mem;
+	const guchar *end = ctx->mem + ctx->mem_size;
+	guint64 h;
+
+	if (ctx->total_len >= 32)
+		{
+		h = XXH64_ROTL(ctx->v[0], 1) + XXH64_ROTL(ctx->v[1], 7) +
+		    XXH64_ROTL(ctx->v[2], 12) + XXH64_ROTL(ctx->v[3], 18);
+		h = xxh64_merge_round(h, ctx->v[0]);
+		h = xxh64_merge_round(h, ctx->v[1]);
+		h = xxh64_merge_round(h, ctx->v[2]);
+		h = xxh64_merge_round(h, ctx->v[3]);
+		}
+	else
+		{
+		h = ctx->seed + XXH64_PRIME5;
+		}
+
+	h += ctx->total_len;
+
+	while (p + 8 <= end)
+		{
+		h ^= xxh64_round(0, xxh64_read64(p));
+		h = XXH64_ROTL(h, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+		p += 8;
+		}
+	if (p + 4 <= end)
+		{
+		h ^= (guint64)xxh64_read32(p) * XXH64_PRIME1;
+		h = XXH64_ROTL(h, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+		p += 4;
+		}
+	while (p < end)
+		{
+		h ^= (guint64)(*p) * XXH64_PRIME5;
+		h = XXH64_ROTL(h, 11) * XXH64_PRIME1;
+		p++;
+		}
+
+	h ^= h >> 33;
+	h *= XXH64_PRIME2;
+	h ^= h >> 29;
+	h *= XXH64_PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+/*
+ * digest of either type
+ */
+
+typedef struct _DigestContext DigestContext;
+struct _DigestContext
+{
+	DigestType type;
+	MD5Context md5;
+	XXH64Context xxh64;
+};
+
+static void digest_init(DigestContext *ctx, DigestType type)
+{
+	ctx->type = type;
+	if (type == DIGEST_TYPE_XXH64)
+		{
+		xxh64_init(&ctx->xxh64, 0);
+		}
+	else
+		{
+		md5_init(&ctx->md5);
+		}
+}
+
+static void digest_update(DigestContext *ctx, const guchar *buf, gsize len)
+{
+	if (ctx->type == DIGEST_TYPE_XXH64)
+		{
+		xxh64_update(&ctx->xxh64, buf, len);
+		}
+	else
+		{
+		md5_update(&ctx->md5, buf, len);
+		}
+}
+
+static void digest_final(DigestContext *ctx, guchar digest[16])
+{
+	if (ctx->type == DIGEST_TYPE_XXH64)
+		{
+		guint64 h = xxh64_final(&ctx->xxh64);
+		gint i;
+
+		/* big endian, as the xxhsum tool prints it */
+		for (i = 0; i < 8; i++)
+			{
+			digest[i] = (guchar)(h >> (56 - i * 8));
+			}
+		}
+	else
+		{
+		md5_final(&ctx->md5, digest);
+		}
+}
+
+gint digest_length(DigestType type)
+{
+	return (type == DIGEST_TYPE_XXH64) ? 8 : 16;
+}
+
+/* reads up to len bytes, only short at the end of the file */
+static gssize digest_read(gint fd, guchar *buf, gsize len)
+{
+	gsize done = 0;
+
+	while (done < len)
+		{
+		gssize n = read(fd, buf + done, len - done);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return -1;
+		if (n == 0) break;
+		done += n;
+		}
+
+	return done;
+}
+
+static gboolean digest_update_from_fd(DigestContext *ctx, gint fd, guchar *buf, gsize len, gboolean to_end)
+{
+	gssize n;
+
+	do
+		{
+		n = digest_read(fd, buf, len);
+		if (n < 0) return FALSE;
+		digest_update(ctx, buf, n);
+		} while (to_end && (gsize)n == len);
+
+	return TRUE;
+}
+
+static gint digest_open(const gchar *path)
+{
+	gint fd;
+
+	do
+		{
+		fd = open(path, O_RDONLY);
+		} while (fd < 0 && errno == EINTR);
+
+	return fd;
+}
+
 /* modified for GQView, starting here */
 
 /**
- * md5_get_digest_from_file: get the md5 hash of a file
+ * digest_get_from_file: get the hash of a file
+ * @type: digest type
  * @filename: file name
- * @digest: 16 bytes buffer receiving the hash code.
+ * @digest: 16 bytes buffer receiving the hash code, digest_length() of them are used.
  * @return: TRUE on success
  *
- * Get the md5 hash of a file. The result is put in
- * the 16 bytes buffer @digest .
+ * The file is read sequentially in big blocks, the hash is the throttle
+ * for md5, xxh64 keeps up with the disk.
  **/
-gboolean md5_get_digest_from_file(const gchar *path, guchar digest[16])
+gboolean digest_get_from_file(DigestType type, const gchar *path, guchar digest[16])
 {
-	MD5Context ctx;
-	guchar tmp_buf[1024];
-	gint nb_bytes_read;
-	FILE *fp;
-	gint success;
+	DigestContext ctx;
+	guchar *buf;
+	gint fd;
+	gboolean success;
 
-	fp = fopen(path, "r");
-	if (!fp) return FALSE;
+	fd = digest_open(path);
+	if (fd < 0) return FALSE;
 
-	md5_init(&ctx);
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	digest_init(&ctx, type);
+	buf = g_malloc(DIGEST_READ_BUFFER_SIZE);
+
+	success = digest_update_from_fd(&ctx, fd, buf, DIGEST_READ_BUFFER_SIZE, TRUE);
+
+	g_free(buf);
+	close(fd);
+	if (!success) return FALSE;
+
+	digest_final(&ctx, digest);
+	return TRUE;
+}
 
-	while ((nb_bytes_read = fread(tmp_buf, sizeof (guchar), sizeof(tmp_buf), fp)) > 0)
+/**
+ * digest_get_from_file_ends: get the hash of the ends of a file
+ * @type: digest type
+ * @filename: file name
+ * @length: bytes read from the start and from the end of the file
+ * @digest: 16 bytes buffer receiving the hash code, digest_length() of them are used.
+ * @return: TRUE on success
+ *
+ * Cheap fingerprint of a file, only files of the same size should be
+ * compared with it. Files up to twice @length are read completely,
+ * the digest is then the same as from digest_get_from_file().
+ **/
+gboolean digest_get_from_file_ends(DigestType type, const gchar *path, gsize length, guchar digest[16])
+{
+	DigestContext ctx;
+	guchar *buf;
+	off_t size;
+	gint fd;
+	gboolean success;
+
+	fd = digest_open(path);
+	if (fd < 0) return FALSE;
+
+	size = lseek(fd, 0, SEEK_END);
+	if (size < 0 || lseek(fd, 0, SEEK_SET) != 0)
 		{
-		md5_update(&ctx, tmp_buf, nb_bytes_read);
+		close(fd);
+		return FALSE;
 		}
 
-	success = (ferror(fp) == 0);
-	fclose(fp);
+	digest_init(&ctx, type);
+	buf = g_malloc(length);
+
+	if ((guint64)size > (guint64)length * 2)
+		{
+		success = (digest_update_from_fd(&ctx, fd, buf, length, FALSE) &&
+			   lseek(fd, size - length, SEEK_SET) == size - (off_t)length &&
+			   digest_update_from_fd(&ctx, fd, buf, length, FALSE));
+		}
+	else
+		{
+		success = digest_update_from_fd(&ctx, fd, buf, length, TRUE);
+		}
+
+	g_free(buf);
+	close(fd);
 	if (!success) return FALSE;
 
-	md5_final(&ctx, digest);
+	digest_final(&ctx, digest);
 	return TRUE;
 }
 
+/**
+ * md5_get_digest_from_file: get the md5 hash of a file
+ * @filename: file name
+ * @digest: 16 bytes buffer receiving the hash code.
+ * @return: TRUE on success
+ *
+ * Get the md5 hash of a file. The result is put in
+ * the 16 bytes buffer @digest .
+ **/
+gboolean md5_get_digest_from_file(const gchar *path, guchar digest[16])
+{
+	return digest_get_from_file(DIGEST_TYPE_MD5, path, digest);
+}
+
 /* these to and from text string converters were borrowed from
  * the libgnomeui library, where they are name thumb_digest_to/from_ascii
  *
@@ -372,35 +691,47 @@ gboolean md5_get_digest_from_file(const gchar *path, guchar digest[16])
  * and assumes a NULL terminated string.
  */
 
-gchar *md5_digest_to_text(guchar digest[16])
+gchar *digest_to_text(DigestType type, guchar digest[16])
 {
 	static gchar hex_digits[] = "0123456789abcdef";
+	gint len = digest_length(type);
 	gchar *result;
 	gint i;
 
-	result = g_malloc(33);
-	for (i = 0; i < 16; i++)
+	result = g_malloc(len * 2 + 1);
+	for (i = 0; i < len; i++)
 		{
 		result[2*i] = hex_digits[digest[i] >> 4];
 		result[2*i+1] = hex_digits[digest[i] & 0xf];
 		}
-	result[32] = '\0';
+	result[len * 2] = '\0';
 
 	return result;
 }
 
-gboolean md5_digest_from_text(const gchar *text, guchar digest[16])
+gboolean digest_from_text(DigestType type, const gchar *text, guchar digest[16])
 {
+	gint len = digest_length(type);
 	gint i;
 
-	for (i = 0; i < 16; i++)
+	for (i = 0; i < len; i++)
 		{
 		if (text[2*i] == '\0' || text[2*i+1] == '\0') return FALSE;
 		digest[i] = g_ascii_xdigit_value(text[2*i]) << 4 |
 			    g_ascii_xdigit_value(text[2*i + 1]);
-	}
+		}
 
 	return TRUE;
 }
 
+gchar *md5_digest_to_text(guchar digest[16])
+{
+	return digest_to_text(DIGEST_TYPE_MD5, digest);
+}
+
+gboolean md5_digest_from_text(const gchar *text, guchar digest[16])
+{
+	return digest_from_text(DIGEST_TYPE_MD5, text, digest);
+}
+
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
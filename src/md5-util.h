@@ -65,5 +65,38 @@ gchar *md5_digest_to_text(guchar digest[16]);
 gboolean md5_digest_from_text(const gchar *text, guchar digest[16]);
 
 
+typedef struct _XXH64Context {
+	guint64 v[4];
+	guint64 seed;
+	guint64 total_len;
+	guchar mem[32];
+	gsize mem_size;
+} XXH64Context;
+
+/* xxh64, much faster than md5 but not cryptographic */
+void xxh64_init(XXH64Context *ctx, guint64 seed);
+void xxh64_update(XXH64Context *ctx, const guchar *buf, gsize len);
+guint64 xxh64_final(XXH64Context *ctx);
+
+
+typedef enum {
+	DIGEST_TYPE_MD5,
+	DIGEST_TYPE_XXH64
+} DigestType;
+
+#define DIGEST_READ_BUFFER_SIZE (1024 * 1024)
+
+/* bytes of the digest, at most 16 */
+gint digest_length(DigestType type);
+
+/* generate digest from file, or from the first and last length bytes of a file */
+gboolean digest_get_from_file(DigestType type, const gchar *path, guchar digest[16]);
+gboolean digest_get_from_file_ends(DigestType type, const gchar *path, gsize length, guchar digest[16]);
+
+/* convert digest to/from a NULL terminated text string, in ascii encoding */
+gchar *digest_to_text(DigestType type, guchar digest[16]);
+gboolean digest_from_text(DigestType type, const gchar *text, guchar digest[16]);
+
+
 #endif	/* MD5_UTILS_H */
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -356,4 +356,143 @@ gchar *get_symbolic_link(const gchar *path_utf8)
 	return ret;
 }
 
+gint get_cpu_cores(void)
+{
+#if GLIB_CHECK_VERSION(2,36,0)
+	return g_get_num_processors();
+#else
+	glong cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (cores > 0) ? (gint)cores : 1;
+#endif
+}
+
+/*
+ * Work split in parts run by one pool of threads shared by the renderer,
+ * the caller waits for the parts of its batch. Parts pushed from one of
+ * the threads are run right away, they must not wait for each other.
+ */
+
+struct _ParallelBatch
+{
+	gint pending;			/* parts not done, under parallel_mutex */
+};
+
+#ifdef HAVE_GTHREAD
+typedef struct _ParallelTask ParallelTask;
+struct _ParallelTask
+{
+	GFunc func;
+	gpointer data;
+	ParallelBatch *batch;
+};
+
+static GThreadPool *parallel_pool = NULL;
+static GMutex *parallel_mutex = NULL;
+static GCond *parallel_cond = NULL;
+#if GLIB_CHECK_VERSION(2,32,0)
+static GPrivate parallel_worker = G_PRIVATE_INIT(NULL);
+#else
+static GPrivate *parallel_worker = NULL;
+#endif
+
+static void parallel_thread_run(gpointer data, gpointer user_data)
+{
+	ParallelTask *task = data;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_private_set(&parallel_worker, GINT_TO_POINTER(1));
+#else
+	g_private_set(parallel_worker, GINT_TO_POINTER(1));
+#endif
+
+	task->func(task->data, NULL);
+
+	g_mutex_lock(parallel_mutex);
+	task->batch->pending--;
+	if (task->batch->pending == 0) g_cond_broadcast(parallel_cond);
+	g_mutex_unlock(parallel_mutex);
+
+	g_free(task);
+}
+
+static GThreadPool *parallel_pool_get(void)
+{
+	static gsize init = 0;
+
+	if (g_once_init_enter(&init))
+		{
+#if GLIB_CHECK_VERSION(2,32,0)
+		parallel_mutex = g_new(GMutex, 1);
+		g_mutex_init(parallel_mutex);
+		parallel_cond = g_new(GCond, 1);
+		g_cond_init(parallel_cond);
+#else
+		parallel_mutex = g_mutex_new();
+		parallel_cond = g_cond_new();
+		parallel_worker = g_private_new(NULL);
+#endif
+		if (get_cpu_cores() > 1)
+			{
+			parallel_pool = g_thread_pool_new(parallel_thread_run, NULL, get_cpu_cores(), FALSE, NULL);
+			}
+		g_once_init_leave(&init, 1);
+		}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	if (g_private_get(&parallel_worker)) return NULL;
+#else
+	if (g_private_get(parallel_worker)) return NULL;
+#endif
+
+	return parallel_pool;
+}
+#endif
+
+ParallelBatch *parallel_batch_new(void)
+{
+	return g_new0(ParallelBatch, 1);
+}
+
+/* func is called with data and NULL, by the pool or right away */
+void parallel_batch_push(ParallelBatch *batch, GFunc func, gpointer data)
+{
+#ifdef HAVE_GTHREAD
+	GThreadPool *pool = parallel_pool_get();
+
+	if (pool)
+		{
+		ParallelTask *task = g_new(ParallelTask, 1);
+
+		task->func = func;
+		task->data = data;
+		task->batch = batch;
+
+		g_mutex_lock(parallel_mutex);
+		batch->pending++;
+		g_mutex_unlock(parallel_mutex);
+
+		g_thread_pool_push(pool, task, NULL);
+		return;
+		}
+#endif
+
+	func(data, NULL);
+}
+
+/* waits for all the parts of batch and frees it */
+void parallel_batch_wait(ParallelBatch *batch)
+{
+#ifdef HAVE_GTHREAD
+	if (parallel_mutex)
+		{
+		g_mutex_lock(parallel_mutex);
+		while (batch->pending > 0) g_cond_wait(parallel_cond, parallel_mutex);
+		g_mutex_unlock(parallel_mutex);
+		}
+#endif
+
+	g_free(batch);
+}
+
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -31,5 +31,12 @@ gint date_get_first_day_of_week();
 gchar *date_get_abbreviated_day_name(gint day);
 gchar *convert_rating_to_stars(gint rating);
 gchar *get_symbolic_link(const gchar *path_utf8);
+gint get_cpu_cores(void);
+
+typedef struct _ParallelBatch ParallelBatch;
+
+ParallelBatch *parallel_batch_new(void);
+void parallel_batch_push(ParallelBatch *batch, GFunc func, gpointer data);
+void parallel_batch_wait(ParallelBatch *batch);
 #endif /* MISC_H */
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -99,6 +99,8 @@ ConfOptions *init_options(ConfOptions *options)
 	options->image.alpha_color_2.green = 0x006666;
 	options->image.alpha_color_2.blue = 0x006666;
 	options->image.enable_read_ahead = TRUE;
+	options->image.read_ahead_count = 3;
+	options->image.read_ahead_behind = 1;
 	options->image.exif_rotate_enable = TRUE;
 	options->image.exif_proof_rotate_enable = TRUE;
 	options->image.fit_window_to_image = FALSE;
@@ -110,6 +112,8 @@ ConfOptions *init_options(ConfOptions *options)
 	options->image.scroll_reset_method = SCROLL_RESET_NOCHANGE;
 	options->image.tile_cache_max = 10;
 	options->image.image_cache_max = 128; /* 4 x 10MPix */
+	options->image.image_cache_compressed_max = 128;
+	options->image.tiled_view_min_size = 100;
 	options->image.use_custom_border_color = FALSE;
 	options->image.use_custom_border_color_in_fullscreen = TRUE;
 	options->image.zoom_2pass = TRUE;
@@ -176,6 +180,7 @@ ConfOptions *init_options(ConfOptions *options)
 	options->thumbnails.use_ft_metadata = TRUE;
 // 	options->thumbnails.use_ft_metadata_small = TRUE;
 	options->thumbnails.collection_preview = 20;
+	options->thumbnails.jobs = 0;
 
 	options->tree_descend_subdirs = FALSE;
 	options->view_dir_list_single_click_enter = TRUE;
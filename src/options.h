@@ -49,6 +49,7 @@ struct _ConfOptions
 	guint duplicates_similarity_threshold;
 	guint duplicates_match;
 	gboolean duplicates_thumbnails;
+	gboolean duplicates_fast_checksum;
 	guint duplicates_select_type;
 	gboolean rot_invariant_sim;
 	gboolean sort_totals;
@@ -118,7 +119,11 @@ struct _ConfOptions
 
 		gint tile_cache_max;	/* in megabytes */
 		gint image_cache_max;   /* in megabytes */
+		gint image_cache_compressed_max;	/* in megabytes */
+		gint tiled_view_min_size;	/* in megapixels, bigger images are shown in tiles, 0 disables */
 		gboolean enable_read_ahead;
+		gint read_ahead_count;	/* images preloaded in the browsing direction */
+		gint read_ahead_behind;	/* images preloaded in the other direction */
 
 		ZoomMode zoom_mode;
 		gboolean zoom_2pass;
@@ -146,6 +151,7 @@ struct _ConfOptions
 		gboolean use_exif;
 		gboolean use_ft_metadata;
 		gint collection_preview;
+		gint jobs;		/* thumbnails loaded at once by a file view, 0 is one per cpu core */
 // 		gboolean use_ft_metadata_small;
 	} thumbnails;
 
@@ -0,0 +1,568 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "main.h"
+#include "pixbuf-cache.h"
+
+#include <string.h>
+
+
+/*
+ *-------------------------------------------------------------------
+ * Entries are stored as the rows of the pixbuf without padding, each
+ * byte replaced by its difference to the same channel of the pixel on
+ * the left, deflated at the fastest level. The differences of photos
+ * are small numbers and compress much better than the pixels.
+ *-------------------------------------------------------------------
+ */
+
+#define PIXBUF_CACHE_RATIO_MAX 90	/* percent of the raw size, above it the entry is not worth it */
+#define PIXBUF_CACHE_JOBS_MAX 2		/* pixbufs held for compression, more are dropped */
+#define PIXBUF_CACHE_PRESSURE_INTERVAL 2000000	/* microseconds the memory state is reused */
+
+typedef struct _PixbufCacheEntry PixbufCacheEntry;
+struct _PixbufCacheEntry
+{
+	FileData *fd;
+	gint width;
+	gint height;
+	gboolean has_alpha;
+	guchar *data;
+	gsize len;
+};
+
+typedef struct _PixbufCacheJob PixbufCacheJob;
+struct _PixbufCacheJob
+{
+	PixbufCache *pc;
+	FileData *fd;
+	GdkPixbuf *pixbuf;
+	gsize limit;
+	gboolean cancelled;
+
+	PixbufCacheEntry *pe;	/* result, NULL when it did not compress well */
+};
+
+struct _PixbufCache
+{
+	GQueue queue;		/* PixbufCacheEntry, most recently used first */
+	GHashTable *table;	/* FileData -> its link in queue */
+	GHashTable *jobs;	/* FileData -> PixbufCacheJob being compressed */
+	gulong max_size;
+	gulong size;
+
+#ifdef HAVE_GTHREAD
+	GThreadPool *pool;
+#endif
+};
+
+static void pixbuf_cache_notify_cb(FileData *fd, NotifyType type, gpointer data);
+
+
+static void pixbuf_cache_filter_row(guchar *dest, const guchar *src, gsize len, gint n_channels)
+{
+	gsize i;
+
+	memcpy(dest, src, n_channels);
+	for (i = n_channels; i < len; i++)
+		{
+		dest[i] = (guchar)(src[i] - src[i - n_channels]);
+		}
+}
+
+static void pixbuf_cache_unfilter_row(guchar *row, gsize len, gint n_channels)
+{
+	gsize i;
+
+	for (i = n_channels; i < len; i++)
+		{
+		row[i] = (guchar)(row[i] + row[i - n_channels]);
+		}
+}
+
+static PixbufCacheEntry *pixbuf_cache_compress(GdkPixbuf *pixbuf, gsize limit)
+{
+	PixbufCacheEntry *pe;
+	GConverter *conv;
+	const guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+	gint width = gdk_pixbuf_get_width(pixbuf);
+	gint height = gdk_pixbuf_get_height(pixbuf);
+	gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	gint n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+	gsize row_len = (gsize)width * n_channels;
+	gsize out_size;
+	gsize out_len = 0;
+	guchar *out;
+	guchar *row;
+	gboolean ok = TRUE;
+	gint y;
+
+	out_size = MIN(limit, row_len * height / 4 + 1024);
+	out = g_malloc(out_size);
+	row = g_malloc(row_len);
+	conv = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+
+	for (y = 0; y < height && ok; y++)
+		{
+		GConverterFlags flags = (y == height - 1) ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS;
+		GConverterResult res = G_CONVERTER_CONVERTED;
+		gsize row_pos = 0;
+
+		pixbuf_cache_filter_row(row, pixels + (gsize)y * rowstride, row_len, n_channels);
+
+		do
+			{
+			gsize bytes_read;
+			gsize bytes_written;
+
+			if (out_len == out_size)
+				{
+				if (out_size == limit)
+					{
+					ok = FALSE;
+					break;
+					}
+				out_size = MIN(limit, out_size * 2);
+				out = g_realloc(out, out_size);
+				}
+
+			res = g_converter_convert(conv, row + row_pos, row_len - row_pos,
+						  out + out_len, out_size - out_len,
+						  flags, &bytes_read, &bytes_written, NULL);
+			if (res == G_CONVERTER_ERROR)
+				{
+				ok = FALSE;
+				break;
+				}
+
+			row_pos += bytes_read;
+			out_len += bytes_written;
+			} while (row_pos < row_len || (flags == G_CONVERTER_INPUT_AT_END && res != G_CONVERTER_FINISHED));
+		}
+
+	g_object_unref(conv);
+	g_free(row);
+
+	if (!ok)
+		{
+		g_free(out);
+		return NULL;
+		}
+
+	pe = g_new0(PixbufCacheEntry, 1);
+	pe->width = width;
+	pe->height = height;
+	pe->has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+	pe->data = g_realloc(out, out_len);
+	pe->len = out_len;
+
+	return pe;
+}
+
+static GdkPixbuf *pixbuf_cache_decompress(PixbufCacheEntry *pe)
+{
+	GdkPixbuf *pixbuf;
+	GConverter *conv;
+	guchar *pixels;
+	gint rowstride;
+	gint n_channels;
+	gsize row_len;
+	gsize in_pos = 0;
+	gboolean ok = TRUE;
+	gint y;
+
+	pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, pe->has_alpha, 8, pe->width, pe->height);
+	if (!pixbuf) return NULL;
+
+	pixels = gdk_pixbuf_get_pixels(pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+	row_len = (gsize)pe->width * n_channels;
+
+	conv = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+
+	for (y = 0; y < pe->height && ok; y++)
+		{
+		guchar *row = pixels + (gsize)y * rowstride;
+		gsize row_pos = 0;
+
+		while (row_pos < row_len)
+			{
+			GConverterResult res;
+			gsize bytes_read;
+			gsize bytes_written;
+
+			res = g_converter_convert(conv, pe->data + in_pos, pe->len - in_pos,
+						  row + row_pos, row_len - row_pos,
+						  G_CONVERTER_INPUT_AT_END, &bytes_read, &bytes_written, NULL);
+			in_pos += bytes_read;
+			row_pos += bytes_written;
+
+			if (res == G_CONVERTER_ERROR ||
+			    (res == G_CONVERTER_FINISHED && row_pos < row_len))
+				{
+				ok = FALSE;
+				break;
+				}
+			}
+
+		pixbuf_cache_unfilter_row(row, row_len, n_channels);
+		}
+
+	g_object_unref(conv);
+
+	if (!ok)
+		{
+		g_object_unref(pixbuf);
+		return NULL;
+		}
+
+	return pixbuf;
+}
+
+/*
+ *-------------------------------------------------------------------
+ * cache
+ *-------------------------------------------------------------------
+ */
+
+static gulong pixbuf_cache_entry_size(PixbufCacheEntry *pe)
+{
+	return pe->len + sizeof(PixbufCacheEntry);
+}
+
+static void pixbuf_cache_entry_free(PixbufCacheEntry *pe)
+{
+	if (pe->fd) file_data_unref(pe->fd);
+	g_free(pe->data);
+	g_free(pe);
+}
+
+static void pixbuf_cache_entry_drop(PixbufCache *pc, GList *link)
+{
+	PixbufCacheEntry *pe = link->data;
+
+	g_hash_table_remove(pc->table, pe->fd);
+	g_queue_delete_link(&pc->queue, link);
+	pc->size -= pixbuf_cache_entry_size(pe);
+	pixbuf_cache_entry_free(pe);
+}
+
+static void pixbuf_cache_check_limits(PixbufCache *pc)
+{
+	while (pc->size > pc->max_size && pc->queue.tail)
+		{
+		DEBUG_2("pixbuf cache: drop %s", ((PixbufCacheEntry *)pc->queue.tail->data)->fd->path);
+		pixbuf_cache_entry_drop(pc, pc->queue.tail);
+		}
+}
+
+static void pixbuf_cache_insert(PixbufCache *pc, FileData *fd, PixbufCacheEntry *pe)
+{
+	GList *link;
+
+	link = g_hash_table_lookup(pc->table, fd);
+	if (link) pixbuf_cache_entry_drop(pc, link);
+
+	pe->fd = file_data_ref(fd);
+	g_queue_push_head(&pc->queue, pe);
+	g_hash_table_insert(pc->table, fd, pc->queue.head);
+	pc->size += pixbuf_cache_entry_size(pe);
+
+	DEBUG_1("pixbuf cache: %s %dx%d stored in %lu bytes, cache %lu / %lu",
+		fd->path, pe->width, pe->height, (gulong)pe->len, pc->size, pc->max_size);
+
+	pixbuf_cache_check_limits(pc);
+}
+
+static void pixbuf_cache_job_free(PixbufCacheJob *job)
+{
+	if (job->pe) pixbuf_cache_entry_free(job->pe);
+	file_data_unref(job->fd);
+	g_object_unref(job->pixbuf);
+	g_free(job);
+}
+
+static void pixbuf_cache_job_done(PixbufCacheJob *job)
+{
+	PixbufCache *pc = job->pc;
+
+	if (!job->cancelled)
+		{
+		g_hash_table_remove(pc->jobs, job->fd);
+		if (job->pe)
+			{
+			pixbuf_cache_insert(pc, job->fd, job->pe);
+			job->pe = NULL;
+			}
+		}
+
+	pixbuf_cache_job_free(job);
+}
+
+#ifdef HAVE_GTHREAD
+static gboolean pixbuf_cache_job_done_cb(gpointer data)
+{
+	pixbuf_cache_job_done(data);
+	return FALSE;
+}
+
+static void pixbuf_cache_thread_run(gpointer data, gpointer user_data)
+{
+	PixbufCacheJob *job = data;
+
+	job->pe = pixbuf_cache_compress(job->pixbuf, job->limit);
+	g_idle_add(pixbuf_cache_job_done_cb, job);
+}
+#endif
+
+PixbufCache *pixbuf_cache_new(gulong max_size)
+{
+	PixbufCache *pc = g_new0(PixbufCache, 1);
+
+	g_queue_init(&pc->queue);
+	pc->table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pc->jobs = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pc->max_size = max_size;
+
+#ifdef HAVE_GTHREAD
+	/* images are evicted one at a time, one thread keeps up with it */
+	pc->pool = g_thread_pool_new(pixbuf_cache_thread_run, NULL, 1, FALSE, NULL);
+#endif
+
+	file_data_register_notify_func(pixbuf_cache_notify_cb, pc, NOTIFY_PRIORITY_LOW);
+
+	return pc;
+}
+
+void pixbuf_cache_set_max_size(PixbufCache *pc, gulong size)
+{
+	pc->max_size = size;
+	pixbuf_cache_check_limits(pc);
+}
+
+gulong pixbuf_cache_get_size(PixbufCache *pc)
+{
+	return pc->size;
+}
+
+void pixbuf_cache_put(PixbufCache *pc, FileData *fd, GdkPixbuf *pixbuf)
+{
+	PixbufCacheJob *job;
+	gsize raw;
+
+	pixbuf_cache_remove(pc, fd);
+
+	if (!pixbuf || pc->max_size == 0) return;
+	if (g_hash_table_size(pc->jobs) >= PIXBUF_CACHE_JOBS_MAX) return;
+
+	if (gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB ||
+	    gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 ||
+	    gdk_pixbuf_get_n_channels(pixbuf) != (gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3)) return;
+
+	raw = (gsize)gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_n_channels(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+
+	job = g_new0(PixbufCacheJob, 1);
+	job->pc = pc;
+	job->fd = file_data_ref(fd);
+	job->pixbuf = g_object_ref(pixbuf);
+	job->limit = MIN(raw / 100 * PIXBUF_CACHE_RATIO_MAX, pc->max_size);
+
+	g_hash_table_insert(pc->jobs, fd, job);
+
+#ifdef HAVE_GTHREAD
+	g_thread_pool_push(pc->pool, job, NULL);
+#else
+	job->pe = pixbuf_cache_compress(job->pixbuf, job->limit);
+	pixbuf_cache_job_done(job);
+#endif
+}
+
+GdkPixbuf *pixbuf_cache_get(PixbufCache *pc, FileData *fd)
+{
+	GdkPixbuf *pixbuf;
+	GList *link;
+
+	link = g_hash_table_lookup(pc->table, fd);
+	if (!link) return NULL;
+
+	if (file_data_check_changed_files(fd))
+		{
+		/* file has been changed, cache entry is no longer valid */
+		pixbuf_cache_remove(pc, fd);
+		DEBUG_1("pixbuf cache: changed %s", fd->path);
+		return NULL;
+		}
+
+	pixbuf = pixbuf_cache_decompress(link->data);
+	pixbuf_cache_entry_drop(pc, link);
+
+	DEBUG_1("pixbuf cache: %s %s", pixbuf ? "restored" : "failed to restore", fd->path);
+	return pixbuf;
+}
+
+gboolean pixbuf_cache_has(PixbufCache *pc, FileData *fd)
+{
+	return g_hash_table_lookup(pc->table, fd) || g_hash_table_lookup(pc->jobs, fd);
+}
+
+void pixbuf_cache_remove(PixbufCache *pc, FileData *fd)
+{
+	PixbufCacheJob *job;
+	GList *link;
+
+	job = g_hash_table_lookup(pc->jobs, fd);
+	if (job)
+		{
+		/* it finishes anyway, the result is dropped */
+		job->cancelled = TRUE;
+		g_hash_table_remove(pc->jobs, fd);
+		}
+
+	link = g_hash_table_lookup(pc->table, fd);
+	if (link) pixbuf_cache_entry_drop(pc, link);
+}
+
+static void pixbuf_cache_notify_cb(FileData *fd, NotifyType type, gpointer data)
+{
+	PixbufCache *pc = data;
+
+	if (type & (NOTIFY_REREAD | NOTIFY_CHANGE)) /* invalidate the entry on each file change */
+		{
+		pixbuf_cache_remove(pc, fd);
+		}
+}
+
+/*
+ *-------------------------------------------------------------------
+ * memory pressure
+ *-------------------------------------------------------------------
+ */
+
+/* share of the last 10 seconds some tasks were stalled on memory, in percent */
+static gdouble pixbuf_cache_memory_stall(void)
+{
+	gchar *text;
+	gdouble avg10 = 0.0;
+
+	if (g_file_get_contents("/proc/pressure/memory", &text, NULL, NULL))
+		{
+		gchar *p = strstr(text, "some avg10=");
+
+		if (p) avg10 = g_ascii_strtod(p + strlen("some avg10="), NULL);
+		g_free(text);
+		}
+
+	return avg10;
+}
+
+static const gchar *pixbuf_cache_cgroup_dir(void)
+{
+	static gchar *dir = NULL;
+	static gboolean done = FALSE;
+	gchar *text;
+
+	if (done) return dir;
+	done = TRUE;
+
+	if (g_file_get_contents("/proc/self/cgroup", &text, NULL, NULL))
+		{
+		gchar **lines = g_strsplit(text, "\n", -1);
+		gint i;
+
+		for (i = 0; lines[i]; i++)
+			{
+			/* the unified hierarchy of cgroup v2 */
+			if (g_str_has_prefix(lines[i], "0::"))
+				{
+				dir = g_build_filename("/sys/fs/cgroup", lines[i] + 3, NULL);
+				break;
+				}
+			}
+
+		g_strfreev(lines);
+		g_free(text);
+		}
+
+	return dir;
+}
+
+static guint64 pixbuf_cache_cgroup_read(const gchar *dir, const gchar *name)
+{
+	gchar *path;
+	gchar *text;
+	guint64 value = 0;
+
+	path = g_build_filename(dir, name, NULL);
+	if (g_file_get_contents(path, &text, NULL, NULL))
+		{
+		value = g_ascii_strtoull(text, NULL, 10); /* "max" reads as 0 */
+		g_free(text);
+		}
+	g_free(path);
+
+	return value;
+}
+
+/* percentage of the cgroup memory limit in use, 0 when there is no limit */
+static gint pixbuf_cache_cgroup_usage(void)
+{
+	const gchar *dir = pixbuf_cache_cgroup_dir();
+	guint64 max;
+
+	if (!dir) return 0;
+
+	max = pixbuf_cache_cgroup_read(dir, "memory.max");
+	if (max == 0) return 0;
+
+	return (gint)MIN(pixbuf_cache_cgroup_read(dir, "memory.current") * 100 / max, 100);
+}
+
+gint pixbuf_cache_memory_percent(void)
+{
+	static gint percent = 100;
+	static gint64 last = 0;
+	gint64 now = g_get_monotonic_time();
+	gdouble stall;
+	gint usage;
+	gint old;
+
+	if (last && now - last < PIXBUF_CACHE_PRESSURE_INTERVAL) return percent;
+	last = now;
+
+	stall = pixbuf_cache_memory_stall();
+	usage = pixbuf_cache_cgroup_usage();
+
+	old = percent;
+	if (stall >= 10.0 || usage >= 95)
+		percent = 25;
+	else if (stall >= 2.0 || usage >= 90)
+		percent = 50;
+	else if (stall >= 0.5 || usage >= 80)
+		percent = 75;
+	else
+		percent = 100;
+
+	if (percent != old)
+		{
+		DEBUG_1("memory pressure: stall %.2f%%, cgroup usage %d%%, image caches at %d%%", stall, usage, percent);
+		}
+
+	return percent;
+}
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
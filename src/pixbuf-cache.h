@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2008 - 2016 The Geeqie Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PIXBUF_CACHE_H
+#define PIXBUF_CACHE_H
+
+#include "filedata.h"
+
+/*
+ * Losslessly compressed pixbufs by FileData, least recently used are
+ * dropped first. Holds the images evicted from the decoded image cache,
+ * getting one back is much faster than decoding the file again.
+ */
+
+typedef struct _PixbufCache PixbufCache;
+
+PixbufCache *pixbuf_cache_new(gulong max_size);
+void pixbuf_cache_set_max_size(PixbufCache *pc, gulong size);
+gulong pixbuf_cache_get_size(PixbufCache *pc);
+
+/* stores a copy of pixbuf for fd, compressed in the background */
+void pixbuf_cache_put(PixbufCache *pc, FileData *fd, GdkPixbuf *pixbuf);
+
+/* returns a new pixbuf for fd and drops it from the cache, or NULL */
+GdkPixbuf *pixbuf_cache_get(PixbufCache *pc, FileData *fd);
+gboolean pixbuf_cache_has(PixbufCache *pc, FileData *fd);
+void pixbuf_cache_remove(PixbufCache *pc, FileData *fd);
+
+/* percentage of their configured size the image caches should use,
+ * below 100 when the system or the cgroup is short of memory
+ */
+gint pixbuf_cache_memory_percent(void);
+
+#endif
+/* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
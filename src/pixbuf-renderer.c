@@ -42,6 +42,7 @@
 
 #ifdef GQ_BUILD
 #include "main.h"
+#include "misc.h"
 #include "pixbuf_util.h"
 #include "exif.h"
 #else
@@ -134,6 +135,10 @@ static void pr_scroller_timer_set(PixbufRenderer *pr, gboolean start);
 
 
 static void pr_source_tile_free_all(PixbufRenderer *pr);
+static void pr_pyramid_free(PixbufRenderer *pr);
+static void pr_source_tile_take(PixbufRenderer *pr, PixbufRenderer *source);
+static guint pr_source_tile_hash(gconstpointer key);
+static gboolean pr_source_tile_equal(gconstpointer a, gconstpointer b);
 
 static void pr_zoom_sync(PixbufRenderer *pr, gdouble zoom,
 			 PrZoomFlags flags, gint px, gint py);
@@ -437,7 +442,9 @@ static void pixbuf_renderer_init(PixbufRenderer *pr)
 	pr->y_mouse = -1;
 
 	pr->source_tiles_enabled = FALSE;
-	pr->source_tiles = NULL;
+	pr->source_tile_shrink = 1;
+	g_queue_init(&pr->source_tiles);
+	pr->source_tile_table = g_hash_table_new(pr_source_tile_hash, pr_source_tile_equal);
 
 	pr->orientation = 1;
 
@@ -477,6 +484,8 @@ static void pixbuf_renderer_finalize(GObject *object)
 	pr_scroller_timer_set(pr, FALSE);
 
 	pr_source_tile_free_all(pr);
+	g_hash_table_destroy(pr->source_tile_table);
+	pr_pyramid_free(pr);
 }
 
 PixbufRenderer *pixbuf_renderer_new(void)
@@ -953,11 +962,28 @@ static void pr_source_tile_free(SourceTile *st)
 	g_free(st);
 }
 
+static guint pr_source_tile_hash(gconstpointer key)
+{
+	const SourceTile *st = key;
+
+	return (guint)st->x * 65599 + (guint)st->y;
+}
+
+static gboolean pr_source_tile_equal(gconstpointer a, gconstpointer b)
+{
+	const SourceTile *sta = a;
+	const SourceTile *stb = b;
+
+	return sta->x == stb->x && sta->y == stb->y;
+}
+
 static void pr_source_tile_free_all(PixbufRenderer *pr)
 {
 	GList *work;
 
-	work = pr->source_tiles;
+	g_hash_table_remove_all(pr->source_tile_table);
+
+	work = pr->source_tiles.head;
 	while (work)
 		{
 		SourceTile *st;
@@ -968,8 +994,22 @@ static void pr_source_tile_free_all(PixbufRenderer *pr)
 		pr_source_tile_free(st);
 		}
 
-	g_list_free(pr->source_tiles);
-	pr->source_tiles = NULL;
+	g_queue_init(&pr->source_tiles);
+}
+
+/* moves the source tiles of source to pr */
+static void pr_source_tile_take(PixbufRenderer *pr, PixbufRenderer *source)
+{
+	GHashTable *table;
+
+	pr_source_tile_free_all(pr);
+
+	pr->source_tiles = source->source_tiles;
+	g_queue_init(&source->source_tiles);
+
+	table = pr->source_tile_table;
+	pr->source_tile_table = source->source_tile_table;
+	source->source_tile_table = table;
 }
 
 static void pr_source_tile_unset(PixbufRenderer *pr)
@@ -994,9 +1034,9 @@ static gboolean pr_source_tile_visible(PixbufRenderer *pr, SourceTile *st)
 	y2 = pr->y_scroll + pr->vis_height;
 
 	return !((gdouble)st->x * pr->scale > (gdouble)x2 ||
-		 (gdouble)(st->x + pr->source_tile_width) * pr->scale < (gdouble)x1 ||
+		 (gdouble)(st->x + pr->source_tile_width * pr->source_tile_shrink) * pr->scale < (gdouble)x1 ||
 		 (gdouble)st->y * pr->scale > (gdouble)y2 ||
-		 (gdouble)(st->y + pr->source_tile_height) * pr->scale < (gdouble)y1);
+		 (gdouble)(st->y + pr->source_tile_height * pr->source_tile_shrink) * pr->scale < (gdouble)y1);
 }
 
 static SourceTile *pr_source_tile_new(PixbufRenderer *pr, gint x, gint y)
@@ -1008,12 +1048,12 @@ static SourceTile *pr_source_tile_new(PixbufRenderer *pr, gint x, gint y)
 
 	if (pr->source_tiles_cache_size < 4) pr->source_tiles_cache_size = 4;
 
-	count = g_list_length(pr->source_tiles);
+	count = pr->source_tiles.length;
 	if (count >= pr->source_tiles_cache_size)
 		{
 		GList *work;
 
-		work = g_list_last(pr->source_tiles);
+		work = pr->source_tiles.tail;
 		while (work && count >= pr->source_tiles_cache_size)
 			{
 			SourceTile *needle;
@@ -1023,7 +1063,8 @@ static SourceTile *pr_source_tile_new(PixbufRenderer *pr, gint x, gint y)
 
 			if (!pr_source_tile_visible(pr, needle))
 				{
-				pr->source_tiles = g_list_remove(pr->source_tiles, needle);
+				g_hash_table_remove(pr->source_tile_table, needle);
+				g_queue_unlink(&pr->source_tiles, &needle->link);
 
 				if (pr->func_tile_dispose)
 					{
@@ -1053,11 +1094,13 @@ static SourceTile *pr_source_tile_new(PixbufRenderer *pr, gint x, gint y)
 					    pr->source_tile_width, pr->source_tile_height);
 		}
 
-	st->x = ROUND_DOWN(x, pr->source_tile_width);
-	st->y = ROUND_DOWN(y, pr->source_tile_height);
+	st->x = ROUND_DOWN(x, pr->source_tile_width * pr->source_tile_shrink);
+	st->y = ROUND_DOWN(y, pr->source_tile_height * pr->source_tile_shrink);
 	st->blank = TRUE;
 
-	pr->source_tiles = g_list_prepend(pr->source_tiles, st);
+	st->link.data = st;
+	g_queue_push_head_link(&pr->source_tiles, &st->link);
+	g_hash_table_insert(pr->source_tile_table, st, st);
 
 	return st;
 }
@@ -1065,48 +1108,62 @@ static SourceTile *pr_source_tile_new(PixbufRenderer *pr, gint x, gint y)
 static SourceTile *pr_source_tile_request(PixbufRenderer *pr, gint x, gint y)
 {
 	SourceTile *st;
+	gint w = pr->source_tile_width * pr->source_tile_shrink;
+	gint h = pr->source_tile_height * pr->source_tile_shrink;
 
 	st = pr_source_tile_new(pr, x, y);
 	if (!st) return NULL;
 
 	if (pr->func_tile_request &&
-	    pr->func_tile_request(pr, st->x, st->y,
-				   pr->source_tile_width, pr->source_tile_height, st->pixbuf, pr->func_tile_data))
+	    pr->func_tile_request(pr, st->x, st->y, w, h, st->pixbuf, pr->func_tile_data))
 		{
 		st->blank = FALSE;
 		}
 
 	pr->renderer->invalidate_region(pr->renderer, st->x * pr->scale, st->y * pr->scale,
-				  pr->source_tile_width * pr->scale, pr->source_tile_height * pr->scale);
+				  w * pr->scale, h * pr->scale);
 	if (pr->renderer2) pr->renderer2->invalidate_region(pr->renderer2, st->x * pr->scale, st->y * pr->scale,
-				  pr->source_tile_width * pr->scale, pr->source_tile_height * pr->scale);
+				  w * pr->scale, h * pr->scale);
 	return st;
 }
 
 static SourceTile *pr_source_tile_find(PixbufRenderer *pr, gint x, gint y)
 {
-	GList *work;
+	SourceTile key;
+	SourceTile *st;
 
-	work = pr->source_tiles;
-	while (work)
+	if (pr->source_tile_width < 1 || pr->source_tile_height < 1) return NULL;
+
+	key.x = ROUND_DOWN(x, pr->source_tile_width * pr->source_tile_shrink);
+	key.y = ROUND_DOWN(y, pr->source_tile_height * pr->source_tile_shrink);
+	st = g_hash_table_lookup(pr->source_tile_table, &key);
+	if (st && st->link.prev)
 		{
-		SourceTile *st = work->data;
+		g_queue_unlink(&pr->source_tiles, &st->link);
+		g_queue_push_head_link(&pr->source_tiles, &st->link);
+		}
 
-		if (x >= st->x && x < st->x + pr->source_tile_width &&
-		    y >= st->y && y < st->y + pr->source_tile_height)
-			{
-			if (work != pr->source_tiles)
-				{
-				pr->source_tiles = g_list_remove_link(pr->source_tiles, work);
-				pr->source_tiles = g_list_concat(work, pr->source_tiles);
-				}
-			return st;
-			}
+	return st;
+}
 
-		work = work->next;
+/* picks the reduction of the source tiles for the current scale,
+ * dropping the tiles when it changes
+ */
+static void pr_source_tile_shrink_sync(PixbufRenderer *pr)
+{
+	gint shrink = 1;
+
+	if (pr->source_tiles_reduced)
+		{
+		while (shrink < PR_SOURCE_TILE_SHRINK_MAX && pr->scale * shrink * 2 <= 1.0) shrink *= 2;
 		}
 
-	return NULL;
+	if (shrink == pr->source_tile_shrink) return;
+
+	DEBUG_1("source tiles reduced 1:%d", shrink);
+
+	pr_source_tile_free_all(pr);
+	pr->source_tile_shrink = shrink;
 }
 
 GList *pr_source_tile_compute_region(PixbufRenderer *pr, gint x, gint y, gint w, gint h, gboolean request)
@@ -1114,18 +1171,23 @@ GList *pr_source_tile_compute_region(PixbufRenderer *pr, gint x, gint y, gint w,
 	gint x1, y1;
 	GList *list = NULL;
 	gint sx, sy;
+	gint tile_w, tile_h;
+
+	pr_source_tile_shrink_sync(pr);
+	tile_w = pr->source_tile_width * pr->source_tile_shrink;
+	tile_h = pr->source_tile_height * pr->source_tile_shrink;
 
 	if (x < 0) x = 0;
 	if (y < 0) y = 0;
 	if (w > pr->image_width) w = pr->image_width;
 	if (h > pr->image_height) h = pr->image_height;
 
-	sx = ROUND_DOWN(x, pr->source_tile_width);
-	sy = ROUND_DOWN(y, pr->source_tile_height);
+	sx = ROUND_DOWN(x, tile_w);
+	sy = ROUND_DOWN(y, tile_h);
 
-	for (x1 = sx; x1 < x + w; x1+= pr->source_tile_width)
+	for (x1 = sx; x1 < x + w; x1+= tile_w)
 		{
-		for (y1 = sy; y1 < y + h; y1 += pr->source_tile_height)
+		for (y1 = sy; y1 < y + h; y1 += tile_h)
 			{
 			SourceTile *st;
 
@@ -1142,10 +1204,11 @@ GList *pr_source_tile_compute_region(PixbufRenderer *pr, gint x, gint y, gint w,
 static void pr_source_tile_changed(PixbufRenderer *pr, gint x, gint y, gint width, gint height)
 {
 	GList *work;
+	gint shrink = pr->source_tile_shrink;
 
 	if (width < 1 || height < 1) return;
 
-	work = pr->source_tiles;
+	work = pr->source_tiles.head;
 	while (work)
 		{
 		SourceTile *st;
@@ -1154,13 +1217,14 @@ static void pr_source_tile_changed(PixbufRenderer *pr, gint x, gint y, gint widt
 		st = work->data;
 		work = work->next;
 
-		if (pr_clip_region(st->x, st->y, pr->source_tile_width, pr->source_tile_height,
+		if (pr_clip_region(st->x, st->y, pr->source_tile_width * shrink, pr->source_tile_height * shrink,
 				   x, y, width, height,
 				   &rx, &ry, &rw, &rh))
 			{
 			GdkPixbuf *pixbuf;
 
-			pixbuf = gdk_pixbuf_new_subpixbuf(st->pixbuf, rx - st->x, ry - st->y, rw, rh);
+			pixbuf = gdk_pixbuf_new_subpixbuf(st->pixbuf, (rx - st->x) / shrink, (ry - st->y) / shrink,
+							  MAX(rw / shrink, 1), MAX(rh / shrink, 1));
 			if (pr->func_tile_request &&
 			    pr->func_tile_request(pr, rx, ry, rw, rh, pixbuf, pr->func_tile_data))
 				{
@@ -1174,6 +1238,148 @@ static void pr_source_tile_changed(PixbufRenderer *pr, gint x, gint y, gint widt
 		}
 }
 
+/*
+ *-------------------------------------------------------------------
+ * zoom pyramid
+ *-------------------------------------------------------------------
+ */
+
+#ifdef HAVE_GTHREAD
+typedef struct _PyramidBand PyramidBand;
+struct _PyramidBand
+{
+	GdkPixbuf *src;
+	GdkPixbuf *dest;
+	gint x;
+	gint y;
+	gint w;
+	gint h;
+};
+
+static void pr_pyramid_band_run(gpointer data, gpointer user_data)
+{
+	PyramidBand *band = data;
+	gdouble scale_x = (gdouble)gdk_pixbuf_get_width(band->dest) / gdk_pixbuf_get_width(band->src);
+	gdouble scale_y = (gdouble)gdk_pixbuf_get_height(band->dest) / gdk_pixbuf_get_height(band->src);
+
+	gdk_pixbuf_scale(band->src, band->dest, band->x, band->y, band->w, band->h,
+			 0.0, 0.0, scale_x, scale_y, GDK_INTERP_BILINEAR);
+}
+#endif
+
+/* scales src to fill the area of dest, in bands by several threads */
+static void pr_pyramid_scale(GdkPixbuf *src, GdkPixbuf *dest, gint x, gint y, gint w, gint h)
+{
+#ifdef HAVE_GTHREAD
+	ParallelBatch *batch;
+	PyramidBand *bands;
+	gint threads = CLAMP(get_cpu_cores(), 1, h);
+	gint band_h = (h + threads - 1) / threads;
+	gint i;
+
+	bands = g_new0(PyramidBand, threads);
+	batch = parallel_batch_new();
+	for (i = 0; i < threads && i * band_h < h; i++)
+		{
+		bands[i].src = src;
+		bands[i].dest = dest;
+		bands[i].x = x;
+		bands[i].y = y + i * band_h;
+		bands[i].w = w;
+		bands[i].h = MIN(band_h, h - i * band_h);
+		parallel_batch_push(batch, pr_pyramid_band_run, &bands[i]);
+		}
+	parallel_batch_wait(batch);
+	g_free(bands);
+#else
+	gdk_pixbuf_scale(src, dest, x, y, w, h, 0.0, 0.0,
+			 (gdouble)gdk_pixbuf_get_width(dest) / gdk_pixbuf_get_width(src),
+			 (gdouble)gdk_pixbuf_get_height(dest) / gdk_pixbuf_get_height(src),
+			 GDK_INTERP_BILINEAR);
+#endif
+}
+
+/* the next level of the pyramid, src reduced to half its size */
+static GdkPixbuf *pr_pyramid_level_new(GdkPixbuf *src)
+{
+	GdkPixbuf *dest;
+	gint w = MAX(1, (gdk_pixbuf_get_width(src) + 1) / 2);
+	gint h = MAX(1, (gdk_pixbuf_get_height(src) + 1) / 2);
+
+	dest = gdk_pixbuf_new(GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha(src), 8, w, h);
+	if (dest) pr_pyramid_scale(src, dest, 0, 0, w, h);
+
+	return dest;
+}
+
+static void pr_pyramid_free(PixbufRenderer *pr)
+{
+	gint i;
+
+	for (i = 0; i < PR_PYRAMID_LEVELS; i++)
+		{
+		if (pr->pyramid[i]) g_object_unref(pr->pyramid[i]);
+		pr->pyramid[i] = NULL;
+		}
+}
+
+/* scales the changed area of the image again into the levels built so far */
+static void pr_pyramid_area_changed(PixbufRenderer *pr, gint x, gint y, gint w, gint h)
+{
+	GdkPixbuf *src = pr->pixbuf;
+	gint i;
+
+	for (i = 0; i < PR_PYRAMID_LEVELS && pr->pyramid[i]; i++)
+		{
+		GdkPixbuf *dest = pr->pyramid[i];
+		gdouble scale_x = (gdouble)gdk_pixbuf_get_width(dest) / gdk_pixbuf_get_width(src);
+		gdouble scale_y = (gdouble)gdk_pixbuf_get_height(dest) / gdk_pixbuf_get_height(src);
+		gint x1;
+		gint y1;
+
+		/* the bilinear filter reaches one pixel further */
+		x1 = MIN(gdk_pixbuf_get_width(dest), (gint)ceil((x + w) * scale_x) + 1);
+		y1 = MIN(gdk_pixbuf_get_height(dest), (gint)ceil((y + h) * scale_y) + 1);
+		x = MAX(0, (gint)floor(x * scale_x) - 1);
+		y = MAX(0, (gint)floor(y * scale_y) - 1);
+		if (x1 <= x || y1 <= y) return;
+		w = x1 - x;
+		h = y1 - y;
+
+		pr_pyramid_scale(src, dest, x, y, w, h);
+		src = dest;
+		}
+}
+
+GdkPixbuf *pr_pyramid_get(PixbufRenderer *pr, gdouble scale)
+{
+	GdkPixbuf *pixbuf = pr->pixbuf;
+	gint level;
+	gint i;
+
+	if (!pixbuf || pr->loading || scale > 0.5) return pixbuf;
+	if ((gint64)gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_height(pixbuf) < PR_PYRAMID_MIN_PIXELS) return pixbuf;
+	if (gdk_pixbuf_get_bits_per_sample(pixbuf) != 8) return pixbuf;
+
+	/* the smallest level that is still at least as big as the result */
+	level = 0;
+	while (level < PR_PYRAMID_LEVELS && scale * (1 << (level + 1)) <= 1.0) level++;
+
+	for (i = 0; i < level; i++)
+		{
+		if (!pr->pyramid[i])
+			{
+			pr->pyramid[i] = pr_pyramid_level_new(pixbuf);
+			if (!pr->pyramid[i]) return pixbuf;
+			DEBUG_1("zoom pyramid level %d: %dx%d", i + 1,
+				gdk_pixbuf_get_width(pr->pyramid[i]), gdk_pixbuf_get_height(pr->pyramid[i]));
+			}
+		pixbuf = pr->pyramid[i];
+		}
+
+	return pixbuf;
+}
+
 void pixbuf_renderer_set_tiles(PixbufRenderer *pr, gint width, gint height,
 			       gint tile_width, gint tile_height, gint cache_size,
 			       PixbufRendererTileRequestFunc func_request,
@@ -1188,6 +1394,7 @@ void pixbuf_renderer_set_tiles(PixbufRenderer *pr, gint width, gint height,
 
 	if (pr->pixbuf) g_object_unref(pr->pixbuf);
 	pr->pixbuf = NULL;
+	pr_pyramid_free(pr);
 
 	pr_source_tile_unset(pr);
 
@@ -1197,6 +1404,7 @@ void pixbuf_renderer_set_tiles(PixbufRenderer *pr, gint width, gint height,
 	pr->source_tiles_cache_size = cache_size;
 	pr->source_tile_width = tile_width;
 	pr->source_tile_height = tile_height;
+	pr->source_tile_shrink = 1;
 
 	pr->image_width = width;
 	pr->image_height = height;
@@ -1223,6 +1431,19 @@ void pixbuf_renderer_set_tiles_size(PixbufRenderer *pr, gint width, gint height)
 	pr_zoom_sync(pr, pr->zoom, PR_ZOOM_FORCE, 0, 0);
 }
 
+void pixbuf_renderer_set_tiles_reduced(PixbufRenderer *pr, gboolean reduced)
+{
+	g_return_if_fail(IS_PIXBUF_RENDERER(pr));
+
+	if (pr->source_tiles_reduced == reduced) return;
+
+	pr->source_tiles_reduced = reduced;
+	if (!pr->source_tiles_enabled) return;
+
+	pr_source_tile_shrink_sync(pr);
+	pr_zoom_sync(pr, pr->zoom, PR_ZOOM_FORCE, 0, 0);
+}
+
 gint pixbuf_renderer_get_tiles(PixbufRenderer *pr)
 {
 	g_return_val_if_fail(IS_PIXBUF_RENDERER(pr), FALSE);
@@ -2441,6 +2662,7 @@ static void pr_set_pixbuf(PixbufRenderer *pr, GdkPixbuf *pixbuf, gdouble zoom, P
 	if (pixbuf) g_object_ref(pixbuf);
 	if (pr->pixbuf) g_object_unref(pr->pixbuf);
 	pr->pixbuf = pixbuf;
+	pr_pyramid_free(pr);
 
 	if (!pr->pixbuf)
 		{
@@ -2547,6 +2769,13 @@ void pixbuf_renderer_set_post_process_func(PixbufRenderer *pr, PixbufRendererPos
 
 }
 
+void pixbuf_renderer_set_post_process_threaded(PixbufRenderer *pr, gboolean threaded)
+{
+	g_return_if_fail(IS_PIXBUF_RENDERER(pr));
+
+	pr->post_process_threaded = threaded;
+}
+
 
 void pixbuf_renderer_move(PixbufRenderer *pr, PixbufRenderer *source)
 {
@@ -2577,6 +2806,7 @@ void pixbuf_renderer_move(PixbufRenderer *pr, PixbufRenderer *source)
 	pr->func_post_process = source->func_post_process;
 	pr->post_process_user_data = source->post_process_user_data;
 	pr->post_process_slow = source->post_process_slow;
+	pr->post_process_threaded = source->post_process_threaded;
 	pr->orientation = source->orientation;
 	pr->stereo_data = source->stereo_data;
 
@@ -2588,6 +2818,8 @@ void pixbuf_renderer_move(PixbufRenderer *pr, PixbufRenderer *source)
 		pr->source_tiles_cache_size = source->source_tiles_cache_size;
 		pr->source_tile_width = source->source_tile_width;
 		pr->source_tile_height = source->source_tile_height;
+		pr->source_tiles_reduced = source->source_tiles_reduced;
+		pr->source_tile_shrink = source->source_tile_shrink;
 		pr->image_width = source->image_width;
 		pr->image_height = source->image_height;
 
@@ -2595,8 +2827,7 @@ void pixbuf_renderer_move(PixbufRenderer *pr, PixbufRenderer *source)
 		pr->func_tile_dispose = source->func_tile_dispose;
 		pr->func_tile_data = source->func_tile_data;
 
-		pr->source_tiles = source->source_tiles;
-		source->source_tiles = NULL;
+		pr_source_tile_take(pr, source);
 
 		pr_zoom_sync(pr, source->zoom, PR_ZOOM_FORCE | PR_ZOOM_NEW, 0, 0);
 		}
@@ -2645,6 +2876,8 @@ void pixbuf_renderer_copy(PixbufRenderer *pr, PixbufRenderer *source)
 		pr->source_tiles_cache_size = source->source_tiles_cache_size;
 		pr->source_tile_width = source->source_tile_width;
 		pr->source_tile_height = source->source_tile_height;
+		pr->source_tiles_reduced = source->source_tiles_reduced;
+		pr->source_tile_shrink = source->source_tile_shrink;
 		pr->image_width = source->image_width;
 		pr->image_height = source->image_height;
 
@@ -2652,8 +2885,7 @@ void pixbuf_renderer_copy(PixbufRenderer *pr, PixbufRenderer *source)
 		pr->func_tile_dispose = source->func_tile_dispose;
 		pr->func_tile_data = source->func_tile_data;
 
-		pr->source_tiles = source->source_tiles;
-		source->source_tiles = NULL;
+		pr_source_tile_take(pr, source);
 
 		pr_zoom_sync(pr, source->zoom, PR_ZOOM_FORCE | PR_ZOOM_NEW, 0, 0);
 		}
@@ -2674,6 +2906,15 @@ void pixbuf_renderer_area_changed(PixbufRenderer *pr, gint x, gint y, gint w, gi
 		pr_source_tile_changed(pr, x, y, w, h);
 		}
 
+	if (pr->pixbuf)
+		{
+		pr_pyramid_area_changed(pr, x, y, w, h);
+		}
+	else
+		{
+		pr_pyramid_free(pr);
+		}
+
 	pr->renderer->area_changed(pr->renderer, x, y, w, h);
 	if (pr->renderer2) pr->renderer2->area_changed(pr->renderer2, x, y, w, h);
 }
@@ -39,6 +39,14 @@
 /* default size of tile cache (mb) */
 #define PR_CACHE_SIZE_DEFAULT 8
 
+/* images with more pixels are zoomed out from a pyramid of reduced copies */
+#define PR_PYRAMID_MIN_PIXELS (4096 * 4096)
+/* reduced copies, level n is 1/2^n of the size of the image */
+#define PR_PYRAMID_LEVELS 12
+
+/* largest reduction of source tiles when zoomed out, see pixbuf_renderer_set_tiles_reduced() */
+#define PR_SOURCE_TILE_SHRINK_MAX 64
+
 /* round A up/down to integer count of B */
 #define ROUND_UP(A,B)   ((gint)(((A)+(B)-1)/(B))*(B))
 #define ROUND_DOWN(A,B) ((gint)(((A))/(B))*(B))
@@ -171,9 +179,12 @@ struct _PixbufRenderer
 	gboolean source_tiles_enabled;
 	gint source_tiles_cache_size;
 
-	GList *source_tiles;	/* list of active source tiles */
+	GQueue source_tiles;	/* active source tiles, most recently used first */
+	GHashTable *source_tile_table;	/* active source tiles by position */
 	gint source_tile_width;
 	gint source_tile_height;
+	gboolean source_tiles_reduced;
+	gint source_tile_shrink;	/* image pixels per source tile pixel */
 
 	PixbufRendererTileRequestFunc func_tile_request;
 	PixbufRendererTileDisposeFunc func_tile_dispose;
@@ -183,6 +194,9 @@ struct _PixbufRenderer
 	PixbufRendererPostProcessFunc func_post_process;
 	gpointer post_process_user_data;
 	gint post_process_slow;
+	gboolean post_process_threaded;	/* func_post_process can run in worker threads */
+
+	GdkPixbuf *pyramid[PR_PYRAMID_LEVELS];	/* reduced copies of pixbuf, built when needed */
 
 	gboolean delay_flip;
 	gboolean loading;
@@ -255,6 +269,8 @@ gint pixbuf_renderer_get_orientation(PixbufRenderer *pr);
 void pixbuf_renderer_set_stereo_data(PixbufRenderer *pr, StereoPixbufData stereo_data);
 
 void pixbuf_renderer_set_post_process_func(PixbufRenderer *pr, PixbufRendererPostProcessFunc func, gpointer user_data, gboolean slow);
+/* the post process func may be called from worker threads, for several tiles at once */
+void pixbuf_renderer_set_post_process_threaded(PixbufRenderer *pr, gboolean threaded);
 
 /* display an on-request array of pixbuf tiles */
 
@@ -265,6 +281,10 @@ void pixbuf_renderer_set_tiles(PixbufRenderer *pr, gint width, gint height,
 			       gpointer user_data,
 			       gdouble zoom);
 void pixbuf_renderer_set_tiles_size(PixbufRenderer *pr, gint width, gint height);
+/* when zoomed out, request tiles that cover a power of two times more of the image
+ * than their own size, so that the tiles in view stay few at any zoom
+ */
+void pixbuf_renderer_set_tiles_reduced(PixbufRenderer *pr, gboolean reduced);
 gint pixbuf_renderer_get_tiles(PixbufRenderer *pr);
 
 /* move image data from source to pr, source is then set to NULL image */
@@ -340,6 +360,8 @@ struct _SourceTile
 	gint y;
 	GdkPixbuf *pixbuf;
 	gboolean blank;
+
+	GList link;	/* in the source tiles queue, data points back to the tile */
 };
 
 
@@ -348,6 +370,9 @@ gboolean pr_clip_region(gint x, gint y, gint w, gint h,
 			       gint *rx, gint *ry, gint *rw, gint *rh);
 void pr_render_complete_signal(PixbufRenderer *pr);
 
+/* pixbuf or the smallest of its reduced copies at least scale of its size */
+GdkPixbuf *pr_pyramid_get(PixbufRenderer *pr, gdouble scale);
+
 void pr_tile_coords_map_orientation(gint orientation,
 				     gdouble tile_x, gdouble tile_y, /* coordinates of the tile */
 				     gdouble image_w, gdouble image_h,
@@ -296,6 +296,7 @@ static void config_window_apply(void)
 	options->thumbnails.cache_into_dirs = c_options->thumbnails.cache_into_dirs;
 	options->thumbnails.use_exif = c_options->thumbnails.use_exif;
 	options->thumbnails.collection_preview = c_options->thumbnails.collection_preview;
+	options->thumbnails.jobs = c_options->thumbnails.jobs;
 	options->thumbnails.use_ft_metadata = c_options->thumbnails.use_ft_metadata;
 // 	options->thumbnails.use_ft_metadata_small = c_options->thumbnails.use_ft_metadata_small;
 	options->thumbnails.spec_standard = c_options->thumbnails.spec_standard;
@@ -325,12 +326,16 @@ static void config_window_apply(void)
 
 	options->image.tile_cache_max = c_options->image.tile_cache_max;
 	options->image.image_cache_max = c_options->image.image_cache_max;
+	options->image.image_cache_compressed_max = c_options->image.image_cache_compressed_max;
+	options->image.tiled_view_min_size = c_options->image.tiled_view_min_size;
 
 	options->image.zoom_quality = c_options->image.zoom_quality;
 
 	options->image.zoom_increment = c_options->image.zoom_increment;
 
 	options->image.enable_read_ahead = c_options->image.enable_read_ahead;
+	options->image.read_ahead_count = c_options->image.read_ahead_count;
+	options->image.read_ahead_behind = c_options->image.read_ahead_behind;
 
 
 	if (options->image.use_custom_border_color != c_options->image.use_custom_border_color
@@ -1752,6 +1757,11 @@ static void config_tab_general(GtkWidget *notebook)
 				 options->thumbnails.collection_preview, &c_options->thumbnails.collection_preview);
 	gtk_widget_set_tooltip_text(spin, _("The maximum number of thumbnails shown in a Collection preview montage"));
 
+	spin = pref_spin_new_int(group, _("Thumbnails loaded at once:"), NULL,
+				 0, 64, 1,
+				 options->thumbnails.jobs, &c_options->thumbnails.jobs);
+	gtk_widget_set_tooltip_text(spin, _("The number of thumbnails the file list creates at the same time, 0 uses one per processor core"));
+
 #ifdef HAVE_FFMPEGTHUMBNAILER_METADATA
 	pref_checkbox_new_int(group, _("Use embedded metadata in video files as thumbnails when available"),
 			      options->thumbnails.use_ft_metadata, &c_options->thumbnails.use_ft_metadata);
@@ -1863,8 +1873,19 @@ static void config_tab_general(GtkWidget *notebook)
 
 	pref_spin_new_int(group, _("Decoded image cache size (Mb):"), NULL,
 			  0, 99999, 1, options->image.image_cache_max, &c_options->image.image_cache_max);
-	pref_checkbox_new_int(group, _("Preload next image"),
-			      options->image.enable_read_ahead, &c_options->image.enable_read_ahead);
+	pref_spin_new_int(group, _("Compressed image cache size (Mb):"), NULL,
+			  0, 99999, 1, options->image.image_cache_compressed_max, &c_options->image.image_cache_compressed_max);
+	pref_spin_new_int(group, _("Show images in tiles from (Mpixels, 0 for never):"), NULL,
+			  0, 99999, 1, options->image.tiled_view_min_size, &c_options->image.tiled_view_min_size);
+	ct_button = pref_checkbox_new_int(group, _("Preload next image"),
+					  options->image.enable_read_ahead, &c_options->image.enable_read_ahead);
+
+	hbox = pref_box_new(group, FALSE, GTK_ORIENTATION_HORIZONTAL, PREF_PAD_SPACE);
+	pref_checkbox_link_sensitivity(ct_button, hbox);
+	pref_spin_new_int(hbox, _("Ahead:"), NULL,
+			  1, 32, 1, options->image.read_ahead_count, &c_options->image.read_ahead_count);
+	pref_spin_new_int(hbox, _("Behind:"), NULL,
+			  0, 32, 1, options->image.read_ahead_behind, &c_options->image.read_ahead_behind);
 
 	pref_checkbox_new_int(group, _("Refresh on file change"),
 			      options->update_on_time_change, &c_options->update_on_time_change);
@@ -42,6 +42,7 @@
 
 #ifdef GQ_BUILD
 #include "main.h"
+#include "misc.h"
 #include "pixbuf_util.h"
 #include "exif.h"
 #else
@@ -90,6 +91,8 @@ struct _ImageTile
 	QueueData *qd2;
 
 	guint size;		/* est. memory used by pixmap and pixbuf */
+
+	GList link;		/* in the tiles queue, data points back to the tile */
 };
 
 struct _QueueData
@@ -128,7 +131,8 @@ struct _RendererTiles
 	gint tile_width;
 	gint tile_height;
 	gint tile_cols;		/* count of tile columns */
-	GList *tiles;		/* list of buffer tiles */
+	GQueue tiles;		/* buffer tiles, most recently used first */
+	GHashTable *tile_table;	/* buffer tiles by position */
 	gint tile_cache_size;	/* allocated size of pixmaps/pixbufs */
 	GList *draw_queue;	/* list of areas to redraw */
 	GList *draw_queue_2pass;/* list when 2 pass is enabled */
@@ -139,6 +143,7 @@ struct _RendererTiles
 	guint draw_idle_id; /* event source id */
 
 	GdkPixbuf *spare_tile;
+	GList *spare_tiles;	/* scratch tiles of the threaded scaling */
 
 	gint stereo_mode;
 	gint stereo_off_x;
@@ -321,11 +326,28 @@ static void rt_tile_free(ImageTile *it)
 	g_free(it);
 }
 
+static guint rt_tile_hash(gconstpointer key)
+{
+	const ImageTile *it = key;
+
+	return (guint)it->x * 65599 + (guint)it->y;
+}
+
+static gboolean rt_tile_equal(gconstpointer a, gconstpointer b)
+{
+	const ImageTile *ita = a;
+	const ImageTile *itb = b;
+
+	return ita->x == itb->x && ita->y == itb->y;
+}
+
 static void rt_tile_free_all(RendererTiles *rt)
 {
 	GList *work;
 
-	work = rt->tiles;
+	g_hash_table_remove_all(rt->tile_table);
+
+	work = rt->tiles.head;
 	while (work)
 		{
 		ImageTile *it;
@@ -336,8 +358,7 @@ static void rt_tile_free_all(RendererTiles *rt)
 		rt_tile_free(it);
 		}
 
-	g_list_free(rt->tiles);
-	rt->tiles = NULL;
+	g_queue_init(&rt->tiles);
 	rt->tile_cache_size = 0;
 }
 
@@ -351,7 +372,9 @@ static ImageTile *rt_tile_add(RendererTiles *rt, gint x, gint y)
 	if (it->x + it->w > pr->width) it->w = pr->width - it->x;
 	if (it->y + it->h > pr->height) it->h = pr->height - it->y;
 
-	rt->tiles = g_list_prepend(rt->tiles, it);
+	it->link.data = it;
+	g_queue_push_head_link(&rt->tiles, &it->link);
+	g_hash_table_insert(rt->tile_table, it, it);
 	rt->tile_cache_size += it->size;
 
 	return it;
@@ -377,7 +400,8 @@ static void rt_tile_remove(RendererTiles *rt, ImageTile *it)
 		g_free(qd);
 		}
 
-	rt->tiles = g_list_remove(rt->tiles, it);
+	g_hash_table_remove(rt->tile_table, it);
+	g_queue_unlink(&rt->tiles, &it->link);
 	rt->tile_cache_size -= it->size;
 
 	rt_tile_free(it);
@@ -389,7 +413,7 @@ static void rt_tile_free_space(RendererTiles *rt, guint space, ImageTile *it)
 	GList *work;
 	guint tile_max;
 
-	work = g_list_last(rt->tiles);
+	work = rt->tiles.tail;
 
 	if (pr->source_tiles_enabled && pr->scale < 1.0)
 		{
@@ -420,7 +444,7 @@ static void rt_tile_invalidate_all(RendererTiles *rt)
 	PixbufRenderer *pr = rt->pr;
 	GList *work;
 
-	work = rt->tiles;
+	work = rt->tiles.head;
 	while (work)
 		{
 		ImageTile *it;
@@ -449,7 +473,28 @@ static void rt_tile_invalidate_region(RendererTiles *rt, gint x, gint y, gint w,
 	y1 = ROUND_DOWN(y, rt->tile_height);
 	y2 = ROUND_UP(y + h, rt->tile_height);
 
-	work = rt->tiles;
+	if ((gint64)(x2 - x1) / rt->tile_width * ((y2 - y1) / rt->tile_height) < (gint64)rt->tiles.length)
+		{
+		/* small region, look up the tiles that can be in it */
+		ImageTile key;
+
+		for (key.y = y1; key.y < y2; key.y += rt->tile_height)
+			{
+			for (key.x = x1; key.x < x2; key.x += rt->tile_width)
+				{
+				ImageTile *it = g_hash_table_lookup(rt->tile_table, &key);
+
+				if (it && it->x + it->w > x1 && it->y + it->h > y1)
+					{
+					it->render_done = TILE_RENDER_NONE;
+					it->render_todo = TILE_RENDER_ALL;
+					}
+				}
+			}
+		return;
+		}
+
+	work = rt->tiles.head;
 	while (work)
 		{
 		ImageTile *it;
@@ -468,22 +513,17 @@ static void rt_tile_invalidate_region(RendererTiles *rt, gint x, gint y, gint w,
 
 static ImageTile *rt_tile_get(RendererTiles *rt, gint x, gint y, gboolean only_existing)
 {
-	GList *work;
+	ImageTile key;
+	ImageTile *it;
 
-	work = rt->tiles;
-	while (work)
+	key.x = x;
+	key.y = y;
+	it = g_hash_table_lookup(rt->tile_table, &key);
+	if (it)
 		{
-		ImageTile *it;
-
-		it = work->data;
-		if (it->x == x && it->y == y)
-			{
-			rt->tiles = g_list_delete_link(rt->tiles, work);
-			rt->tiles = g_list_prepend(rt->tiles, it);
-			return it;
-			}
-
-		work = work->next;
+		g_queue_unlink(&rt->tiles, &it->link);
+		g_queue_push_head_link(&rt->tiles, &it->link);
+		return it;
 		}
 
 	if (only_existing) return NULL;
@@ -907,7 +947,7 @@ static GdkPixbuf *rt_get_spare_tile(RendererTiles *rt)
 
 #define COLOR_BYTES 3	/* rgb */
 
-static void rt_tile_rotate_90_clockwise(RendererTiles *rt, GdkPixbuf **tile, gint x, gint y, gint w, gint h)
+static void rt_tile_rotate_90_clockwise(RendererTiles *rt, GdkPixbuf **tile, GdkPixbuf **spare, gint x, gint y, gint w, gint h)
 {
 	GdkPixbuf *src = *tile;
 	GdkPixbuf *dest;
@@ -922,7 +962,7 @@ static void rt_tile_rotate_90_clockwise(RendererTiles *rt, GdkPixbuf **tile, gin
 	s_pix = gdk_pixbuf_get_pixels(src);
 	spi = s_pix + (x * COLOR_BYTES);
 
-	dest = rt_get_spare_tile(rt);
+	dest = *spare;
 	drs = gdk_pixbuf_get_rowstride(dest);
 	d_pix = gdk_pixbuf_get_pixels(dest);
 	dpi = d_pix + (tw - 1) * COLOR_BYTES;
@@ -939,11 +979,11 @@ static void rt_tile_rotate_90_clockwise(RendererTiles *rt, GdkPixbuf **tile, gin
 			}
 		}
 
-	rt->spare_tile = src;
+	*spare = src;
 	*tile = dest;
 }
 
-static void rt_tile_rotate_90_counter_clockwise(RendererTiles *rt, GdkPixbuf **tile, gint x, gint y, gint w, gint h)
+static void rt_tile_rotate_90_counter_clockwise(RendererTiles *rt, GdkPixbuf **tile, GdkPixbuf **spare, gint x, gint y, gint w, gint h)
 {
 	GdkPixbuf *src = *tile;
 	GdkPixbuf *dest;
@@ -958,7 +998,7 @@ static void rt_tile_rotate_90_counter_clockwise(RendererTiles *rt, GdkPixbuf **t
 	s_pix = gdk_pixbuf_get_pixels(src);
 	spi = s_pix + (x * COLOR_BYTES);
 
-	dest = rt_get_spare_tile(rt);
+	dest = *spare;
 	drs = gdk_pixbuf_get_rowstride(dest);
 	d_pix = gdk_pixbuf_get_pixels(dest);
 	dpi = d_pix + (th - 1) * drs;
@@ -975,11 +1015,11 @@ static void rt_tile_rotate_90_counter_clockwise(RendererTiles *rt, GdkPixbuf **t
 			}
 		}
 
-	rt->spare_tile = src;
+	*spare = src;
 	*tile = dest;
 }
 
-static void rt_tile_mirror_only(RendererTiles *rt, GdkPixbuf **tile, gint x, gint y, gint w, gint h)
+static void rt_tile_mirror_only(RendererTiles *rt, GdkPixbuf **tile, GdkPixbuf **spare, gint x, gint y, gint w, gint h)
 {
 	GdkPixbuf *src = *tile;
 	GdkPixbuf *dest;
@@ -995,7 +1035,7 @@ static void rt_tile_mirror_only(RendererTiles *rt, GdkPixbuf **tile, gint x, gin
 	s_pix = gdk_pixbuf_get_pixels(src);
 	spi = s_pix + (x * COLOR_BYTES);
 
-	dest = rt_get_spare_tile(rt);
+	dest = *spare;
 	drs = gdk_pixbuf_get_rowstride(dest);
 	d_pix = gdk_pixbuf_get_pixels(dest);
 	dpi =  d_pix + (tw - x - 1) * COLOR_BYTES;
@@ -1012,11 +1052,11 @@ static void rt_tile_mirror_only(RendererTiles *rt, GdkPixbuf **tile, gint x, gin
 			}
 		}
 
-	rt->spare_tile = src;
+	*spare = src;
 	*tile = dest;
 }
 
-static void rt_tile_mirror_and_flip(RendererTiles *rt, GdkPixbuf **tile, gint x, gint y, gint w, gint h)
+static void rt_tile_mirror_and_flip(RendererTiles *rt, GdkPixbuf **tile, GdkPixbuf **spare, gint x, gint y, gint w, gint h)
 {
 	GdkPixbuf *src = *tile;
 	GdkPixbuf *dest;
@@ -1031,7 +1071,7 @@ static void rt_tile_mirror_and_flip(RendererTiles *rt, GdkPixbuf **tile, gint x,
 	srs = gdk_pixbuf_get_rowstride(src);
 	s_pix = gdk_pixbuf_get_pixels(src);
 
-	dest = rt_get_spare_tile(rt);
+	dest = *spare;
 	drs = gdk_pixbuf_get_rowstride(dest);
 	d_pix = gdk_pixbuf_get_pixels(dest);
 	dpi = d_pix + (th - 1) * drs + (tw - 1) * COLOR_BYTES;
@@ -1048,11 +1088,11 @@ static void rt_tile_mirror_and_flip(RendererTiles *rt, GdkPixbuf **tile, gint x,
 			}
 		}
 
-	rt->spare_tile = src;
+	*spare = src;
 	*tile = dest;
 }
 
-static void rt_tile_flip_only(RendererTiles *rt, GdkPixbuf **tile, gint x, gint y, gint w, gint h)
+static void rt_tile_flip_only(RendererTiles *rt, GdkPixbuf **tile, GdkPixbuf **spare, gint x, gint y, gint w, gint h)
 {
 	GdkPixbuf *src = *tile;
 	GdkPixbuf *dest;
@@ -1067,7 +1107,7 @@ static void rt_tile_flip_only(RendererTiles *rt, GdkPixbuf **tile, gint x, gint
 	s_pix = gdk_pixbuf_get_pixels(src);
 	spi = s_pix + (x * COLOR_BYTES);
 
-	dest = rt_get_spare_tile(rt);
+	dest = *spare;
 	drs = gdk_pixbuf_get_rowstride(dest);
 	d_pix = gdk_pixbuf_get_pixels(dest);
 	dpi = d_pix + (th - 1) * drs + (x * COLOR_BYTES);
@@ -1079,11 +1119,11 @@ static void rt_tile_flip_only(RendererTiles *rt, GdkPixbuf **tile, gint x, gint
 		memcpy(dp, sp, w * COLOR_BYTES);
 		}
 
-	rt->spare_tile = src;
+	*spare = src;
 	*tile = dest;
 }
 
-static void rt_tile_apply_orientation(RendererTiles *rt, gint orientation, GdkPixbuf **pixbuf, gint x, gint y, gint w, gint h)
+static void rt_tile_apply_orientation(RendererTiles *rt, gint orientation, GdkPixbuf **pixbuf, GdkPixbuf **spare, gint x, gint y, gint w, gint h)
 {
 	switch (orientation)
 		{
@@ -1093,43 +1133,43 @@ static void rt_tile_apply_orientation(RendererTiles *rt, gint orientation, GdkPi
 		case EXIF_ORIENTATION_TOP_RIGHT:
 			/* mirrored */
 			{
-				rt_tile_mirror_only(rt, pixbuf, x, y, w, h);
+				rt_tile_mirror_only(rt, pixbuf, spare, x, y, w, h);
 			}
 			break;
 		case EXIF_ORIENTATION_BOTTOM_RIGHT:
 			/* upside down */
 			{
-				rt_tile_mirror_and_flip(rt, pixbuf, x, y, w, h);
+				rt_tile_mirror_and_flip(rt, pixbuf, spare, x, y, w, h);
 			}
 			break;
 		case EXIF_ORIENTATION_BOTTOM_LEFT:
 			/* flipped */
 			{
-				rt_tile_flip_only(rt, pixbuf, x, y, w, h);
+				rt_tile_flip_only(rt, pixbuf, spare, x, y, w, h);
 			}
 			break;
 		case EXIF_ORIENTATION_LEFT_TOP:
 			{
-				rt_tile_flip_only(rt, pixbuf, x, y, w, h);
-				rt_tile_rotate_90_clockwise(rt, pixbuf, x, rt->tile_height - y - h, w, h);
+				rt_tile_flip_only(rt, pixbuf, spare, x, y, w, h);
+				rt_tile_rotate_90_clockwise(rt, pixbuf, spare, x, rt->tile_height - y - h, w, h);
 			}
 			break;
 		case EXIF_ORIENTATION_RIGHT_TOP:
 			/* rotated -90 (270) */
 			{
-				rt_tile_rotate_90_clockwise(rt, pixbuf, x, y, w, h);
+				rt_tile_rotate_90_clockwise(rt, pixbuf, spare, x, y, w, h);
 			}
 			break;
 		case EXIF_ORIENTATION_RIGHT_BOTTOM:
 			{
-				rt_tile_flip_only(rt, pixbuf, x, y, w, h);
-				rt_tile_rotate_90_counter_clockwise(rt, pixbuf, x, rt->tile_height - y - h, w, h);
+				rt_tile_flip_only(rt, pixbuf, spare, x, y, w, h);
+				rt_tile_rotate_90_counter_clockwise(rt, pixbuf, spare, x, rt->tile_height - y - h, w, h);
 			}
 			break;
 		case EXIF_ORIENTATION_LEFT_BOTTOM:
 			/* rotated 90 */
 			{
-				rt_tile_rotate_90_counter_clockwise(rt, pixbuf, x, y, w, h);
+				rt_tile_rotate_90_counter_clockwise(rt, pixbuf, spare, x, y, w, h);
 			}
 			break;
 		default:
@@ -1159,7 +1199,8 @@ static gboolean rt_source_tile_render(RendererTiles *rt, ImageTile *it,
 			st = work->data;
 			work = work->next;
 
-			if (pr_clip_region(st->x, st->y, pr->source_tile_width, pr->source_tile_height,
+			if (pr_clip_region(st->x, st->y, pr->source_tile_width * pr->source_tile_shrink,
+					   pr->source_tile_height * pr->source_tile_shrink,
 					   it->x + x, it->y + y, w, h,
 					   &rx, &ry, &rw, &rh))
 				{
@@ -1214,8 +1255,8 @@ static gboolean rt_source_tile_render(RendererTiles *rt, ImageTile *it,
 
 			stx = floor((gdouble)st->x * scale_x);
 			sty = floor((gdouble)st->y * scale_y);
-			stw = ceil((gdouble)(st->x + pr->source_tile_width) * scale_x) - stx;
-			sth = ceil((gdouble)(st->y + pr->source_tile_height) * scale_y) - sty;
+			stw = ceil((gdouble)(st->x + pr->source_tile_width * pr->source_tile_shrink) * scale_x) - stx;
+			sth = ceil((gdouble)(st->y + pr->source_tile_height * pr->source_tile_shrink) * scale_y) - sty;
 
 			if (pr_clip_region(stx, sty, stw, sth,
 					   it->x + x, it->y + y, w, h,
@@ -1243,7 +1284,7 @@ static gboolean rt_source_tile_render(RendererTiles *rt, ImageTile *it,
 					gdk_pixbuf_scale(st->pixbuf, it->pixbuf, rx - it->x, ry - it->y, rw, rh,
 						 (gdouble) 0.0 + offset_x,
 						 (gdouble) 0.0 + offset_y,
-						 scale_x, scale_y,
+						 scale_x * pr->source_tile_shrink, scale_y * pr->source_tile_shrink,
 						 (fast) ? GDK_INTERP_NEAREST : pr->zoom_quality);
 					draw = TRUE;
 					}
@@ -1317,29 +1358,123 @@ static gint rt_get_orientation(RendererTiles *rt)
 }
 
 
-static void rt_tile_render(RendererTiles *rt, ImageTile *it,
-			   gint x, gint y, gint w, gint h,
-			   gboolean new_data, gboolean fast)
+/* the scaling of a tile from pr->pixbuf, it does not touch the widget
+ * and can run in a worker thread while the main thread waits for it
+ */
+typedef struct _TileScaleData TileScaleData;
+struct _TileScaleData
+{
+	RendererTiles *rt;
+	ImageTile *it;
+	GdkPixbuf *pixbuf;	/* destination, replaces it->pixbuf when done */
+	GdkPixbuf *spare;	/* scratch pixbuf of the size of a tile */
+	GdkPixbuf *source;	/* pr->pixbuf or a reduced copy of it */
+
+	gboolean has_alpha;
+	gint orientation;
+	gdouble src_x;
+	gdouble src_y;
+	gdouble scale_x;
+	gdouble scale_y;
+	gdouble source_scale_x;	/* scale_x and scale_y for source */
+	gdouble source_scale_y;
+	gint pb_x;
+	gint pb_y;
+	gint pb_w;
+	gint pb_h;
+	gboolean fast;
+};
+
+static void rt_tile_scale(TileScaleData *ts)
+{
+	RendererTiles *rt = ts->rt;
+	PixbufRenderer *pr = rt->pr;
+	ImageTile *it = ts->it;
+
+	rt_tile_get_region(ts->has_alpha,
+			   ts->source, ts->pixbuf, ts->pb_x, ts->pb_y, ts->pb_w, ts->pb_h,
+			   (gdouble) 0.0 - ts->src_x - GET_RIGHT_PIXBUF_OFFSET(rt) * ts->scale_x,
+			   (gdouble) 0.0 - ts->src_y,
+			   ts->source_scale_x, ts->source_scale_y,
+			   (ts->fast) ? GDK_INTERP_NEAREST : pr->zoom_quality,
+			   it->x + ts->pb_x, it->y + ts->pb_y);
+	if (rt->stereo_mode & PR_STEREO_ANAGLYPH &&
+	    (pr->stereo_pixbuf_offset_right > 0 || pr->stereo_pixbuf_offset_left > 0))
+		{
+		GdkPixbuf *right_pb = ts->spare;
+		rt_tile_get_region(ts->has_alpha,
+				   ts->source, right_pb, ts->pb_x, ts->pb_y, ts->pb_w, ts->pb_h,
+				   (gdouble) 0.0 - ts->src_x - GET_LEFT_PIXBUF_OFFSET(rt) * ts->scale_x,
+				   (gdouble) 0.0 - ts->src_y,
+				   ts->source_scale_x, ts->source_scale_y,
+				   (ts->fast) ? GDK_INTERP_NEAREST : pr->zoom_quality,
+				   it->x + ts->pb_x, it->y + ts->pb_y);
+		pr_create_anaglyph(rt->stereo_mode, ts->pixbuf, right_pb, ts->pb_x, ts->pb_y, ts->pb_w, ts->pb_h);
+		/* do not care about freeing the spare tile, it will be reused */
+		}
+	rt_tile_apply_orientation(rt, ts->orientation, &ts->pixbuf, &ts->spare, ts->pb_x, ts->pb_y, ts->pb_w, ts->pb_h);
+}
+
+static gboolean rt_tile_post_process_needed(RendererTiles *rt, gboolean fast)
+{
+	PixbufRenderer *pr = rt->pr;
+
+	return pr->func_post_process && !(pr->post_process_slow && fast);
+}
+
+/* copies the area of the tile pixbuf to its surface */
+static void rt_tile_render_blit(RendererTiles *rt, ImageTile *it,
+				gint x, gint y, gint w, gint h)
+{
+	cairo_t *cr;
+
+	if (!it->pixbuf || it->blank) return;
+
+	cr = cairo_create(it->surface);
+	cairo_rectangle (cr, x, y, w, h);
+	rt_hidpi_aware_draw(rt, cr, it->pixbuf, 0, 0);
+	cairo_destroy (cr);
+}
+
+static void rt_tile_render_finish(RendererTiles *rt, ImageTile *it,
+				  gint x, gint y, gint w, gint h, gboolean fast)
+{
+	PixbufRenderer *pr = rt->pr;
+
+	if (!it->pixbuf || it->blank) return;
+
+	if (rt_tile_post_process_needed(rt, fast))
+		pr->func_post_process(pr, &it->pixbuf, x, y, w, h, pr->post_process_user_data);
+
+	rt_tile_render_blit(rt, it, x, y, w, h);
+}
+
+/* renders what can not be done in a thread, returns TRUE when the tile
+ * still has to be scaled as set up in ts, then finished with the area
+ * in x, y, w, h
+ */
+static gboolean rt_tile_render_prepare(RendererTiles *rt, ImageTile *it,
+				       gint *x, gint *y, gint *w, gint *h,
+				       gboolean new_data, gboolean fast, TileScaleData *ts)
 {
 	PixbufRenderer *pr = rt->pr;
 	gboolean has_alpha;
-	gboolean draw = FALSE;
 	gint orientation = rt_get_orientation(rt);
 
-	if (it->render_todo == TILE_RENDER_NONE && it->surface && !new_data) return;
+	if (it->render_todo == TILE_RENDER_NONE && it->surface && !new_data) return FALSE;
 
 	if (it->render_done != TILE_RENDER_ALL)
 		{
-		x = 0;
-		y = 0;
-		w = it->w;
-		h = it->h;
+		*x = 0;
+		*y = 0;
+		*w = it->w;
+		*h = it->h;
 		if (!fast) it->render_done = TILE_RENDER_ALL;
 		}
 	else if (it->render_todo != TILE_RENDER_AREA)
 		{
 		if (!fast) it->render_todo = TILE_RENDER_NONE;
-		return;
+		return FALSE;
 		}
 
 	if (!fast) it->render_todo = TILE_RENDER_NONE;
@@ -1365,7 +1500,10 @@ static void rt_tile_render(RendererTiles *rt, ImageTile *it,
 		}
 	else if (pr->source_tiles_enabled)
 		{
-		draw = rt_source_tile_render(rt, it, x, y, w, h, new_data, fast);
+		if (rt_source_tile_render(rt, it, *x, *y, *w, *h, new_data, fast))
+			{
+			rt_tile_render_finish(rt, it, *x, *y, *w, *h, fast);
+			}
 		}
 	else
 		{
@@ -1374,7 +1512,7 @@ static void rt_tile_render(RendererTiles *rt, ImageTile *it,
 		gint pb_x, pb_y;
 		gint pb_w, pb_h;
 
-		if (pr->image_width == 0 || pr->image_height == 0) return;
+		if (pr->image_width == 0 || pr->image_height == 0) return FALSE;
 
 		scale_x = rt->hidpi_scale * (gdouble)pr->width / pr->image_width;
 		scale_y = rt->hidpi_scale * (gdouble)pr->height / pr->image_height;
@@ -1383,9 +1521,9 @@ static void rt_tile_render(RendererTiles *rt, ImageTile *it,
 					    pr->width, pr->height,
 					    rt->tile_width, rt->tile_height,
 					    &src_x, &src_y);
-		pr_tile_region_map_orientation(orientation, x, y,
+		pr_tile_region_map_orientation(orientation, *x, *y,
 					    rt->tile_width, rt->tile_height,
-					    w, h,
+					    *w, *h,
 					    &pb_x, &pb_y,
 					    &pb_w, &pb_h);
 
@@ -1417,78 +1555,85 @@ static void rt_tile_render(RendererTiles *rt, ImageTile *it,
 		 */
 		if (pr->width < PR_MIN_SCALE_SIZE || pr->height < PR_MIN_SCALE_SIZE) fast = TRUE;
 
-		rt_tile_get_region(has_alpha,
-				   pr->pixbuf, it->pixbuf, pb_x, pb_y, pb_w, pb_h,
-				   (gdouble) 0.0 - src_x - GET_RIGHT_PIXBUF_OFFSET(rt) * scale_x,
-				   (gdouble) 0.0 - src_y,
-				   scale_x, scale_y,
-				   (fast) ? GDK_INTERP_NEAREST : pr->zoom_quality,
-				   it->x + pb_x, it->y + pb_y);
-		if (rt->stereo_mode & PR_STEREO_ANAGLYPH &&
-		    (pr->stereo_pixbuf_offset_right > 0 || pr->stereo_pixbuf_offset_left > 0))
-			{
-			GdkPixbuf *right_pb = rt_get_spare_tile(rt);
-			rt_tile_get_region(has_alpha,
-					   pr->pixbuf, right_pb, pb_x, pb_y, pb_w, pb_h,
-					   (gdouble) 0.0 - src_x - GET_LEFT_PIXBUF_OFFSET(rt) * scale_x,
-					   (gdouble) 0.0 - src_y,
-					   scale_x, scale_y,
-					   (fast) ? GDK_INTERP_NEAREST : pr->zoom_quality,
-					   it->x + pb_x, it->y + pb_y);
-			pr_create_anaglyph(rt->stereo_mode, it->pixbuf, right_pb, pb_x, pb_y, pb_w, pb_h);
-			/* do not care about freeing spare_tile, it will be reused */
-			}
-		rt_tile_apply_orientation(rt, orientation, &it->pixbuf, pb_x, pb_y, pb_w, pb_h);
-		draw = TRUE;
+		/* zoomed out far, scale from the reduced copy closest in size */
+		ts->source = pr_pyramid_get(pr, MAX(scale_x, scale_y));
+
+		ts->rt = rt;
+		ts->it = it;
+		ts->pixbuf = it->pixbuf;
+		ts->spare = NULL;
+		ts->has_alpha = has_alpha;
+		ts->orientation = orientation;
+		ts->src_x = src_x;
+		ts->src_y = src_y;
+		ts->scale_x = scale_x;
+		ts->scale_y = scale_y;
+		ts->source_scale_x = scale_x * gdk_pixbuf_get_width(pr->pixbuf) / gdk_pixbuf_get_width(ts->source);
+		ts->source_scale_y = scale_y * gdk_pixbuf_get_height(pr->pixbuf) / gdk_pixbuf_get_height(ts->source);
+		ts->pb_x = pb_x;
+		ts->pb_y = pb_y;
+		ts->pb_w = pb_w;
+		ts->pb_h = pb_h;
+		ts->fast = fast;
+		return TRUE;
 		}
 
-	if (draw && it->pixbuf && !it->blank)
-		{
-		cairo_t *cr;
-
-		if (pr->func_post_process && !(pr->post_process_slow && fast))
-			pr->func_post_process(pr, &it->pixbuf, x, y, w, h, pr->post_process_user_data);
-
-		cr = cairo_create(it->surface);
-		cairo_rectangle (cr, x, y, w, h);
-		rt_hidpi_aware_draw(rt, cr, it->pixbuf, 0, 0);
-		cairo_destroy (cr);
-		}
+	return FALSE;
 }
 
-
-static void rt_tile_expose(RendererTiles *rt, ImageTile *it,
+static void rt_tile_render(RendererTiles *rt, ImageTile *it,
 			   gint x, gint y, gint w, gint h,
 			   gboolean new_data, gboolean fast)
+{
+	TileScaleData ts;
+
+	if (!rt_tile_render_prepare(rt, it, &x, &y, &w, &h, new_data, fast, &ts)) return;
+
+	ts.spare = rt_get_spare_tile(rt);
+	rt_tile_scale(&ts);
+	it->pixbuf = ts.pixbuf;
+	rt->spare_tile = ts.spare;
+
+	rt_tile_render_finish(rt, it, x, y, w, h, ts.fast);
+}
+
+/* clamps the area of the tile to the visible part, FALSE if none is visible */
+static gboolean rt_tile_expose_clamp(RendererTiles *rt, ImageTile *it,
+				     gint *x, gint *y, gint *w, gint *h)
 {
 	PixbufRenderer *pr = rt->pr;
-	GtkWidget *box;
-	GdkWindow *window;
-	cairo_t *cr;
 
-	/* clamp to visible */
-	if (it->x + x < rt->x_scroll)
+	if (it->x + *x < rt->x_scroll)
 		{
-		w -= rt->x_scroll - it->x - x;
-		x = rt->x_scroll - it->x;
+		*w -= rt->x_scroll - it->x - *x;
+		*x = rt->x_scroll - it->x;
 		}
-	if (it->x + x + w > rt->x_scroll + pr->vis_width)
+	if (it->x + *x + *w > rt->x_scroll + pr->vis_width)
 		{
-		w = rt->x_scroll + pr->vis_width - it->x - x;
+		*w = rt->x_scroll + pr->vis_width - it->x - *x;
 		}
-	if (w < 1) return;
-	if (it->y + y < rt->y_scroll)
+	if (*w < 1) return FALSE;
+	if (it->y + *y < rt->y_scroll)
 		{
-		h -= rt->y_scroll - it->y - y;
-		y = rt->y_scroll - it->y;
+		*h -= rt->y_scroll - it->y - *y;
+		*y = rt->y_scroll - it->y;
 		}
-	if (it->y + y + h > rt->y_scroll + pr->vis_height)
+	if (it->y + *y + *h > rt->y_scroll + pr->vis_height)
 		{
-		h = rt->y_scroll + pr->vis_height - it->y - y;
+		*h = rt->y_scroll + pr->vis_height - it->y - *y;
 		}
-	if (h < 1) return;
+	if (*h < 1) return FALSE;
 
-	rt_tile_render(rt, it, x, y, w, h, new_data, fast);
+	return TRUE;
+}
+
+static void rt_tile_expose_draw(RendererTiles *rt, ImageTile *it,
+				gint x, gint y, gint w, gint h)
+{
+	PixbufRenderer *pr = rt->pr;
+	GtkWidget *box;
+	GdkWindow *window;
+	cairo_t *cr;
 
 	box = GTK_WIDGET(pr);
 	window = gtk_widget_get_window(box);
@@ -1508,6 +1653,16 @@ static void rt_tile_expose(RendererTiles *rt, ImageTile *it,
 		}
 }
 
+static void rt_tile_expose(RendererTiles *rt, ImageTile *it,
+			   gint x, gint y, gint w, gint h,
+			   gboolean new_data, gboolean fast)
+{
+	if (!rt_tile_expose_clamp(rt, it, &x, &y, &w, &h)) return;
+
+	rt_tile_render(rt, it, x, y, w, h, new_data, fast);
+	rt_tile_expose_draw(rt, it, x, y, w, h);
+}
+
 
 static gboolean rt_tile_is_visible(RendererTiles *rt, ImageTile *it)
 {
@@ -1582,6 +1737,188 @@ static gboolean rt_queue_schedule_next_draw(RendererTiles *rt, gboolean force_se
 }
 
 
+/* takes qd out of its queue, after a fast render it goes on to the 2pass queue */
+static void rt_queue_draw_done(RendererTiles *rt, QueueData *qd, gboolean fast)
+{
+	if (qd->it->qd == qd)
+		{
+		qd->it->qd = NULL;
+		rt->draw_queue = g_list_remove(rt->draw_queue, qd);
+		if (fast)
+			{
+			if (qd->it->qd2)
+				{
+				rt_queue_merge(qd->it->qd2, qd);
+				g_free(qd);
+				}
+			else
+				{
+				qd->it->qd2 = qd;
+				rt->draw_queue_2pass = g_list_append(rt->draw_queue_2pass, qd);
+				}
+			}
+		else
+			{
+			g_free(qd);
+			}
+		}
+	else
+		{
+		qd->it->qd2 = NULL;
+		rt->draw_queue_2pass = g_list_remove(rt->draw_queue_2pass, qd);
+		g_free(qd);
+		}
+}
+
+#ifdef HAVE_GTHREAD
+#define RT_SCALE_BATCH_PER_THREAD 2	/* tiles rendered at once per thread */
+
+typedef struct _TileBatchItem TileBatchItem;
+struct _TileBatchItem
+{
+	QueueData *qd;
+	gboolean exposed;
+	gint x, y, w, h;	/* visible area to draw */
+	gint rx, ry, rw, rh;	/* area to render */
+	gboolean scale;
+	gboolean post_process;	/* done in the thread too */
+	TileScaleData ts;
+};
+
+static void rt_tile_scale_thread(gpointer data, gpointer user_data)
+{
+	TileBatchItem *item = data;
+	PixbufRenderer *pr = item->ts.rt->pr;
+
+	rt_tile_scale(&item->ts);
+
+	if (item->post_process)
+		{
+		pr->func_post_process(pr, &item->ts.pixbuf, item->rx, item->ry, item->rw, item->rh,
+				      pr->post_process_user_data);
+		}
+}
+
+static GdkPixbuf *rt_spare_tile_take(RendererTiles *rt)
+{
+	GdkPixbuf *pixbuf;
+
+	if (!rt->spare_tiles)
+		{
+		return gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, rt->tile_width * rt->hidpi_scale, rt->tile_height * rt->hidpi_scale);
+		}
+
+	pixbuf = rt->spare_tiles->data;
+	rt->spare_tiles = g_list_delete_link(rt->spare_tiles, rt->spare_tiles);
+	return pixbuf;
+}
+#endif
+
+/* renders and draws the visible tiles at the start of the queue of qd
+ * at once, with the scaling and the post processing, when it is safe,
+ * done in threads; qd itself is left in the queue for the caller, the others are done
+ * returns FALSE when it is not worth it, nothing is done then
+ */
+static gboolean rt_queue_draw_batch(RendererTiles *rt, QueueData *qd, gboolean fast)
+{
+#ifdef HAVE_GTHREAD
+	PixbufRenderer *pr = rt->pr;
+	ParallelBatch *scaling = NULL;
+	GList *batch = NULL;
+	GList *work;
+	gint threads;
+	gint count = 0;
+
+	/* source tiles are requested from the main thread while rendering */
+	if (!pr->pixbuf || pr->source_tiles_enabled) return FALSE;
+
+	/* unscaled tiles are just copied, unless they need post processing */
+	if (pr->scale == 1.0 &&
+	    !(pr->post_process_threaded && rt_tile_post_process_needed(rt, fast))) return FALSE;
+
+	threads = get_cpu_cores();
+	if (threads < 2) return FALSE;
+
+	work = (qd->it->qd == qd) ? rt->draw_queue : rt->draw_queue_2pass;
+	while (work && count < threads * RT_SCALE_BATCH_PER_THREAD)
+		{
+		QueueData *bqd = work->data;
+		TileBatchItem *item;
+
+		work = work->next;
+
+		/* visible tiles in the queue are not freed to make space */
+		if (!rt_tile_is_visible(rt, bqd->it)) break;
+
+		item = g_new0(TileBatchItem, 1);
+		item->qd = bqd;
+		batch = g_list_prepend(batch, item);
+		count++;
+		}
+	batch = g_list_reverse(batch);
+
+	for (work = batch; work; work = work->next)
+		{
+		TileBatchItem *item = work->data;
+		QueueData *bqd = item->qd;
+
+		item->x = bqd->x;
+		item->y = bqd->y;
+		item->w = bqd->w;
+		item->h = bqd->h;
+		if (!rt_tile_expose_clamp(rt, bqd->it, &item->x, &item->y, &item->w, &item->h)) continue;
+		item->exposed = TRUE;
+
+		item->rx = item->x;
+		item->ry = item->y;
+		item->rw = item->w;
+		item->rh = item->h;
+		item->scale = rt_tile_render_prepare(rt, bqd->it, &item->rx, &item->ry, &item->rw, &item->rh,
+						     bqd->new_data, fast, &item->ts);
+		if (item->scale)
+			{
+			item->ts.spare = rt_spare_tile_take(rt);
+			item->post_process = (pr->post_process_threaded && !bqd->it->blank &&
+					      rt_tile_post_process_needed(rt, item->ts.fast));
+			if (!scaling) scaling = parallel_batch_new();
+			parallel_batch_push(scaling, rt_tile_scale_thread, item);
+			}
+		}
+
+	/* wait for the scaling */
+	if (scaling) parallel_batch_wait(scaling);
+
+	for (work = batch; work; work = work->next)
+		{
+		TileBatchItem *item = work->data;
+		ImageTile *it = item->qd->it;
+
+		if (item->scale)
+			{
+			it->pixbuf = item->ts.pixbuf;
+			rt->spare_tiles = g_list_prepend(rt->spare_tiles, item->ts.spare);
+			if (item->post_process)
+				{
+				rt_tile_render_blit(rt, it, item->rx, item->ry, item->rw, item->rh);
+				}
+			else
+				{
+				rt_tile_render_finish(rt, it, item->rx, item->ry, item->rw, item->rh, item->ts.fast);
+				}
+			}
+		if (item->exposed) rt_tile_expose_draw(rt, it, item->x, item->y, item->w, item->h);
+
+		if (item->qd != qd) rt_queue_draw_done(rt, item->qd, fast);
+		g_free(item);
+		}
+	g_list_free(batch);
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
 static gboolean rt_queue_draw_idle_cb(gpointer data)
 {
 	RendererTiles *rt = data;
@@ -1622,7 +1959,10 @@ static gboolean rt_queue_draw_idle_cb(gpointer data)
 		{
 		if (rt_tile_is_visible(rt, qd->it))
 			{
-			rt_tile_expose(rt, qd->it, qd->x, qd->y, qd->w, qd->h, qd->new_data, fast);
+			if (!rt_queue_draw_batch(rt, qd, fast))
+				{
+				rt_tile_expose(rt, qd->it, qd->x, qd->y, qd->w, qd->h, qd->new_data, fast);
+				}
 			}
 		else if (qd->new_data)
 			{
@@ -1635,34 +1975,7 @@ static gboolean rt_queue_draw_idle_cb(gpointer data)
 			}
 		}
 
-	if (rt->draw_queue)
-		{
-		qd->it->qd = NULL;
-		rt->draw_queue = g_list_remove(rt->draw_queue, qd);
-		if (fast)
-			{
-			if (qd->it->qd2)
-				{
-				rt_queue_merge(qd->it->qd2, qd);
-				g_free(qd);
-				}
-			else
-				{
-				qd->it->qd2 = qd;
-				rt->draw_queue_2pass = g_list_append(rt->draw_queue_2pass, qd);
-				}
-			}
-		else
-			{
-			g_free(qd);
-			}
-		}
-	else
-		{
-		qd->it->qd2 = NULL;
-		rt->draw_queue_2pass = g_list_remove(rt->draw_queue_2pass, qd);
-		g_free(qd);
-		}
+	rt_queue_draw_done(rt, qd, fast);
 
 	if (!rt->draw_queue && !rt->draw_queue_2pass)
 		{
@@ -2091,7 +2404,13 @@ static void renderer_free(void *renderer)
 	RendererTiles *rt = (RendererTiles *)renderer;
 	rt_queue_clear(rt);
 	rt_tile_free_all(rt);
+	g_hash_table_destroy(rt->tile_table);
 	if (rt->spare_tile) g_object_unref(rt->spare_tile);
+	while (rt->spare_tiles)
+		{
+		g_object_unref(rt->spare_tiles->data);
+		rt->spare_tiles = g_list_delete_link(rt->spare_tiles, rt->spare_tiles);
+		}
 	if (rt->overlay_buffer) g_object_unref(rt->overlay_buffer);
 	rt_overlay_list_clear(rt);
 	/* disconnect "hierarchy-changed" */
@@ -2179,7 +2498,8 @@ RendererFuncs *renderer_tiles_new(PixbufRenderer *pr)
 	rt->tile_width = PR_TILE_SIZE;
 	rt->tile_height = PR_TILE_SIZE;
 
-	rt->tiles = NULL;
+	g_queue_init(&rt->tiles);
+	rt->tile_table = g_hash_table_new(rt_tile_hash, rt_tile_equal);
 	rt->tile_cache_size = 0;
 
 	rt->tile_cache_max = PR_CACHE_SIZE_DEFAULT;
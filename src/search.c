@@ -23,11 +23,14 @@
 #include "search.h"
 
 #include "cache.h"
+#include "cache-metadb.h"
+#include "cache-simdb.h"
 #include "collect.h"
 #include "collect-table.h"
 #include "dnd.h"
 #include "dupe.h"
 #include "editors.h"
+#include "exif.h"
 #include "filedata.h"
 #include "image-load.h"
 #include "img-view.h"
@@ -63,6 +66,8 @@
 #define SEARCH_BUFFER_MATCH_MISS 1
 #define SEARCH_BUFFER_FLUSH_SIZE 99
 
+#define SEARCH_COUNTRY_BATCH 64	/* file positions looked up in the timezone database at once */
+
 typedef enum {
 	SEARCH_MATCH_NONE,
 	SEARCH_MATCH_EQUAL,
@@ -228,10 +233,13 @@ struct _SearchData
 	*/
 	gint search_gps;
 	gdouble search_lat, search_lon;
+	gchar *search_country;		/* country code at the position */
+	GHashTable *search_countries;	/* FileData -> country code, looked up ahead */
 	GtkWidget *entry_gps_coord;
 	GtkWidget *check_gps;
 	GtkWidget *spin_gps;
 	GtkWidget *units_gps;
+	GtkWidget *label_gps_from;
 	GtkWidget *menu_gps;
 	gboolean match_gps_enable;
 
@@ -300,7 +308,8 @@ static const MatchList text_search_menu_rating[] = {
 static const MatchList text_search_menu_gps[] = {
 	{ N_("not geocoded"),	SEARCH_MATCH_NONE },
 	{ N_("less than"),	SEARCH_MATCH_UNDER },
-	{ N_("greater than"),	SEARCH_MATCH_OVER }
+	{ N_("greater than"),	SEARCH_MATCH_OVER },
+	{ N_("in the country of"),	SEARCH_MATCH_EQUAL }
 };
 
 static const MatchList text_search_menu_class[] = {
@@ -1706,6 +1715,8 @@ static void search_stop(SearchData *sd)
 	g_list_free(sd->search_done_list);
 	sd->search_done_list = NULL;
 
+	if (sd->search_countries) g_hash_table_remove_all(sd->search_countries);
+
 	filelist_free(sd->search_file_list);
 	sd->search_file_list = NULL;
 
@@ -1725,10 +1736,13 @@ static void search_file_load_process(SearchData *sd, CacheData *cd)
 
 	if (cd && pixbuf)
 		{
-		if (!cd->dimensions)
+		gint width;
+		gint height;
+
+		if (!cd->dimensions &&
+		    image_loader_get_image_size(sd->img_loader, &width, &height))
 			{
-			cache_sim_data_set_dimensions(cd, gdk_pixbuf_get_width(pixbuf),
-							  gdk_pixbuf_get_height(pixbuf));
+			cache_sim_data_set_dimensions(cd, width, height);
 			}
 
 		if (sd->match_similarity_enable && !cd->similarity)
@@ -1743,22 +1757,7 @@ static void search_file_load_process(SearchData *sd, CacheData *cd)
 		if (options->thumbnails.enable_caching &&
 		    sd->img_loader && image_loader_get_fd(sd->img_loader))
 			{
-			gchar *base;
-			const gchar *path;
-			mode_t mode = 0755;
-
-			path = image_loader_get_fd(sd->img_loader)->path;
-			base = cache_get_location(CACHE_TYPE_SIM, path, FALSE, &mode);
-			if (recursive_mkdir_if_not_exists(base, mode))
-				{
-				g_free(cd->path);
-				cd->path = cache_get_location(CACHE_TYPE_SIM, path, TRUE, NULL);
-				if (cache_sim_data_save(cd))
-					{
-					filetime_set(cd->path, filetime(image_loader_get_fd(sd->img_loader)->path));
-					}
-				}
-			g_free(base);
+			cache_sim_db_save(image_loader_get_fd(sd->img_loader)->path, cd);
 			}
 		}
 
@@ -1783,16 +1782,9 @@ static gboolean search_file_do_extra(SearchData *sd, FileData *fd, gint *match,
 
 	if (!sd->img_cd)
 		{
-		gchar *cd_path;
-
 		new_data = TRUE;
 
-		cd_path = cache_find_location(CACHE_TYPE_SIM, fd->path);
-		if (cd_path && filetime(fd->path) == filetime(cd_path))
-			{
-			sd->img_cd = cache_sim_data_load(cd_path);
-			}
-		g_free(cd_path);
+		sd->img_cd = cache_sim_db_load(fd->path);
 		}
 
 	if (!sd->img_cd)
@@ -1806,6 +1798,12 @@ static gboolean search_file_do_extra(SearchData *sd, FileData *fd, gint *match,
 		    (sd->match_similarity_enable && !sd->img_cd->similarity))
 			{
 			sd->img_loader = image_loader_new(fd);
+			image_loader_set_queue_priority(sd->img_loader, IMAGE_LOADER_PRIORITY_BACKGROUND);
+			if (!sd->match_dimensions_enable || sd->img_cd->dimensions)
+				{
+				/* only the similarity grid is needed */
+				image_loader_set_requested_size(sd->img_loader, IMAGE_SIM_LOAD_SIZE, IMAGE_SIM_LOAD_SIZE);
+				}
 			g_signal_connect(G_OBJECT(sd->img_loader), "error", (GCallback)search_file_load_done_cb, sd);
 			g_signal_connect(G_OBJECT(sd->img_loader), "done", (GCallback)search_file_load_done_cb, sd);
 			if (image_loader_start(sd->img_loader))
@@ -1885,9 +1883,88 @@ static gboolean search_file_do_extra(SearchData *sd, FileData *fd, gint *match,
 	return FALSE;
 }
 
+/* the indexed metadata of fd, looked up on first use */
+static CacheMetaData *search_file_meta(FileData *fd, CacheMetaData **md)
+{
+	if (!*md) *md = cache_meta_db_get(fd);
+	return *md;
+}
+
+/* whether fd is in the country of the search position; the countries of
+ * the next files with indexed positions are looked up at once with it
+ */
+static gboolean search_file_in_country(SearchData *sd, FileData *fd, CacheMetaData **md)
+{
+	ExifTimezone tz[SEARCH_COUNTRY_BATCH];
+	FileData *files[SEARCH_COUNTRY_BATCH];
+	gdouble latitude;
+	gdouble longitude;
+	gdouble direction;
+	const gchar *country;
+	gboolean match;
+	GList *work;
+	guint count = 0;
+	guint i;
+
+	if (!sd->search_countries)
+		{
+		sd->search_countries = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+		}
+
+	if (!g_hash_table_lookup(sd->search_countries, fd))
+		{
+		/* fd itself is read if it is not indexed */
+		if (!cache_meta_db_load_position(fd, &latitude, &longitude, &direction))
+			{
+			latitude = search_file_meta(fd, md)->latitude;
+			longitude = (*md)->longitude;
+			}
+		if (latitude == CACHE_META_NO_COORD)
+			{
+			g_hash_table_insert(sd->search_countries, fd, g_strdup(""));
+			}
+		else
+			{
+			files[count] = fd;
+			tz[count].latitude = latitude;
+			tz[count].longitude = longitude;
+			count++;
+			}
+
+		for (work = sd->search_file_list, i = 0; work && i < SEARCH_COUNTRY_BATCH && count < SEARCH_COUNTRY_BATCH; work = work->next, i++)
+			{
+			FileData *next = work->data;
+
+			if (next == fd || g_hash_table_lookup(sd->search_countries, next)) continue;
+			if (!cache_meta_db_load_position(next, &latitude, &longitude, &direction) ||
+			    latitude == CACHE_META_NO_COORD) continue;
+
+			files[count] = next;
+			tz[count].latitude = latitude;
+			tz[count].longitude = longitude;
+			count++;
+			}
+
+		exif_timezone_lookup_list(tz, count);
+		for (i = 0; i < count; i++)
+			{
+			g_hash_table_insert(sd->search_countries, files[i],
+					    g_strdup(tz[i].countryalpha2 ? tz[i].countryalpha2 : ""));
+			exif_timezone_clear(&tz[i]);
+			}
+		}
+
+	country = g_hash_table_lookup(sd->search_countries, fd);
+	match = (g_strcmp0(country, sd->search_country) == 0);
+	g_hash_table_remove(sd->search_countries, fd);
+
+	return match;
+}
+
 static gboolean search_file_next(SearchData *sd)
 {
 	FileData *fd;
+	CacheMetaData *md = NULL;
 	gboolean match = TRUE;
 	gboolean tested = FALSE;
 	gboolean extra_only = FALSE;
@@ -1979,14 +2056,12 @@ static gboolean search_file_next(SearchData *sd)
 		else if (g_strcmp0(gtk_combo_box_text_get_active_text(
 						GTK_COMBO_BOX_TEXT(sd->date_type)), _("Original")) == 0)
 			{
-			read_exif_time_data(fd);
-			file_date = fd->exifdate;
+			file_date = search_file_meta(fd, &md)->exifdate;
 			}
 		else if (g_strcmp0(gtk_combo_box_text_get_active_text(
 						GTK_COMBO_BOX_TEXT(sd->date_type)), _("Digitized")) == 0)
 			{
-			read_exif_time_digitized_data(fd);
-			file_date = fd->exifdate_digitized;
+			file_date = search_file_meta(fd, &md)->exifdate_digitized;
 			}
 		else
 			{
@@ -2035,7 +2110,7 @@ static gboolean search_file_next(SearchData *sd)
 		tested = TRUE;
 		match = FALSE;
 
-		list = metadata_read_list(fd, KEYWORD_KEY, METADATA_PLAIN);
+		list = search_file_meta(fd, &md)->keywords;
 
 		if (list)
 			{
@@ -2100,7 +2175,6 @@ static gboolean search_file_next(SearchData *sd)
 
 				match = !found;
 				}
-			string_list_free(list);
 			}
 		else
 			{
@@ -2115,7 +2189,7 @@ static gboolean search_file_next(SearchData *sd)
 		tested = TRUE;
 		match = FALSE;
 
-		comment = metadata_read_string(fd, COMMENT_KEY, METADATA_PLAIN);
+		comment = g_strdup(search_file_meta(fd, &md)->comment);
 
 		if (comment)
 			{
@@ -2148,7 +2222,8 @@ static gboolean search_file_next(SearchData *sd)
 		match = FALSE;
 		gint rating;
 
-		rating = metadata_read_int(fd, RATING_KEY, 0);
+		rating = search_file_meta(fd, &md)->rating;
+		if (rating == STAR_RATING_NOT_READ) rating = 0;
 		if (sd->match_rating == SEARCH_MATCH_EQUAL)
 			{
 			match = (rating == sd->search_rating);
@@ -2264,15 +2339,17 @@ static gboolean search_file_next(SearchData *sd)
 
 	if (match && sd->match_gps_enable)
 		{
-		/* Calculate the distance the image is from the specified origin.
-		* This is a standard algorithm. A simplified one may be faster.
-		*/
-		#define RADIANS  0.0174532925
+		/* The distance the image is from the specified origin, as an angle
+		 * on a sphere the size of the earth. The index of the directory
+		 * finds the positions in range without reading the files.
+		 */
 		#define KM_EARTH_RADIUS 6371
 		#define MILES_EARTH_RADIUS 3959
 		#define NAUTICAL_MILES_EARTH_RADIUS 3440
 
-		gdouble latitude, longitude, range, conversion;
+		CacheMetaArea area;
+		CacheMetaAreaMatch area_match;
+		gdouble latitude, conversion;
 
 		if (g_strcmp0(gtk_combo_box_text_get_active_text(
 						GTK_COMBO_BOX_TEXT(sd->units_gps)), _("km")) == 0)
@@ -2292,28 +2369,41 @@ static gboolean search_file_next(SearchData *sd)
 		tested = TRUE;
 		match = FALSE;
 
-		latitude = metadata_read_GPS_coord(fd, "Xmp.exif.GPSLatitude", 1000);
-		longitude = metadata_read_GPS_coord(fd, "Xmp.exif.GPSLongitude", 1000);
-		if (latitude != 1000 && longitude != 1000)
+		if (sd->match_gps == SEARCH_MATCH_EQUAL)
 			{
-			range = conversion * acos(sin(latitude * RADIANS) *
-						sin(sd->search_lat * RADIANS) + cos(latitude * RADIANS) *
-						cos(sd->search_lat * RADIANS) * cos((sd->search_lon -
-						longitude) * RADIANS));
+			match = search_file_in_country(sd, fd, &md);
+			}
+		else
+			{
+			cache_meta_area_set(&area, sd->search_lat, sd->search_lon, sd->search_gps / conversion);
+
+			area_match = md ? CACHE_META_AREA_UNKNOWN : cache_meta_db_match_area(fd, &area);
+			if (area_match == CACHE_META_AREA_UNKNOWN)
+				{
+				latitude = search_file_meta(fd, &md)->latitude;
+				if (latitude == CACHE_META_NO_COORD)
+					{
+					area_match = CACHE_META_AREA_NO_POSITION;
+					}
+				else
+					{
+					area_match = cache_meta_area_contains(&area, latitude, md->longitude) ?
+						     CACHE_META_AREA_INSIDE : CACHE_META_AREA_OUTSIDE;
+					}
+				}
+
 			if (sd->match_gps == SEARCH_MATCH_UNDER)
 				{
-				if (sd->search_gps >= range)
-					match = TRUE;
+				match = (area_match == CACHE_META_AREA_INSIDE);
 				}
 			else if (sd->match_gps == SEARCH_MATCH_OVER)
 				{
-				if (sd->search_gps < range)
-					match = TRUE;
+				match = (area_match == CACHE_META_AREA_OUTSIDE);
+				}
+			else if (sd->match_gps == SEARCH_MATCH_NONE)
+				{
+				match = (area_match == CACHE_META_AREA_NO_POSITION);
 				}
-			}
-		else if (sd->match_gps == SEARCH_MATCH_NONE)
-			{
-			match = TRUE;
 			}
 		}
 
@@ -2324,11 +2414,14 @@ static gboolean search_file_next(SearchData *sd)
 
 		if (search_file_do_extra(sd, fd, &match, &width, &height, &sim))
 			{
+			cache_meta_data_free(md);
 			sd->search_buffer_count += SEARCH_BUFFER_MATCH_LOAD;
 			return TRUE;
 			}
 		}
 
+	cache_meta_data_free(md);
+
 	sd->search_file_list = g_list_remove(sd->search_file_list, fd);
 
 	if (tested && match)
@@ -2542,14 +2635,7 @@ static void search_start(SearchData *sd)
 	    !sd->search_similarity_cd &&
 	    isfile(sd->search_similarity_path))
 		{
-		gchar *cd_path;
-
-		cd_path = cache_find_location(CACHE_TYPE_SIM, sd->search_similarity_path);
-		if (cd_path && filetime(sd->search_similarity_path) == filetime(cd_path))
-			{
-			sd->search_similarity_cd = cache_sim_data_load(cd_path);
-			}
-		g_free(cd_path);
+		sd->search_similarity_cd = cache_sim_db_load(sd->search_similarity_path);
 
 		if (!sd->search_similarity_cd || !sd->search_similarity_cd->similarity)
 			{
@@ -2559,6 +2645,7 @@ static void search_start(SearchData *sd)
 				}
 
 			sd->img_loader = image_loader_new(file_data_new_group(sd->search_similarity_path));
+			image_loader_set_requested_size(sd->img_loader, IMAGE_SIM_LOAD_SIZE, IMAGE_SIM_LOAD_SIZE);
 			g_signal_connect(G_OBJECT(sd->img_loader), "error", (GCallback)search_similarity_load_done_cb, sd);
 			g_signal_connect(G_OBJECT(sd->img_loader), "done", (GCallback)search_similarity_load_done_cb, sd);
 			if (image_loader_start(sd->img_loader))
@@ -2634,6 +2721,25 @@ static void search_start_cb(GtkWidget *widget, gpointer data)
 				}
 			g_free(entry_text);
 			}
+		if (sd->match_gps == SEARCH_MATCH_EQUAL)
+			{
+			ExifTimezone tz;
+
+			tz.latitude = sd->search_lat;
+			tz.longitude = sd->search_lon;
+			exif_timezone_lookup(&tz);
+
+			g_free(sd->search_country);
+			sd->search_country = g_strdup(tz.countryalpha2);
+			exif_timezone_clear(&tz);
+			if (!sd->search_country)
+				{
+				file_util_warning_dialog(_("No country found"),
+							 _("The position is not in a known country."),
+							 GTK_STOCK_DIALOG_WARNING, sd->window);
+				return;
+				}
+			}
 		}
 
 	string_list_free(sd->search_keyword_list);
@@ -2941,6 +3047,9 @@ static void menu_choice_gps_cb(GtkWidget *combo, gpointer data)
 
 	menu_choice_set_visible(gtk_widget_get_parent(sd->spin_gps),
 					(sd->match_gps != SEARCH_MATCH_NONE));
+	menu_choice_set_visible(sd->spin_gps, (sd->match_gps != SEARCH_MATCH_EQUAL));
+	menu_choice_set_visible(sd->units_gps, (sd->match_gps != SEARCH_MATCH_EQUAL));
+	menu_choice_set_visible(sd->label_gps_from, (sd->match_gps != SEARCH_MATCH_EQUAL));
 }
 
 static GtkWidget *menu_spin(GtkWidget *box, gdouble min, gdouble max, gint value,
@@ -3089,6 +3198,8 @@ static void search_window_destroy_cb(GtkWidget *widget, gpointer data)
 		}
 	g_free(sd->search_similarity_path);
 	string_list_free(sd->search_keyword_list);
+	g_free(sd->search_country);
+	if (sd->search_countries) g_hash_table_destroy(sd->search_countries);
 
 	file_data_unregister_notify_func(search_notify_cb, sd);
 
@@ -3349,7 +3460,7 @@ void search_new(FileData *dir_fd, FileData *example_file)
 	gtk_widget_set_tooltip_text(sd->units_gps, "kilometres, miles or nautical miles");
 	gtk_widget_show(sd->units_gps);
 
-	pref_label_new(hbox2, _("from"));
+	sd->label_gps_from = pref_label_new(hbox2, _("from"));
 
 	sd->entry_gps_coord = gtk_entry_new();
 	gtk_editable_set_editable(GTK_EDITABLE(sd->entry_gps_coord), TRUE);
@@ -329,15 +329,147 @@ static gdouble alternate_image_sim_compare_fast(ImageSimilarityData *a, ImageSim
 }
 #endif
 
-gdouble image_sim_compare_transfo(ImageSimilarityData *a, ImageSimilarityData *b, gchar transfo)
+/*
+ * The compare functions treat the three channel grids as one block of
+ * IMAGE_SIM_GRID_SIZE bytes, avg_r, avg_g and avg_b are adjacent in ImageSimilarityData.
+ * The rotated and mirrored variants are built as transformed copies of the grid,
+ * so every compare is a plain sum of absolute differences.
+ */
+
+#define IMAGE_SIM_GRID_SIZE (1024 * 3)
+#define IMAGE_SIM_SAD_BLOCK 256		/* bytes compared between checks of the fast cutoff */
+
+G_STATIC_ASSERT(G_STRUCT_OFFSET(ImageSimilarityData, avg_r) == 0);
+G_STATIC_ASSERT(G_STRUCT_OFFSET(ImageSimilarityData, avg_b) == 2048);
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define IMAGE_SIM_SAD_X86 1
+#  include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define IMAGE_SIM_SAD_NEON 1
+#  include <arm_neon.h>
+#endif
+
+typedef guint (*ImageSimSadFunc)(const guint8 *a, const guint8 *b, gint len);
+
+static ImageSimSadFunc image_sim_sad = NULL;
+
+static guint image_sim_sad_c(const guint8 *a, const guint8 *b, gint len)
 {
-	gint sim;
-	gint i1, i2, *i;
-	gint j1, j2, *j;
+	guint sim = 0;
+	gint i;
 
-	if (!a || !b || !a->filled || !b->filled) return 0.0;
+	for (i = 0; i < len; i++)
+		{
+		sim += abs(a[i] - b[i]);
+		}
 
-	sim = 0.0;
+	return sim;
+}
+
+#ifdef IMAGE_SIM_SAD_X86
+__attribute__((target("sse2")))
+static guint image_sim_sad_sse2(const guint8 *a, const guint8 *b, gint len)
+{
+	__m128i acc = _mm_setzero_si128();
+	gint i;
+
+	for (i = 0; i < len; i += 16)
+		{
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+		}
+
+	return _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+}
+
+__attribute__((target("avx2")))
+static guint image_sim_sad_avx2(const guint8 *a, const guint8 *b, gint len)
+{
+	__m256i acc = _mm256_setzero_si256();
+	__m128i sum;
+	gint i;
+
+	for (i = 0; i < len; i += 32)
+		{
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+		}
+
+	sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+
+	return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+#endif
+
+#ifdef IMAGE_SIM_SAD_NEON
+static guint image_sim_sad_neon(const guint8 *a, const guint8 *b, gint len)
+{
+	uint32x4_t acc = vdupq_n_u32(0);
+	gint i;
+
+	for (i = 0; i < len; i += 16)
+		{
+		uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+		acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+		}
+
+	return vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) +
+	       vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+}
+#endif
+
+/* picks the best kernel for this cpu, once */
+static ImageSimSadFunc image_sim_sad_get(void)
+{
+	static gsize sad_init = 0;
+
+	if (g_once_init_enter(&sad_init))
+		{
+		ImageSimSadFunc func = image_sim_sad_c;
+		const gchar *name = "C";
+
+#ifdef IMAGE_SIM_SAD_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			{
+			func = image_sim_sad_avx2;
+			name = "AVX2";
+			}
+		else if (__builtin_cpu_supports("sse2"))
+			{
+			func = image_sim_sad_sse2;
+			name = "SSE2";
+			}
+#endif
+#ifdef IMAGE_SIM_SAD_NEON
+		func = image_sim_sad_neon;
+		name = "NEON";
+#endif
+		DEBUG_1("Similarity compare uses %s kernel", name);
+
+		image_sim_sad = func;
+		g_once_init_leave(&sad_init, 1);
+		}
+
+	return image_sim_sad;
+}
+
+/*
+4 rotations (0, 90, 180, 270) combined with two mirrors (0, H)
+generate all possible isometric transformations
+= 8 tests
+= change dir of x, change dir of y, exchange x and y = 2^3 = 8
+*/
+static void image_sim_transfo_fill(ImageSimilarityData *dest, ImageSimilarityData *src, gint transfo)
+{
+	gint i1, i2, *i;
+	gint j1, j2, *j;
 
 	if (transfo & 1) { i = &j2; j = &i2; } else { i = &i2; j = &j2; }
 	for (j1 = 0; j1 < 32; j1++)
@@ -346,15 +478,58 @@ gdouble image_sim_compare_transfo(ImageSimilarityData *a, ImageSimilarityData *b
 		for (i1 = 0; i1 < 32; i1++)
 			{
 			if (transfo & 4) *i = 31-i1; else *i = i1;
-			sim += abs(a->avg_r[i1*32+j1] - b->avg_r[i2*32+j2]);
-			sim += abs(a->avg_g[i1*32+j1] - b->avg_g[i2*32+j2]);
-			sim += abs(a->avg_b[i1*32+j1] - b->avg_b[i2*32+j2]);
+			dest->avg_r[i1*32+j1] = src->avg_r[i2*32+j2];
+			dest->avg_g[i1*32+j1] = src->avg_g[i2*32+j2];
+			dest->avg_b[i1*32+j1] = src->avg_b[i2*32+j2];
 			}
 		}
 
+	dest->filled = src->filled;
+}
+
+static gdouble image_sim_compare_grid(ImageSimilarityData *a, ImageSimilarityData *b)
+{
+	guint sim;
+
+	sim = image_sim_sad_get()((const guint8 *)a, (const guint8 *)b, IMAGE_SIM_GRID_SIZE);
+
 	return 1.0 - ((gdouble)sim / (255.0 * 1024.0 * 3.0));
 }
 
+/* this uses a cutoff point so that it can abort early when it gets to
+ * a point that can simply no longer make the cut-off point.
+ */
+static gdouble image_sim_compare_grid_fast(ImageSimilarityData *a, ImageSimilarityData *b, gdouble min)
+{
+	ImageSimSadFunc sad = image_sim_sad_get();
+	guint sim = 0;
+	gint i;
+
+	min = 1.0 - min;
+
+	for (i = 0; i < IMAGE_SIM_GRID_SIZE; i += IMAGE_SIM_SAD_BLOCK)
+		{
+		sim += sad((const guint8 *)a + i, (const guint8 *)b + i, IMAGE_SIM_SAD_BLOCK);
+
+		/* check for abort, if so return 0.0 */
+		if ((gdouble)sim / (255.0 * 1024.0 * 3.0) > min) return 0.0;
+		}
+
+	return (1.0 - ((gdouble)sim / (255.0 * 1024.0 * 3.0)) );
+}
+
+gdouble image_sim_compare_transfo(ImageSimilarityData *a, ImageSimilarityData *b, gchar transfo)
+{
+	ImageSimilarityData tb;
+
+	if (!a || !b || !a->filled || !b->filled) return 0.0;
+
+	if (transfo == 0) return image_sim_compare_grid(a, b);
+
+	image_sim_transfo_fill(&tb, b, transfo);
+	return image_sim_compare_grid(a, &tb);
+}
+
 gdouble image_sim_compare(ImageSimilarityData *a, ImageSimilarityData *b)
 {
 	gint max_t = (options->rot_invariant_sim ? 8 : 1);
@@ -370,18 +545,9 @@ gdouble image_sim_compare(ImageSimilarityData *a, ImageSimilarityData *b)
 	return max_score;
 }
 
-
-/*
-4 rotations (0, 90, 180, 270) combined with two mirrors (0, H)
-generate all possible isometric transformations
-= 8 tests
-= change dir of x, change dir of y, exchange x and y = 2^3 = 8
-*/
 gdouble image_sim_compare_fast_transfo(ImageSimilarityData *a, ImageSimilarityData *b, gdouble min, gchar transfo)
 {
-	gint sim;
-	gint i1, i2, *i;
-	gint j1, j2, *j;
+	ImageSimilarityData tb;
 
 #ifdef ALTERNATE_INCLUDE_COMPARE_CHANGE
 	if (alternate_enabled) return alternate_image_sim_compare_fast(a, b, min);
@@ -389,30 +555,12 @@ gdouble image_sim_compare_fast_transfo(ImageSimilarityData *a, ImageSimilarityDa
 
 	if (!a || !b || !a->filled || !b->filled) return 0.0;
 
-	min = 1.0 - min;
-	sim = 0.0;
+	if (transfo == 0) return image_sim_compare_grid_fast(a, b, min);
 
-	if (transfo & 1) { i = &j2; j = &i2; } else { i = &i2; j = &j2; }
-	for (j1 = 0; j1 < 32; j1++)
-		{
-		if (transfo & 2) *j = 31-j1; else *j = j1;
-		for (i1 = 0; i1 < 32; i1++)
-			{
-			if (transfo & 4) *i = 31-i1; else *i = i1;
-			sim += abs(a->avg_r[i1*32+j1] - b->avg_r[i2*32+j2]);
-			sim += abs(a->avg_g[i1*32+j1] - b->avg_g[i2*32+j2]);
-			sim += abs(a->avg_b[i1*32+j1] - b->avg_b[i2*32+j2]);
-			}
-		/* check for abort, if so return 0.0 */
-		if ((gdouble)sim / (255.0 * 1024.0 * 3.0) > min) return 0.0;
-		}
-
-	return (1.0 - ((gdouble)sim / (255.0 * 1024.0 * 3.0)) );
+	image_sim_transfo_fill(&tb, b, transfo);
+	return image_sim_compare_grid_fast(a, &tb, min);
 }
 
-/* this uses a cutoff point so that it can abort early when it gets to
- * a point that can simply no longer make the cut-off point.
- */
 gdouble image_sim_compare_fast(ImageSimilarityData *a, ImageSimilarityData *b, gdouble min)
 {
 	gint max_t = (options->rot_invariant_sim ? 8 : 1);
@@ -422,9 +570,282 @@ gdouble image_sim_compare_fast(ImageSimilarityData *a, ImageSimilarityData *b, g
 
 	for(t = 0; t < max_t; t++)
 	{
-		score = image_sim_compare_fast_transfo(a, b, min, t);
+		/* a variant below the best one found so far can not change the result */
+		score = image_sim_compare_fast_transfo(a, b, MAX(min, max_score), t);
 		if (score > max_score) max_score = score;
 	}
 	return max_score;
 }
+
+/*
+ * When one grid is compared against many others (the duplicate finder's needle),
+ * its transformed variants are built once with image_sim_transfo_new().
+ */
+ImageSimilarityTransfo *image_sim_transfo_new(ImageSimilarityData *sd)
+{
+	ImageSimilarityTransfo *st;
+	gint t;
+
+	if (!sd) return NULL;
+
+	st = g_new(ImageSimilarityTransfo, 1);
+	st->count = (options->rot_invariant_sim ? 8 : 1);
+
+	st->sd[0] = *sd;
+	for (t = 1; t < st->count; t++)
+		{
+		image_sim_transfo_fill(&st->sd[t], sd, t);
+		}
+
+	return st;
+}
+
+void image_sim_transfo_free(ImageSimilarityTransfo *st)
+{
+	g_free(st);
+}
+
+gdouble image_sim_transfo_compare_fast(ImageSimilarityData *a, ImageSimilarityTransfo *st, gdouble min)
+{
+	gint t;
+	gdouble score, max_score = 0;
+
+	if (!a || !st || !a->filled || !st->sd[0].filled) return 0.0;
+
+#ifdef ALTERNATE_INCLUDE_COMPARE_CHANGE
+	if (alternate_enabled) return alternate_image_sim_compare_fast(a, &st->sd[0], min);
+#endif
+
+	for (t = 0; t < st->count; t++)
+		{
+		score = image_sim_compare_grid_fast(a, &st->sd[t], MAX(min, max_score));
+		if (score > max_score) max_score = score;
+		}
+
+	return max_score;
+}
+
+/*
+ * Index for finding the grids within reach of a similarity threshold without
+ * comparing against all of them.
+ *
+ * Each grid is reduced to a coarse signature, the sums of 4 x 4 blocks of 8 x 8
+ * cells for each channel. The L1 distance of two signatures is never more than
+ * the L1 distance of the full grids, so a range search on the signatures returns
+ * every grid that can pass the threshold (and some that will not). The blocks map
+ * onto each other under rotation and mirroring, the transformed grids of
+ * ImageSimilarityTransfo are searched the same way.
+ *
+ * The signatures are searched with a vantage point tree built in place: the
+ * node for the range ids[lo..hi) has its vantage point at ids[lo], the closer
+ * half of the rest follows it and mu[lo] is the distance splitting the halves.
+ */
+
+#define IMAGE_SIM_COARSE_SIZE (4 * 4 * 3)
+#define IMAGE_SIM_INDEX_LEAF 16		/* ranges this small are scanned */
+
+struct _ImageSimilarityIndex
+{
+	gint count;
+	guint16 *coarse;		/* count * IMAGE_SIM_COARSE_SIZE */
+	gint *ids;			/* tree order */
+	guint *mu;
+};
+
+typedef struct _ImageSimilarityIndexEntry ImageSimilarityIndexEntry;
+struct _ImageSimilarityIndexEntry
+{
+	gint id;
+	guint dist;
+};
+
+static void image_sim_coarse_fill(guint16 *coarse, ImageSimilarityData *sd)
+{
+	gint c, x, y;
+
+	memset(coarse, 0, sizeof(guint16) * IMAGE_SIM_COARSE_SIZE);
+	if (!sd) return;
+
+	for (c = 0; c < 3; c++)
+		{
+		const guint8 *grid = (const guint8 *)sd + c * 1024;
+
+		for (y = 0; y < 32; y++)
+			{
+			for (x = 0; x < 32; x++)
+				{
+				coarse[c * 16 + (y / 8) * 4 + x / 8] += grid[y * 32 + x];
+				}
+			}
+		}
+}
+
+static guint image_sim_coarse_distance(const guint16 *a, const guint16 *b)
+{
+	guint dist = 0;
+	gint i;
+
+	for (i = 0; i < IMAGE_SIM_COARSE_SIZE; i++)
+		{
+		dist += abs(a[i] - b[i]);
+		}
+
+	return dist;
+}
+
+static gint image_sim_index_entry_sort_cb(gconstpointer a, gconstpointer b)
+{
+	const ImageSimilarityIndexEntry *ea = a;
+	const ImageSimilarityIndexEntry *eb = b;
+
+	if (ea->dist < eb->dist) return -1;
+	if (ea->dist > eb->dist) return 1;
+	return 0;
+}
+
+static void image_sim_index_build(ImageSimilarityIndex *si, gint lo, gint hi, ImageSimilarityIndexEntry *entries)
+{
+	const guint16 *vp;
+	gint mid;
+	gint i;
+
+	if (hi - lo <= IMAGE_SIM_INDEX_LEAF) return;
+
+	vp = si->coarse + si->ids[lo] * IMAGE_SIM_COARSE_SIZE;
+	for (i = lo + 1; i < hi; i++)
+		{
+		entries[i].id = si->ids[i];
+		entries[i].dist = image_sim_coarse_distance(vp, si->coarse + si->ids[i] * IMAGE_SIM_COARSE_SIZE);
+		}
+
+	qsort(entries + lo + 1, hi - lo - 1, sizeof(ImageSimilarityIndexEntry), image_sim_index_entry_sort_cb);
+
+	for (i = lo + 1; i < hi; i++)
+		{
+		si->ids[i] = entries[i].id;
+		}
+
+	mid = lo + 1 + (hi - lo - 1) / 2;
+	si->mu[lo] = entries[mid].dist;
+
+	image_sim_index_build(si, lo + 1, mid, entries);
+	image_sim_index_build(si, mid, hi, entries);
+}
+
+ImageSimilarityIndex *image_sim_index_new(ImageSimilarityData **sd, gint count)
+{
+	ImageSimilarityIndex *si;
+	ImageSimilarityIndexEntry *entries;
+	gint i;
+
+	si = g_new0(ImageSimilarityIndex, 1);
+	si->count = count;
+	si->coarse = g_new(guint16, count * IMAGE_SIM_COARSE_SIZE);
+	si->ids = g_new(gint, count);
+	si->mu = g_new0(guint, count);
+
+	for (i = 0; i < count; i++)
+		{
+		image_sim_coarse_fill(si->coarse + i * IMAGE_SIM_COARSE_SIZE, sd[i]);
+		si->ids[i] = i;
+		}
+
+	entries = g_new(ImageSimilarityIndexEntry, count);
+	image_sim_index_build(si, 0, count, entries);
+	g_free(entries);
+
+	return si;
+}
+
+void image_sim_index_free(ImageSimilarityIndex *si)
+{
+	if (!si) return;
+
+	g_free(si->coarse);
+	g_free(si->ids);
+	g_free(si->mu);
+	g_free(si);
+}
+
+static void image_sim_index_search(ImageSimilarityIndex *si, gint lo, gint hi, const guint16 *coarse, guint radius, GArray *found)
+{
+	guint dist;
+	gint mid;
+	gint i;
+
+	if (hi - lo <= IMAGE_SIM_INDEX_LEAF)
+		{
+		for (i = lo; i < hi; i++)
+			{
+			if (image_sim_coarse_distance(coarse, si->coarse + si->ids[i] * IMAGE_SIM_COARSE_SIZE) <= radius)
+				{
+				g_array_append_val(found, si->ids[i]);
+				}
+			}
+		return;
+		}
+
+	dist = image_sim_coarse_distance(coarse, si->coarse + si->ids[lo] * IMAGE_SIM_COARSE_SIZE);
+	if (dist <= radius) g_array_append_val(found, si->ids[lo]);
+
+	mid = lo + 1 + (hi - lo - 1) / 2;
+	if (dist <= si->mu[lo] + radius) image_sim_index_search(si, lo + 1, mid, coarse, radius, found);
+	if (dist + radius >= si->mu[lo]) image_sim_index_search(si, mid, hi, coarse, radius, found);
+}
+
+static gint image_sim_index_id_sort_cb(gconstpointer a, gconstpointer b)
+{
+	return *(const gint *)a - *(const gint *)b;
+}
+
+/*
+ * Returns the sorted positions (in the array given to image_sim_index_new()) of all
+ * grids that may match any variant of st with a similarity of at least min.
+ * Free the result with g_array_free().
+ */
+GArray *image_sim_index_find(ImageSimilarityIndex *si, ImageSimilarityTransfo *st, gdouble min)
+{
+	GArray *found;
+	guint16 coarse[IMAGE_SIM_COARSE_SIZE];
+	guint radius;
+	gint t;
+
+	found = g_array_new(FALSE, FALSE, sizeof(gint));
+	if (!si || !st) return found;
+
+	min = CLAMP(min, 0.0, 1.0);
+	radius = (guint)((1.0 - min) * 255.0 * 1024.0 * 3.0) + 1;
+#ifdef ALTERNATE_INCLUDE_COMPARE_CHANGE
+	/* the alternate compare divides a larger sum, the grid distance can reach this far */
+	if (alternate_enabled) radius = (guint)((1.0 - min) * 255.0 * 1024.0 * 4.0) + 1;
+#endif
+
+	for (t = 0; t < st->count; t++)
+		{
+		image_sim_coarse_fill(coarse, &st->sd[t]);
+		image_sim_index_search(si, 0, si->count, coarse, radius, found);
+		}
+
+	g_array_sort(found, image_sim_index_id_sort_cb);
+
+	if (st->count > 1 && found->len > 1)
+		{
+		gint *ids = (gint *)found->data;
+		guint n = 1;
+		guint i;
+
+		for (i = 1; i < found->len; i++)
+			{
+			if (ids[i] != ids[n - 1])
+				{
+				ids[n] = ids[i];
+				n++;
+				}
+			}
+		g_array_set_size(found, n);
+		}
+
+	return found;
+}
+
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
@@ -22,6 +22,8 @@
 #ifndef SIMILAR_H
 #define SIMILAR_H
 
+/* the grid needs only a small image, loaders are asked for this size */
+#define IMAGE_SIM_LOAD_SIZE 256
 
 typedef struct _ImageSimilarityData ImageSimilarityData;
 struct _ImageSimilarityData
@@ -33,6 +35,16 @@ struct _ImageSimilarityData
 	gboolean filled;
 };
 
+/* rotated and mirrored copies of one grid, see image_sim_transfo_new() */
+typedef struct _ImageSimilarityTransfo ImageSimilarityTransfo;
+struct _ImageSimilarityTransfo
+{
+	gint count;			/* 1, or 8 with options->rot_invariant_sim */
+	ImageSimilarityData sd[8];
+};
+
+typedef struct _ImageSimilarityIndex ImageSimilarityIndex;
+
 
 ImageSimilarityData *image_sim_new(void);
 void image_sim_free(ImageSimilarityData *sd);
@@ -43,6 +55,14 @@ ImageSimilarityData *image_sim_new_from_pixbuf(GdkPixbuf *pixbuf);
 gdouble image_sim_compare(ImageSimilarityData *a, ImageSimilarityData *b);
 gdouble image_sim_compare_fast(ImageSimilarityData *a, ImageSimilarityData *b, gdouble min);
 
+ImageSimilarityTransfo *image_sim_transfo_new(ImageSimilarityData *sd);
+void image_sim_transfo_free(ImageSimilarityTransfo *st);
+gdouble image_sim_transfo_compare_fast(ImageSimilarityData *a, ImageSimilarityTransfo *st, gdouble min);
+
+ImageSimilarityIndex *image_sim_index_new(ImageSimilarityData **sd, gint count);
+void image_sim_index_free(ImageSimilarityIndex *si);
+GArray *image_sim_index_find(ImageSimilarityIndex *si, ImageSimilarityTransfo *st, gdouble min);
+
 
 void image_sim_alternate_set(gboolean enable);
 gboolean image_sim_alternate_enabled(void);
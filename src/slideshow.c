@@ -196,6 +196,20 @@ gboolean slideshow_should_continue(SlideShowData *ss)
 	return FALSE;
 }
 
+static FileData *slideshow_get_fd(SlideShowData *ss, gint row)
+{
+	if (ss->filelist) return g_list_nth_data(ss->filelist, row);
+
+	if (ss->cd)
+		{
+		CollectInfo *info = g_list_nth_data(ss->cd->list, row);
+
+		return info ? info->fd : NULL;
+		}
+
+	return layout_list_get_fd(ss->lw, row);
+}
+
 static gboolean slideshow_step(SlideShowData *ss, gboolean forward)
 {
 	gint row;
@@ -271,34 +285,29 @@ static gboolean slideshow_step(SlideShowData *ss, gboolean forward)
 		}
 
 	/* read ahead */
-	if (options->image.enable_read_ahead && (!ss->lw || ss->from_selection))
+	if (options->image.enable_read_ahead)
 		{
-		gint r;
-		if (forward)
-			{
-			if (!ss->list) return TRUE;
-			r = GPOINTER_TO_INT(ss->list->data);
-			}
-		else
-			{
-			if (!ss->list_done || !ss->list_done->next) return TRUE;
-			r = GPOINTER_TO_INT(ss->list_done->next->data);
-			}
+		GList *ahead = forward ? ss->list : (ss->list_done ? ss->list_done->next : NULL);
+		GList *behind = forward ? (ss->list_done ? ss->list_done->next : NULL) : ss->list;
+		GList *list = NULL;
+		gint i;
 
-		if (ss->filelist)
-			{
-			image_prebuffer_set(ss->imd, g_list_nth_data(ss->filelist, r));
-			}
-		else if (ss->cd)
+		if (!ahead) return TRUE;
+
+		for (i = 0; ahead && i < options->image.read_ahead_count; i++, ahead = ahead->next)
 			{
-			CollectInfo *info;
-			info = g_list_nth_data(ss->cd->list, r);
-			if (info) image_prebuffer_set(ss->imd, info->fd);
+			FileData *fd = slideshow_get_fd(ss, GPOINTER_TO_INT(ahead->data));
+			if (fd) list = g_list_prepend(list, fd);
 			}
-		else if (ss->from_selection)
+		for (i = 0; behind && i < options->image.read_ahead_behind; i++, behind = behind->next)
 			{
-			image_prebuffer_set(ss->lw->image, layout_list_get_fd(ss->lw, r));
+			FileData *fd = slideshow_get_fd(ss, GPOINTER_TO_INT(behind->data));
+			if (fd) list = g_list_prepend(list, fd);
 			}
+		list = g_list_reverse(list);
+
+		image_prebuffer_set_list(ss->lw ? ss->lw->image : ss->imd, list);
+		g_list_free(list);
 		}
 
 	return TRUE;
@@ -530,6 +530,10 @@ struct _ImageWindow
 
 	FileData *read_ahead_fd;
 	ImageLoader *read_ahead_il;
+	GList *read_ahead_window;	/* further images loaded into the cache, see image_prebuffer_set_list() */
+	gulong read_ahead_size;		/* bytes of the last decoded image, the window is sized by it */
+
+	gpointer tiles;		/* ImageTiles of a huge image shown in tiles, see image_load_tiles() */
 
 	gint prev_color_row;
 
@@ -889,8 +893,10 @@ struct _ViewFile
 
 	/* thumbs updates*/
 	gboolean thumbs_running;
-	ThumbLoader *thumbs_loader;
-	FileData *thumbs_filedata;
+	GList *thumbs_jobs;		/* running thumb loaders, see vf_thumb_next() */
+	GList *thumbs_done;		/* FileData with a new thumb, not yet in the view */
+	guint thumbs_done_id;		/* event source id */
+	guint thumbs_scroll_id;		/* event source id */
 
 	/* marks */
 	gboolean marks_enabled;
@@ -905,6 +911,7 @@ struct _ViewFile
 	GList *editmenu_fd_list;
 
 	guint read_metadata_in_idle_id;
+	guint read_metadata_in_idle_quick_pos;	/* files before it had their headers read */
 };
 
 struct _ViewFileInfoList
@@ -978,14 +978,38 @@ gboolean md5_get_digest_from_file_utf8(const gchar *path, guchar digest[16])
 	return success;
 }
 
+gboolean digest_get_from_file_ends_utf8(DigestType type, const gchar *path, gsize length, guchar digest[16])
+{
+	gboolean success;
+	gchar *pathl;
 
-gchar *md5_text_from_file_utf8(const gchar *path, const gchar *error_text)
+	pathl = path_from_utf8(path);
+	success = digest_get_from_file_ends(type, pathl, length, digest);
+	g_free(pathl);
+
+	return success;
+}
+
+
+gchar *digest_text_from_file_utf8(DigestType type, const gchar *path, const gchar *error_text)
 {
 	guchar digest[16];
+	gboolean success;
+	gchar *pathl;
+
+	pathl = path_from_utf8(path);
+	success = digest_get_from_file(type, pathl, digest);
+	g_free(pathl);
 
-	if (!md5_get_digest_from_file_utf8(path, digest)) return g_strdup(error_text);
+	if (!success) return g_strdup(error_text);
 
-	return md5_digest_to_text(digest);
+	return digest_to_text(type, digest);
+}
+
+
+gchar *md5_text_from_file_utf8(const gchar *path, const gchar *error_text)
+{
+	return digest_text_from_file_utf8(DIGEST_TYPE_MD5, path, error_text);
 }
 
 
@@ -28,6 +28,8 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include "md5-util.h"
+
 
 
 void print_term(gboolean err, const gchar *text_utf8);
@@ -109,5 +111,9 @@ gboolean recursive_mkdir_if_not_exists(const gchar *path, mode_t mode);
 gchar *md5_text_from_file_utf8(const gchar *path, const gchar *error_text);
 gboolean md5_get_digest_from_file_utf8(const gchar *path, guchar digest[16]);
 
+/* same for any digest type */
+gchar *digest_text_from_file_utf8(DigestType type, const gchar *path, const gchar *error_text);
+gboolean digest_get_from_file_ends_utf8(DigestType type, const gchar *path, gsize length, guchar digest[16]);
+
 #endif
 /* vim: set shiftwidth=8 softtabstop=0 cindent cinoptions={1s: */
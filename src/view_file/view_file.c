@@ -25,9 +25,11 @@
 #include "collect.h"
 #include "collect-table.h"
 #include "editors.h"
+#include "filedata.h"
 #include "history_list.h"
 #include "layout.h"
 #include "menu.h"
+#include "misc.h"
 #include "pixbuf_util.h"
 #include "thumb.h"
 #include "ui_menu.h"
@@ -739,6 +741,9 @@ static void vf_destroy_cb(GtkWidget *widget, gpointer data)
 		gtk_widget_destroy(vf->popup);
 		}
 
+	g_signal_handlers_disconnect_matched(G_OBJECT(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(vf->scrolled))),
+					     G_SIGNAL_MATCH_DATA, 0, 0, 0, NULL, vf);
+
 	if (vf->read_metadata_in_idle_id)
 		{
 		g_idle_remove_by_data(vf);
@@ -1017,6 +1022,8 @@ void vf_mark_filter_toggle(ViewFile *vf, gint mark)
 				     !gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(vf->filter_check[n])));
 }
 
+static void vf_thumb_scroll_cb(GtkAdjustment *adjustment, gpointer data);
+
 ViewFile *vf_new(FileViewType type, FileData *dir_fd)
 {
 	ViewFile *vf;
@@ -1063,6 +1070,9 @@ ViewFile *vf_new(FileViewType type, FileData *dir_fd)
 	gtk_container_add(GTK_CONTAINER(vf->scrolled), vf->listview);
 	gtk_widget_show(vf->listview);
 
+	g_signal_connect(G_OBJECT(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(vf->scrolled))), "value_changed",
+			 G_CALLBACK(vf_thumb_scroll_cb), vf);
+
 	if (dir_fd) vf_set_fd(vf, dir_fd);
 
 	return vf;
@@ -1090,6 +1100,16 @@ void vf_thumb_set(ViewFile *vf, gboolean enable)
 }
 
 
+#define VF_THUMB_DONE_DELAY 100	/* ms, finished thumbs are passed to the view together */
+
+typedef struct _ViewFileThumbJob ViewFileThumbJob;
+struct _ViewFileThumbJob
+{
+	ViewFile *vf;
+	ThumbLoader *tl;
+	FileData *fd;
+};
+
 static gboolean vf_thumb_next(ViewFile *vf);
 
 static gdouble vf_thumb_progress(ViewFile *vf)
@@ -1138,24 +1158,120 @@ static void vf_thumb_status(ViewFile *vf, gdouble val, const gchar *text)
 		}
 }
 
+static gboolean vf_thumb_is_visible(ViewFile *vf, FileData *fd)
+{
+	switch (vf->type)
+	{
+	case FILEVIEW_LIST: return vflist_thumb_is_visible(vf, fd);
+	case FILEVIEW_ICON: return vficon_thumb_is_visible(vf, fd);
+	}
+
+	return FALSE;
+}
+
+static gint vf_thumb_jobs_max(void)
+{
+	if (options->thumbnails.jobs > 0) return options->thumbnails.jobs;
+
+	return get_cpu_cores();
+}
+
+gboolean vf_thumb_is_loading(ViewFile *vf, FileData *fd)
+{
+	GList *work;
+
+	for (work = vf->thumbs_jobs; work; work = work->next)
+		{
+		ViewFileThumbJob *job = work->data;
+
+		if (job->fd == fd) return TRUE;
+		}
+
+	return FALSE;
+}
+
+static void vf_thumb_done_flush(ViewFile *vf)
+{
+	GList *work;
+
+	if (vf->thumbs_done_id)
+		{
+		g_source_remove(vf->thumbs_done_id);
+		vf->thumbs_done_id = 0;
+		}
+
+	if (!vf->thumbs_done) return;
+
+	vf->thumbs_done = g_list_reverse(vf->thumbs_done);
+	for (work = vf->thumbs_done; work; work = work->next)
+		{
+		vf_set_thumb_fd(vf, work->data);
+		}
+	filelist_free(vf->thumbs_done);
+	vf->thumbs_done = NULL;
+
+	vf_thumb_status(vf, vf_thumb_progress(vf), _("Loading thumbs..."));
+}
+
+static gboolean vf_thumb_done_timeout_cb(gpointer data)
+{
+	ViewFile *vf = data;
+
+	vf->thumbs_done_id = 0;
+	vf_thumb_done_flush(vf);
+
+	return FALSE;
+}
+
 static void vf_thumb_do(ViewFile *vf, FileData *fd)
 {
 	if (!fd) return;
 
-	vf_set_thumb_fd(vf, fd);
-	vf_thumb_status(vf, vf_thumb_progress(vf), _("Loading thumbs..."));
+	/* the view is updated in batches, not once per thumb */
+	vf->thumbs_done = g_list_prepend(vf->thumbs_done, file_data_ref(fd));
+	if (!vf->thumbs_done_id)
+		{
+		vf->thumbs_done_id = g_timeout_add(VF_THUMB_DONE_DELAY, vf_thumb_done_timeout_cb, vf);
+		}
+}
+
+static void vf_thumb_job_free(ViewFileThumbJob *job)
+{
+	if (!job) return;
+
+	thumb_loader_free(job->tl);
+	file_data_unref(job->fd);
+	g_free(job);
 }
 
 void vf_thumb_cleanup(ViewFile *vf)
 {
+	GList *work;
+
 	vf_thumb_status(vf, 0.0, NULL);
 
 	vf->thumbs_running = FALSE;
 
-	thumb_loader_free(vf->thumbs_loader);
-	vf->thumbs_loader = NULL;
+	for (work = vf->thumbs_jobs; work; work = work->next)
+		{
+		vf_thumb_job_free(work->data);
+		}
+	g_list_free(vf->thumbs_jobs);
+	vf->thumbs_jobs = NULL;
+
+	if (vf->thumbs_done_id)
+		{
+		g_source_remove(vf->thumbs_done_id);
+		vf->thumbs_done_id = 0;
+		}
+	filelist_free(vf->thumbs_done);
+	vf->thumbs_done = NULL;
 
-	vf->thumbs_filedata = NULL;
+	if (vf->thumbs_scroll_id)
+		{
+		g_source_remove(vf->thumbs_scroll_id);
+		vf->thumbs_scroll_id = 0;
+		}
 }
 
 void vf_thumb_stop(ViewFile *vf)
@@ -1163,16 +1279,23 @@ void vf_thumb_stop(ViewFile *vf)
 	if (vf->thumbs_running) vf_thumb_cleanup(vf);
 }
 
+static void vf_thumb_fill(ViewFile *vf)
+{
+	gint jobs = vf_thumb_jobs_max();
+
+	while (vf->thumbs_running && (gint)g_list_length(vf->thumbs_jobs) < jobs && vf_thumb_next(vf));
+}
+
 static void vf_thumb_common_cb(ThumbLoader *tl, gpointer data)
 {
-	ViewFile *vf = data;
+	ViewFileThumbJob *job = data;
+	ViewFile *vf = job->vf;
 
-	if (vf->thumbs_filedata && vf->thumbs_loader == tl)
-		{
-		vf_thumb_do(vf, vf->thumbs_filedata);
-		}
+	vf->thumbs_jobs = g_list_remove(vf->thumbs_jobs, job);
+	vf_thumb_do(vf, job->fd);
+	vf_thumb_job_free(job);
 
-	while (vf_thumb_next(vf));
+	vf_thumb_fill(vf);
 }
 
 static void vf_thumb_error_cb(ThumbLoader *tl, gpointer data)
@@ -1185,9 +1308,47 @@ static void vf_thumb_done_cb(ThumbLoader *tl, gpointer data)
 	vf_thumb_common_cb(tl, data);
 }
 
+static FileData *vf_thumb_next_fd(ViewFile *vf)
+{
+	switch (vf->type)
+	{
+	case FILEVIEW_LIST: return vflist_thumb_next_fd(vf);
+	case FILEVIEW_ICON: return vficon_thumb_next_fd(vf);
+	}
+
+	return NULL;
+}
+
+static void vf_thumb_start(ViewFile *vf, FileData *fd)
+{
+	ViewFileThumbJob *job;
+
+	job = g_new0(ViewFileThumbJob, 1);
+	job->vf = vf;
+	job->fd = file_data_ref(fd);
+	job->tl = thumb_loader_new(options->thumbnails.max_width, options->thumbnails.max_height);
+	thumb_loader_set_callbacks(job->tl,
+				   vf_thumb_done_cb,
+				   vf_thumb_error_cb,
+				   NULL,
+				   job);
+
+	if (!thumb_loader_start(job->tl, fd))
+		{
+		/* set icon to unknown, continue */
+		DEBUG_1("thumb loader start failed %s", fd->path);
+		vf_thumb_do(vf, fd);
+		vf_thumb_job_free(job);
+		return;
+		}
+
+	vf->thumbs_jobs = g_list_prepend(vf->thumbs_jobs, job);
+}
+
+/* starts one more thumb, returns FALSE when there is nothing left to start */
 static gboolean vf_thumb_next(ViewFile *vf)
 {
-	FileData *fd = NULL;
+	FileData *fd;
 
 	if (!gtk_widget_get_realized(vf->listview))
 		{
@@ -1195,42 +1356,65 @@ static gboolean vf_thumb_next(ViewFile *vf)
 		return FALSE;
 		}
 
-	switch (vf->type)
-	{
-	case FILEVIEW_LIST: fd = vflist_thumb_next_fd(vf); break;
-	case FILEVIEW_ICON: fd = vficon_thumb_next_fd(vf); break;
-	}
-
+	fd = vf_thumb_next_fd(vf);
 	if (!fd)
 		{
-		/* done */
-		vf_thumb_cleanup(vf);
+		/* done when the last running loader has finished */
+		if (!vf->thumbs_jobs)
+			{
+			vf_thumb_done_flush(vf);
+			vf_thumb_cleanup(vf);
+			}
 		return FALSE;
 		}
 
-	vf->thumbs_filedata = fd;
+	vf_thumb_start(vf, fd);
 
-	thumb_loader_free(vf->thumbs_loader);
+	return TRUE;
+}
 
-	vf->thumbs_loader = thumb_loader_new(options->thumbnails.max_width, options->thumbnails.max_height);
-	thumb_loader_set_callbacks(vf->thumbs_loader,
-				   vf_thumb_done_cb,
-				   vf_thumb_error_cb,
-				   NULL,
-				   vf);
+static gboolean vf_thumb_scroll_idle_cb(gpointer data)
+{
+	ViewFile *vf = data;
+	GList *work;
 
-	if (!thumb_loader_start(vf->thumbs_loader, fd))
+	vf->thumbs_scroll_id = 0;
+
+	/* loaders of rows scrolled out of view make room for visible ones */
+	work = vf->thumbs_jobs;
+	while (work)
 		{
-		/* set icon to unknown, continue */
-		DEBUG_1("thumb loader start failed %s", fd->path);
-		vf_thumb_do(vf, fd);
+		ViewFileThumbJob *job = work->data;
+		FileData *fd;
 
-		return TRUE;
+		work = work->next;
+
+		if (vf_thumb_is_visible(vf, job->fd)) continue;
+
+		fd = vf_thumb_next_fd(vf);
+		if (!fd || !vf_thumb_is_visible(vf, fd)) break;
+
+		DEBUG_1("thumb loader cancelled, not visible %s", job->fd->path);
+		vf->thumbs_jobs = g_list_remove(vf->thumbs_jobs, job);
+		vf_thumb_job_free(job);
+
+		vf_thumb_start(vf, fd);
 		}
 
+	vf_thumb_fill(vf);
+
 	return FALSE;
 }
 
+static void vf_thumb_scroll_cb(GtkAdjustment *adjustment, gpointer data)
+{
+	ViewFile *vf = data;
+
+	if (!vf->thumbs_running || vf->thumbs_scroll_id) return;
+
+	vf->thumbs_scroll_id = g_idle_add(vf_thumb_scroll_idle_cb, vf);
+}
+
 static void vf_thumb_reset_all(ViewFile *vf)
 {
 	GList *work;
@@ -1261,7 +1445,7 @@ void vf_thumb_update(ViewFile *vf)
 		thumb_format_changed = FALSE;
 		}
 
-	while (vf_thumb_next(vf));
+	vf_thumb_fill(vf);
 }
 
 
@@ -1438,6 +1622,9 @@ void vf_notify_cb(FileData *fd, NotifyType type, gpointer data)
 		}
 }
 
+#define VF_READ_METADATA_QUICK_CHUNK 256	/* files with headers read in one idle call */
+
+/* a chunk of the files from the index or their headers first, the rest one by one */
 static gboolean vf_read_metadata_in_idle_cb(gpointer data)
 {
 	FileData *fd;
@@ -1447,6 +1634,32 @@ static gboolean vf_read_metadata_in_idle_cb(gpointer data)
 
 	vf_thumb_status(vf, vf_read_metadata_in_idle_progress(vf), _("Loading meta..."));
 
+	work = g_list_nth(vf->list, vf->read_metadata_in_idle_quick_pos);
+	if (work)
+		{
+		GList *chunk = NULL;
+		GList *slow;
+		guint n;
+
+		for (n = 0; work && n < VF_READ_METADATA_QUICK_CHUNK; n++)
+			{
+			fd = work->data;
+			if (fd && !fd->metadata_in_idle_loaded) chunk = g_list_prepend(chunk, fd);
+			work = work->next;
+			}
+		vf->read_metadata_in_idle_quick_pos += n;
+
+		slow = read_exif_sort_data_quick(chunk);
+		for (work = chunk; work; work = work->next)
+			{
+			fd = work->data;
+			if (!g_list_find(slow, fd)) fd->metadata_in_idle_loaded = TRUE;
+			}
+		g_list_free(slow);
+		g_list_free(chunk);
+		return TRUE;
+		}
+
 	work = vf->list;
 
 	while (work)
@@ -1455,18 +1668,7 @@ static gboolean vf_read_metadata_in_idle_cb(gpointer data)
 
 		if (fd && !fd->metadata_in_idle_loaded)
 			{
-			if (!fd->exifdate)
-				{
-				read_exif_time_data(fd);
-				}
-			if (!fd->exifdate_digitized)
-				{
-				read_exif_time_digitized_data(fd);
-				}
-			if (fd->rating == STAR_RATING_NOT_READ)
-				{
-				read_rating_data(fd);
-				}
+			read_exif_sort_data(fd);
 			fd->metadata_in_idle_loaded = TRUE;
 			return TRUE;
 			}
@@ -1499,6 +1701,7 @@ void vf_read_metadata_in_idle(ViewFile *vf)
 		g_idle_remove_by_data(vf);
 		}
 	vf->read_metadata_in_idle_id = 0;
+	vf->read_metadata_in_idle_quick_pos = 0;
 
 	if (vf->list)
 		{
@@ -1775,7 +1775,7 @@ FileData *vficon_thumb_next_fd(ViewFile *vf)
 			for (; list; list = list->next)
 				{
 				FileData *fd = list->data;
-				if (fd && !fd->thumb_pixbuf) return fd;
+				if (fd && !fd->thumb_pixbuf && !vf_thumb_is_loading(vf, fd)) return fd;
 				}
 
 			valid = gtk_tree_model_iter_next(store, &iter);
@@ -1790,12 +1790,21 @@ FileData *vficon_thumb_next_fd(ViewFile *vf)
 
 		// Note: This implementation differs from view_file_list.c because sidecar files are not
 		// distinct list elements here, as they are in the list view.
-		if (!fd->thumb_pixbuf) return fd;
+		if (!fd->thumb_pixbuf && !vf_thumb_is_loading(vf, fd)) return fd;
 		}
 
 	return NULL;
 }
 
+gboolean vficon_thumb_is_visible(ViewFile *vf, FileData *fd)
+{
+	GtkTreeIter iter;
+
+	if (!vficon_find_iter(vf, fd, &iter, NULL)) return FALSE;
+
+	return (tree_view_row_get_visibility(GTK_TREE_VIEW(vf->listview), &iter, FALSE) == 0);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * row stuff
@@ -73,6 +73,7 @@ void vficon_thumb_progress_count(GList *list, gint *count, gint *done);
 void vficon_read_metadata_progress_count(GList *list, gint *count, gint *done);
 void vficon_set_thumb_fd(ViewFile *vf, FileData *fd);
 FileData *vficon_thumb_next_fd(ViewFile *vf);
+gboolean vficon_thumb_is_visible(ViewFile *vf, FileData *fd);
 void vficon_thumb_reset_all(ViewFile *vf);
 
 #endif
@@ -1220,7 +1220,7 @@ FileData *vflist_thumb_next_fd(ViewFile *vf)
 
 			gtk_tree_model_get(store, &iter, FILE_COLUMN_POINTER, &nfd, -1);
 
-			if (!nfd->thumb_pixbuf) fd = nfd;
+			if (!nfd->thumb_pixbuf && !vf_thumb_is_loading(vf, nfd)) fd = nfd;
 
 			valid = gtk_tree_model_iter_next(store, &iter);
 			}
@@ -1234,7 +1234,7 @@ FileData *vflist_thumb_next_fd(ViewFile *vf)
 		while (work && !fd)
 			{
 			FileData *fd_p = work->data;
-			if (!fd_p->thumb_pixbuf)
+			if (!fd_p->thumb_pixbuf && !vf_thumb_is_loading(vf, fd_p))
 				fd = fd_p;
 			else
 				{
@@ -1243,7 +1243,7 @@ FileData *vflist_thumb_next_fd(ViewFile *vf)
 				while (work2 && !fd)
 					{
 					fd_p = work2->data;
-					if (!fd_p->thumb_pixbuf) fd = fd_p;
+					if (!fd_p->thumb_pixbuf && !vf_thumb_is_loading(vf, fd_p)) fd = fd_p;
 					work2 = work2->next;
 					}
 				}
@@ -1254,6 +1254,15 @@ FileData *vflist_thumb_next_fd(ViewFile *vf)
 	return fd;
 }
 
+gboolean vflist_thumb_is_visible(ViewFile *vf, FileData *fd)
+{
+	GtkTreeIter iter;
+
+	if (vflist_find_row(vf, fd, &iter) < 0) return FALSE;
+
+	return (tree_view_row_get_visibility(GTK_TREE_VIEW(vf->listview), &iter, FALSE) == 0);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * row stuff
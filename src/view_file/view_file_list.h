@@ -73,6 +73,7 @@ void vflist_thumb_progress_count(GList *list, gint *count, gint *done);
 void vflist_read_metadata_progress_count(GList *list, gint *count, gint *done);
 void vflist_set_thumb_fd(ViewFile *vf, FileData *fd);
 FileData *vflist_thumb_next_fd(ViewFile *vf);
+gboolean vflist_thumb_is_visible(ViewFile *vf, FileData *fd);
 void vflist_thumb_reset_all(ViewFile *vf);
 void vflist_pop_menu_show_star_rating_cb(GtkWidget *widget, gpointer data);
 #endif